@@ -0,0 +1,83 @@
+"""
+Convert an edge log written by GPIO.start_edge_log() to a VCD file that can be
+opened in a waveform viewer such as GTKWave.
+
+usage: python edgelog2vcd.py edges.log edges.vcd
+"""
+
+import struct
+import sys
+import time
+
+HEADER = struct.Struct('<8sIIQQ')
+RECORD = struct.Struct('<QII')
+CHUNK = 4096    # records read per pass
+
+def open_log(f):
+    magic, version, record_size, capacity, head = HEADER.unpack(f.read(HEADER.size))
+    if magic != b'GPIOEDGE' or version != 1 or record_size != RECORD.size:
+        raise ValueError('Not a GPIO edge log')
+    # oldest record first once the ring has wrapped
+    first = max(0, head - capacity)
+    return capacity, first, head
+
+def records(f, capacity, first, head):
+    n = first
+    while n < head:
+        slot = n % capacity
+        count = min(CHUNK, head - n, capacity - slot)
+        f.seek(HEADER.size + slot * RECORD.size)
+        data = f.read(count * RECORD.size)
+        for i in range(count):
+            yield RECORD.unpack_from(data, i * RECORD.size)
+        n += count
+
+def vcd_id(i):
+    # identifier codes are printable ASCII from '!' to '~'
+    s = ''
+    while True:
+        s += chr(33 + i % 94)
+        i //= 94
+        if i == 0:
+            return s
+
+def convert(logname, vcdname):
+    with open(logname, 'rb') as f:
+        capacity, first, head = open_log(f)
+
+        # first pass - find the channels and start time for the VCD header
+        gpios = set()
+        start = None
+        for timestamp, gpio, level in records(f, capacity, first, head):
+            gpios.add(gpio)
+            if start is None:
+                start = timestamp
+        ids = dict((gpio, vcd_id(i)) for i, gpio in enumerate(sorted(gpios)))
+
+        with open(vcdname, 'w') as out:
+            out.write('$date %s $end\n' % time.ctime((start or 0) / 1e9))
+            out.write('$version RPi.GPIO edge log $end\n')
+            out.write('$timescale 1ns $end\n')
+            out.write('$scope module gpio $end\n')
+            for gpio in sorted(gpios):
+                out.write('$var wire 1 %s gpio%d $end\n' % (ids[gpio], gpio))
+            out.write('$upscope $end\n$enddefinitions $end\n')
+            out.write('$dumpvars\n')
+            for gpio in sorted(gpios):
+                out.write('x%s\n' % ids[gpio])
+            out.write('$end\n')
+
+            # second pass - stream the value changes
+            last = None
+            for timestamp, gpio, level in records(f, capacity, first, head):
+                # VCD time must not go backwards if the wall clock was stepped
+                timestamp = max(timestamp, last or start)
+                if timestamp != last:
+                    out.write('#%d\n' % (timestamp - start))
+                    last = timestamp
+                out.write('%d%s\n' % (level, ids[gpio]))
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s edges.log edges.vcd' % sys.argv[0])
+    convert(sys.argv[1], sys.argv[2])
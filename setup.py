@@ -43,6 +43,6 @@ setup(name             = 'RPi.GPIO-PineA64',
       url              = 'http://sourceforge.net/projects/raspberry-gpio-python/',
       classifiers      = classifiers,
       packages         = ['RPi','RPi.GPIO', 'RPi.I2C', 'RPi.SPI'],
-      ext_modules      = [Extension('RPi._GPIO', ['source/py_gpio.c', 'source/c_gpio.c', 'source/cpuinfo.c', 'source/event_gpio.c', 'source/soft_pwm.c', 'source/py_pwm.c', 'source/common.c', 'source/constants.c']), 
+      ext_modules      = [Extension('RPi._GPIO', ['source/py_gpio.c', 'source/c_gpio.c', 'source/cpuinfo.c', 'source/event_gpio.c', 'source/soft_pwm.c', 'source/py_pwm.c', 'source/py_servo.c', 'source/py_pdm.c', 'source/hard_pwm.c', 'source/sysfs_pwm.c', 'source/common.c', 'source/constants.c']), 
                            Extension('RPi._I2C', ['source/i2c/i2c.c', 'source/i2c/i2c_lib.c']),
-                           Extension('RPi._SPI', ['source/spi/spi.c', 'source/spi/spi_lib.c'])])
+                           Extension('RPi._SPI', ['source/spi/spi.c', 'source/spi/spi_device.c', 'source/spi/spi_acquisition.c', 'source/spi/spi_acq.c', 'source/spi/spi_framebuffer.c', 'source/spi/spi_fb.c', 'source/spi/spi_flash.c', 'source/spi/spi_nor.c', 'source/spi/spi_lib.c', 'source/spi/spi_pack.c', 'source/spi/spi_bus.c', 'source/spi/sunxi_spi.c', 'source/spi/spi_gpio.c'])])
@@ -97,6 +97,15 @@ static volatile uint32_t *pio_map;
 
 static volatile uint32_t *gpio_map;
 
+// RPI_GPIO_DEVMEM names a file to map instead of /dev/mem.  The file is
+// addressed by physical address, so a sparse file works as a register image.
+const char *devmem_path(void)
+{
+    const char *path = getenv("RPI_GPIO_DEVMEM");
+
+    return (path != NULL && *path) ? path : "/dev/mem";
+}
+
 void short_wait(void)
 {
     int i;
@@ -167,7 +176,7 @@ int setup(void)
   }
 
     // mmap the GPIO memory registers
-    if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0)
+    if ((mem_fd = open(devmem_path(), O_RDWR|O_SYNC) ) < 0)
         return SETUP_DEVMEM_FAIL;
 
     if ((gpio_mem = malloc(BLOCK_SIZE + (PAGE_SIZE-1))) == NULL)
@@ -407,6 +416,22 @@ void output_gpio(int gpio, int value)
   }
 }
 
+// write several pins of one bank at once, used to merge simultaneous PWM edges
+void output_gpio_bank(int bank, uint32_t set, uint32_t clr)
+{
+  if ( pinea64_found )  {
+    sunxi_gpio_t *pio = &((sunxi_gpio_reg_t *) pio_map)->gpio_bank[bank];
+
+    *(&pio->DAT) = (*(&pio->DAT) & ~clr) | set;
+  } else {
+    // clear first so a pin in both masks ends up set, as on the sunxi
+    if (clr)
+        *(gpio_map+CLR_OFFSET+bank) = clr;
+    if (set)
+        *(gpio_map+SET_OFFSET+bank) = set;
+  }
+}
+
 int input_gpio(int gpio)
 {
   if ( pinea64_found )  {
@@ -20,10 +20,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <stdint.h>
+
+const char *devmem_path(void);
 int setup(void);
 void setup_gpio(int gpio, int direction, int pud);
 int gpio_function(int gpio);
 void output_gpio(int gpio, int value);
+void output_gpio_bank(int bank, uint32_t set, uint32_t clr);
 int input_gpio(int gpio);
 void set_rising_event(int gpio, int enable);
 void set_falling_event(int gpio, int enable);
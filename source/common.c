@@ -22,6 +22,8 @@ SOFTWARE.
 
 #include "Python.h"
 #include "c_gpio.h"
+#include "event_gpio.h"
+#include "gpio_api.h"
 #include "common.h"
 
 int gpio_mode = MODE_UNKNOWN;
@@ -34,6 +36,12 @@ rpi_info rpiinfo;
 int setup_error = 0;
 int module_setup = 0;
 
+// owner and number of claims of each gpio, indexed by gpio number
+static struct {
+    unsigned char owner;
+    unsigned int users;
+} gpio_owner[EVENT_GPIO_MAX];
+
 //
 // For Pine A64/A64+ Board
 //
@@ -134,3 +142,30 @@ int get_gpio_number(int channel, unsigned int *gpio, unsigned int *bcm_gpio)
 
     return 0;
 }
+
+int gpio_claim(unsigned int gpio, int owner)
+// return values:
+// 0 - Success
+// 1 - gpio claimed by another owner
+{
+    if (gpio >= EVENT_GPIO_MAX)
+        return 0;
+    if (gpio_owner[gpio].owner != GPIO_OWNER_NONE && gpio_owner[gpio].owner != owner)
+        return 1;
+    gpio_owner[gpio].owner = owner;
+    gpio_owner[gpio].users++;
+    return 0;
+}
+
+void gpio_release(unsigned int gpio, int owner)
+{
+    if (gpio >= EVENT_GPIO_MAX || gpio_owner[gpio].owner != owner)
+        return;
+    if (--gpio_owner[gpio].users == 0)
+        gpio_owner[gpio].owner = GPIO_OWNER_NONE;
+}
+
+int gpio_owned_by(unsigned int gpio)
+{
+    return gpio < EVENT_GPIO_MAX ? gpio_owner[gpio].owner : GPIO_OWNER_NONE;
+}
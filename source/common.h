@@ -43,3 +43,6 @@ extern int setup_error;
 extern int module_setup;
 int check_gpio_priv(void);
 int get_gpio_number(int channel, unsigned int *gpio, unsigned int *bcm_gpio);
+int gpio_claim(unsigned int gpio, int owner);
+void gpio_release(unsigned int gpio, int owner);
+int gpio_owned_by(unsigned int gpio);
@@ -25,6 +25,7 @@ SOFTWARE.
 #include "common.h"
 #include "c_gpio.h"
 #include "event_gpio.h"
+#include "soft_pwm.h"
 
 PyObject *high;
 PyObject *low;
@@ -43,6 +44,9 @@ PyObject *pud_down;
 PyObject *rising_edge;
 PyObject *falling_edge;
 PyObject *both_edge;
+PyObject *ramp_linear;
+PyObject *ramp_exponential;
+PyObject *ramp_gamma;
 
 void define_constants(PyObject *module)
 {
@@ -96,4 +100,13 @@ void define_constants(PyObject *module)
 
    both_edge = Py_BuildValue("i", BOTH_EDGE + PY_EVENT_CONST_OFFSET);
    PyModule_AddObject(module, "BOTH", both_edge);
+
+   ramp_linear = Py_BuildValue("i", RAMP_LINEAR);
+   PyModule_AddObject(module, "RAMP_LINEAR", ramp_linear);
+
+   ramp_exponential = Py_BuildValue("i", RAMP_EXPONENTIAL);
+   PyModule_AddObject(module, "RAMP_EXPONENTIAL", ramp_exponential);
+
+   ramp_gamma = Py_BuildValue("i", RAMP_GAMMA);
+   PyModule_AddObject(module, "RAMP_GAMMA", ramp_gamma);
 }
@@ -40,5 +40,8 @@ extern PyObject *pud_down;
 extern PyObject *rising_edge;
 extern PyObject *falling_edge;
 extern PyObject *both_edge;
+extern PyObject *ramp_linear;
+extern PyObject *ramp_exponential;
+extern PyObject *ramp_gamma;
 
 void define_constants(PyObject *module);
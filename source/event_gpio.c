@@ -21,13 +21,18 @@ SOFTWARE.
 */
 
 #include <pthread.h>
+#include <sched.h>
 #include <sys/epoll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include "event_gpio.h"
 
 const char *stredge[4] = {"none", "rising", "falling", "both"};
@@ -43,6 +48,7 @@ struct gpios
     int thread_added;
     int bouncetime;
     unsigned long long lastcall;
+    int source;         // opened by edge_source_open(), not for event detection
     struct gpios *next;
 };
 struct gpios *gpio_list = NULL;
@@ -57,11 +63,17 @@ struct callback
 struct callback *callbacks = NULL;
 
 static pthread_t threads;
-int event_occurred[54] = { 0 };
+// one bit per gpio, set by the poll thread and fetched/cleared atomically
+static uint64_t event_pending[EVENT_PENDING_WORDS] = { 0 };
 int thread_running = 0;
 int epfd_thread = -1;
 int epfd_blocking = -1;
 
+// edge log - preallocated ring of fixed size records in a mmap()ed file
+static struct edge_log_header *edge_log = NULL;
+static size_t edge_log_size = 0;
+static int edge_log_writers = 0;
+
 /************* /sys/class/gpio functions ************/
 int gpio_export(unsigned int gpio)
 {
@@ -149,6 +161,94 @@ int open_value_file(unsigned int gpio)
     return fd;
 }
 
+/************* edge log functions ************/
+int edge_log_open(const char *path, unsigned int records)
+// return values:
+// 0 - Success
+// 1 - Edge log already open
+// 2 - Other error
+{
+    int fd, err, created = 1;
+    size_t size;
+    void *map;
+
+    if (edge_log != NULL)
+        return 1;
+    if (records == 0)
+        return 2;
+
+    size = sizeof(struct edge_log_header) + (size_t)records * sizeof(struct edge_record);
+    // only a file created here is removed again if setting it up fails
+    if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        created = 0;
+        if (errno != EEXIST || (fd = open(path, O_RDWR | O_TRUNC)) < 0)
+            return 2;
+    }
+
+    // allocate every block now so the poll thread never faults on a full disk
+    if (ftruncate(fd, size) != 0 || (errno = posix_fallocate(fd, 0, size)) != 0)
+        map = MAP_FAILED;
+    else
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        if (created)
+            unlink(path);
+        errno = err;
+        return 2;
+    }
+
+    edge_log = (struct edge_log_header *)map;
+    memcpy(edge_log->magic, EDGE_LOG_MAGIC, sizeof(edge_log->magic));
+    edge_log->version = EDGE_LOG_VERSION;
+    edge_log->record_size = sizeof(struct edge_record);
+    edge_log->capacity = records;
+    edge_log->head = 0;
+    edge_log_size = size;
+    return 0;
+}
+
+void edge_log_close(void)
+{
+    struct edge_log_header *log = edge_log;
+
+    if (log == NULL)
+        return;
+
+    __atomic_store_n(&edge_log, NULL, __ATOMIC_SEQ_CST);
+    // wait for the poll thread to finish any record it has started
+    while (__atomic_load_n(&edge_log_writers, __ATOMIC_SEQ_CST))
+        sched_yield();
+    msync(log, edge_log_size, MS_SYNC);
+    munmap(log, edge_log_size);
+    edge_log_size = 0;
+}
+
+static void edge_log_append(unsigned int gpio, char level)
+{
+    struct edge_log_header *log;
+    struct edge_record *rec;
+    struct timespec ts;
+    uint64_t head;
+
+    __atomic_add_fetch(&edge_log_writers, 1, __ATOMIC_SEQ_CST);
+    if ((log = __atomic_load_n(&edge_log, __ATOMIC_SEQ_CST)) == NULL) {
+        __atomic_sub_fetch(&edge_log_writers, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    head = log->head;
+    rec = (struct edge_record *)(log + 1) + (head % log->capacity);
+    rec->timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->gpio = gpio;
+    rec->level = (level == '1');
+    // publish the record only once it is complete
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&edge_log_writers, 1, __ATOMIC_SEQ_CST);
+}
+
 /********* gpio list functions **********/
 struct gpios *get_gpio(unsigned int gpio)
 {
@@ -204,6 +304,7 @@ struct gpios *new_gpio(unsigned int gpio)
     new_gpio->bouncetime = -666;
     new_gpio->lastcall = 0;
     new_gpio->thread_added = 0;
+    new_gpio->source = 0;
 
     if (gpio_list == NULL) {
         new_gpio->next = NULL;
@@ -345,11 +446,12 @@ void *poll_thread(void *threadarg)
             if (g->initial_thread) {     // ignore first epoll trigger
                 g->initial_thread = 0;
             } else {
+                edge_log_append(g->gpio, buf);
                 gettimeofday(&tv_timenow, NULL);
                 timenow = tv_timenow.tv_sec*1E6 + tv_timenow.tv_usec;
                 if (g->bouncetime == -666 || timenow - g->lastcall > g->bouncetime*1000 || g->lastcall == 0 || g->lastcall > timenow) {
                     g->lastcall = timenow;
-                    event_occurred[g->gpio] = 1;
+                    __atomic_fetch_or(&event_pending[g->gpio / 64], 1ULL << (g->gpio % 64), __ATOMIC_RELEASE);
                     run_callbacks(g->gpio);
                 }
             }
@@ -359,13 +461,10 @@ void *poll_thread(void *threadarg)
     pthread_exit(NULL);
 }
 
-void remove_edge_detect(unsigned int gpio)
+static void remove_gpio(struct gpios *g)
 {
     struct epoll_event ev;
-    struct gpios *g = get_gpio(gpio);
-
-    if (g == NULL)
-        return;
+    unsigned int gpio = g->gpio;
 
     // delete epoll of fd
 
@@ -385,41 +484,91 @@ void remove_edge_detect(unsigned int gpio)
 
     // btc fixme - check return result??
     gpio_unexport(gpio);
-    event_occurred[gpio] = 0;
+    __atomic_fetch_and(&event_pending[gpio / 64], ~(1ULL << (gpio % 64)), __ATOMIC_ACQ_REL);
 
     delete_gpio(gpio);
 }
 
+void remove_edge_detect(unsigned int gpio)
+{
+    struct gpios *g = get_gpio(gpio);
+
+    if (g != NULL && !g->source)
+        remove_gpio(g);
+}
+
+int edge_source_open(unsigned int gpio, unsigned int edge)
+// export gpio as an input with edge detection set, for a caller that polls
+// the value file itself (POLLPRI, then lseek and read to rearm).  Event
+// detection and cleanup leave the gpio alone until edge_source_close().
+// return values:
+//    value file descriptor
+//   -1 - gpio already in use or other error
+{
+    struct gpios *g;
+
+    if (gpio_event_added(gpio) != NO_EDGE)
+        return -1;
+    if ((g = new_gpio(gpio)) == NULL)
+        return -1;
+    g->source = 1;
+    if (gpio_set_edge(gpio, edge) != 0) {
+        remove_gpio(g);
+        return -1;
+    }
+    g->edge = edge;
+    return g->value_fd;
+}
+
+void edge_source_close(unsigned int gpio)
+{
+    struct gpios *g = get_gpio(gpio);
+
+    if (g != NULL && g->source)
+        remove_gpio(g);
+}
+
 int event_detected(unsigned int gpio)
 {
-    if (event_occurred[gpio]) {
-        event_occurred[gpio] = 0;
-        return 1;
-    } else {
-        return 0;
+    uint64_t bit = 1ULL << (gpio % 64);
+
+    return (__atomic_fetch_and(&event_pending[gpio / 64], ~bit, __ATOMIC_ACQ_REL) & bit) != 0;
+}
+
+int events_fetch(uint64_t pending[EVENT_PENDING_WORDS])
+// fetch and clear every pending event, returns the number of gpios that fired
+{
+    int i, count = 0;
+
+    for (i=0; i<EVENT_PENDING_WORDS; i++) {
+        pending[i] = __atomic_exchange_n(&event_pending[i], 0, __ATOMIC_ACQ_REL);
+        count += __builtin_popcountll(pending[i]);
     }
+    return count;
 }
 
 void event_cleanup(unsigned int gpio)
-// gpio of -666 means clean every channel used
+// gpio of -666 means clean every channel used.  Edge sources are left to
+// whoever opened them.
 {
     struct gpios *g = gpio_list;
-    struct gpios *temp = NULL;
+    struct gpios *temp;
 
     while (g != NULL) {
-        if ((gpio == -666) || (g->gpio == gpio))
-            temp = g->next;
-            remove_edge_detect(g->gpio);
-            g = temp;
+        temp = g->next;
+        if (!g->source && (gpio == -666 || g->gpio == gpio))
+            remove_gpio(g);
+        g = temp;
     }
-    if (gpio_list == NULL)
+    if (gpio_list == NULL) {
         if (epfd_blocking != -1)
             close(epfd_blocking);
-            epfd_blocking = -1;
+        epfd_blocking = -1;
         if (epfd_thread != -1)
             close(epfd_thread);
-            epfd_thread = -1;
+        epfd_thread = -1;
         thread_running = 0;
+    }
 }
 
 void event_cleanup_all(void)
@@ -449,7 +598,8 @@ int add_edge_detect(unsigned int gpio, unsigned int edge, int bouncetime)
     } else if (i == edge) {  // get existing event
         g = get_gpio(gpio);
         if ((bouncetime != -666 && g->bouncetime != bouncetime) ||  // different event bouncetime used
-            (g->thread_added))                // event already added
+            (g->thread_added) ||              // event already added
+            (g->source))                      // gpio is an edge source
             return 1;
     } else {
         return 1;
@@ -499,6 +649,8 @@ int blocking_wait_for_edge(unsigned int gpio, unsigned int edge, int bouncetime,
 
     // add gpio if it has not been added already
     ed = gpio_event_added(gpio);
+    if (ed != NO_EDGE && get_gpio(gpio)->source)
+        return -1;
     if (ed == edge) {   // get existing record
         g = get_gpio(gpio);
         if (g->bouncetime != -666 && g->bouncetime != bouncetime) {
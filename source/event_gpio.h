@@ -25,12 +25,45 @@ SOFTWARE.
 #define FALLING_EDGE 2
 #define BOTH_EDGE    3
 
+#include <stdint.h>
+
+// sunxi gpio numbers run up to bank L (11) * 32 + 31
+#define EVENT_GPIO_MAX      384
+#define EVENT_PENDING_WORDS (EVENT_GPIO_MAX / 64)
+
+// On-disk layout of the edge log.  The header is followed by 'capacity'
+// records; 'head' counts every record ever written, so the next slot is
+// head % capacity and the log has wrapped once head > capacity.
+#define EDGE_LOG_MAGIC   "GPIOEDGE"
+#define EDGE_LOG_VERSION 1
+
+struct edge_log_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t head;
+};
+
+struct edge_record
+{
+    uint64_t timestamp;   // ns since the epoch
+    uint32_t gpio;
+    uint32_t level;
+};
+
 int add_edge_detect(unsigned int gpio, unsigned int edge, int bouncetime);
 void remove_edge_detect(unsigned int gpio);
+int edge_source_open(unsigned int gpio, unsigned int edge);
+void edge_source_close(unsigned int gpio);
 int add_edge_callback(unsigned int gpio, void (*func)(unsigned int gpio));
 int event_detected(unsigned int gpio);
+int events_fetch(uint64_t pending[EVENT_PENDING_WORDS]);
 int gpio_event_added(unsigned int gpio);
 int event_initialise(void);
 void event_cleanup(unsigned int gpio);
 void event_cleanup_all(void);
+int edge_log_open(const char *path, unsigned int records);
+void edge_log_close(void);
 int blocking_wait_for_edge(unsigned int gpio, unsigned int edge, int bouncetime, int timeout);
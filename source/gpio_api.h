@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Functions RPi._GPIO lends to the other extensions, so that every module
+   in the process shares one copy of the gpio state.  RPi._GPIO publishes the
+   table as a capsule; users get it with PyCapsule_Import(GPIO_API_CAPSULE). */
+
+#define GPIO_API_CAPSULE "RPi._GPIO._C_API"
+
+// who a gpio is claimed by
+#define GPIO_OWNER_NONE 0
+#define GPIO_OWNER_GPIO 1
+#define GPIO_OWNER_SPI  2
+
+struct gpio_api
+{
+    // map the gpio registers if that has not been done yet, returns 0 or
+    // -1 with a Python exception set
+    int (*map)(void);
+    const char *(*devmem_path)(void);
+    // see c_gpio.c, valid once map() has succeeded
+    void (*setup_gpio)(int gpio, int direction, int pud);
+    void (*output_gpio)(int gpio, int value);
+    // claim returns 0, or 1 if another owner has the gpio.  An owner may
+    // claim a gpio more than once and gives it up on its last release.
+    int (*claim)(unsigned int gpio, int owner);
+    void (*release)(unsigned int gpio, int owner);
+    // see edge_source_open() in event_gpio.c
+    int (*edge_source_open)(unsigned int gpio, unsigned int edge);
+    void (*edge_source_close)(unsigned int gpio);
+};
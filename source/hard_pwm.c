@@ -0,0 +1,241 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "c_gpio.h"
+#include "hard_pwm.h"
+
+#define PWM_PAGE_SIZE       4096
+#define PWM_CLOCK           24000000.0  // OSC24M
+
+// PWM_CH_CTRL
+#define PWM_CTRL            0
+#define PWM_CH0_PRESCAL     0x0000000F
+#define PWM_CH0_EN          (1 << 4)
+#define PWM_CH0_ACT_STA     (1 << 5)
+#define SCLK_CH0_GATING     (1 << 6)
+#define PWM0_RDY            (1 << 28)
+// PWM_CH0_PERIOD - entire cycles - 1 in 31:16, active cycles in 15:0
+#define PWM_PERIOD          1
+
+// pin controller registers in words, banks are 0x24 bytes apart
+#define PIO_BANK_WORDS      9
+#define PIO_MUX_OUTPUT      1
+
+struct hard_pwm_pin
+{
+    unsigned int gpio;          // sunxi gpio number
+    uint32_t pio_base;          // pin controller holding the pin's bank
+    int pio_bank;               // bank index within that controller
+    int func;                   // mux function selecting the PWM output
+    uint32_t pwm_base;
+};
+
+static const struct hard_pwm_pin pins[] = {
+    { 118, 0x01C20800, 3, 2, 0x01C21400 },  // PD22 - PWM0
+    { 362, 0x01F02C00, 0, 2, 0x01F03800 },  // PL10 - S_PWM (R_PWM), header pin 7
+};
+#define NUM_PINS (sizeof(pins) / sizeof(pins[0]))
+
+static volatile uint32_t *pio_regs[NUM_PINS];
+static volatile uint32_t *pwm_regs[NUM_PINS];
+static int claimed[NUM_PINS];   // a PWM object drives the channel, either backend
+
+// prescaler field value and the divider it selects, smallest divider first
+static const struct { uint32_t code; unsigned int div; } prescalers[] = {
+    { 0xF, 1 }, { 0, 120 }, { 1, 180 }, { 2, 240 }, { 3, 360 }, { 4, 480 },
+    { 8, 12000 }, { 9, 24000 }, { 10, 36000 }, { 11, 48000 }, { 12, 72000 },
+};
+#define NUM_PRESCALERS (sizeof(prescalers) / sizeof(prescalers[0]))
+
+static volatile uint32_t *map_registers(int fd, uint32_t phys)
+{
+    uint32_t page = phys & ~(PWM_PAGE_SIZE - 1);
+    uint8_t *map;
+
+    map = mmap(NULL, PWM_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, page);
+    if (map == MAP_FAILED)
+        return NULL;
+    return (volatile uint32_t *)(map + (phys - page));
+}
+
+static void unmap_registers(volatile uint32_t *regs)
+{
+    munmap((void *)((uintptr_t)regs & ~(uintptr_t)(PWM_PAGE_SIZE - 1)), PWM_PAGE_SIZE);
+}
+
+static void set_mux(int pwm, int func)
+{
+    int num = pins[pwm].gpio & 0x1F;
+    volatile uint32_t *cfg = pio_regs[pwm] + pins[pwm].pio_bank * PIO_BANK_WORDS + (num >> 3);
+    int offset = (num & 0x7) << 2;
+
+    *cfg = (*cfg & ~(0x7 << offset)) | (func << offset);
+}
+
+int hard_pwm_find(unsigned int gpio)
+// returns the hardware PWM for a sunxi gpio number, or -1 if there is none
+{
+    unsigned int i;
+
+    for (i=0; i<NUM_PINS; i++)
+        if (pins[i].gpio == gpio)
+            return i;
+    return -1;
+}
+
+int hard_pwm_claim(int pwm)
+// reserve the channel for one PWM object, as its registers are not shared
+// return values:
+// 0 - Success
+// 1 - Already claimed
+{
+    if (claimed[pwm])
+        return 1;
+    claimed[pwm] = 1;
+    return 0;
+}
+
+void hard_pwm_release(int pwm)
+{
+    claimed[pwm] = 0;
+}
+
+uint32_t hard_pwm_base(int pwm)
+// physical address of the controller, which also names its device tree node
+{
+    return pins[pwm].pwm_base;
+}
+
+int hard_pwm_setup(int pwm)
+// map the PWM and pin controller registers and mux the pin to the PWM
+// return values:
+// 0 - Success
+// 1 - Registers could not be mapped
+{
+    int fd;
+
+    if (pwm_regs[pwm] != NULL)
+        return 0;
+
+    if ((fd = open(devmem_path(), O_RDWR|O_SYNC)) < 0)
+        return 1;
+    pio_regs[pwm] = map_registers(fd, pins[pwm].pio_base);
+    pwm_regs[pwm] = map_registers(fd, pins[pwm].pwm_base);
+    close(fd);
+
+    if (pio_regs[pwm] == NULL || pwm_regs[pwm] == NULL) {
+        if (pio_regs[pwm] != NULL)
+            unmap_registers(pio_regs[pwm]);
+        if (pwm_regs[pwm] != NULL)
+            unmap_registers(pwm_regs[pwm]);
+        pio_regs[pwm] = pwm_regs[pwm] = NULL;
+        return 1;
+    }
+
+    // start disabled, active high
+    pwm_regs[pwm][PWM_CTRL] = PWM_CH0_ACT_STA;
+    set_mux(pwm, pins[pwm].func);
+    return 0;
+}
+
+int hard_pwm_config(int pwm, float freq, float dutycycle)
+// return values:
+// 0 - Success
+// 1 - Frequency out of range for the controller
+{
+    volatile uint32_t *regs = pwm_regs[pwm];
+    unsigned int i, retry;
+    double cycles = 0.0;
+    uint32_t entire, active;
+
+    // the smallest divider that fits the period gives the finest duty steps.
+    // The period rounds to at most 65535 cycles so that a 100% duty cycle
+    // still fits the 16 bit active field.
+    for (i=0; i<NUM_PRESCALERS; i++) {
+        cycles = PWM_CLOCK / prescalers[i].div / freq;
+        if (cycles + 0.5 < 65536.0)
+            break;
+    }
+    if (i == NUM_PRESCALERS || cycles < 2.0)
+        return 1;
+
+    entire = (uint32_t)(cycles + 0.5);
+    active = (uint32_t)(entire * dutycycle / 100.0 + 0.5);
+
+    // the period register is busy until the last write has been taken up
+    for (retry=0; retry<1000 && (regs[PWM_CTRL] & PWM0_RDY); retry++)
+        usleep(1);
+
+    regs[PWM_CTRL] = (regs[PWM_CTRL] & ~PWM_CH0_PRESCAL) | prescalers[i].code;
+    regs[PWM_PERIOD] = ((entire - 1) << 16) | active;
+    return 0;
+}
+
+void hard_pwm_get(int pwm, float *freq, float *dutycycle)
+// the frequency and duty cycle actually programmed, after rounding to cycles
+{
+    volatile uint32_t *regs = pwm_regs[pwm];
+    uint32_t code = regs[PWM_CTRL] & PWM_CH0_PRESCAL;
+    uint32_t entire = (regs[PWM_PERIOD] >> 16) + 1;
+    uint32_t active = regs[PWM_PERIOD] & 0xFFFF;
+    unsigned int i, div = 1;
+
+    for (i=0; i<NUM_PRESCALERS; i++)
+        if (prescalers[i].code == code)
+            div = prescalers[i].div;
+    *freq = PWM_CLOCK / div / entire;
+    *dutycycle = active * 100.0 / entire;
+}
+
+void hard_pwm_enable(int pwm, int enable)
+{
+    volatile uint32_t *regs = pwm_regs[pwm];
+
+    if (enable)
+        regs[PWM_CTRL] |= PWM_CH0_EN | SCLK_CH0_GATING;
+    else
+        regs[PWM_CTRL] &= ~(PWM_CH0_EN | SCLK_CH0_GATING);
+}
+
+void hard_pwm_cleanup(int pwm)
+// disable the PWM and hand the pin back as a low output
+{
+    int num;
+    volatile uint32_t *dat;
+
+    if (pwm_regs[pwm] == NULL)
+        return;
+
+    hard_pwm_enable(pwm, 0);
+    num = pins[pwm].gpio & 0x1F;
+    dat = pio_regs[pwm] + pins[pwm].pio_bank * PIO_BANK_WORDS + 4;
+    *dat &= ~(1 << num);
+    set_mux(pwm, PIO_MUX_OUTPUT);
+
+    unmap_registers(pio_regs[pwm]);
+    unmap_registers(pwm_regs[pwm]);
+    pio_regs[pwm] = pwm_regs[pwm] = NULL;
+}
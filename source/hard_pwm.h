@@ -0,0 +1,35 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Hardware PWM using the Allwinner A64 PWM and R_PWM controllers */
+
+#include <stdint.h>
+
+int hard_pwm_find(unsigned int gpio);
+int hard_pwm_claim(int pwm);
+void hard_pwm_release(int pwm);
+uint32_t hard_pwm_base(int pwm);
+int hard_pwm_setup(int pwm);
+int hard_pwm_config(int pwm, float freq, float dutycycle);
+void hard_pwm_get(int pwm, float *freq, float *dutycycle);
+void hard_pwm_enable(int pwm, int enable);
+void hard_pwm_cleanup(int pwm);
@@ -30,6 +30,8 @@
 
 #include "i2c_lib.h"
 
+#include <errno.h>
+
 /* Define some global variables */
 char bus[30];
 int address;
@@ -181,6 +183,333 @@ static PyObject* py_write(PyObject* self, PyObject* args) {
     Py_RETURN_NONE;
 }
 
+/**
+ * Get the bytes to send from a list of ints or a bytes-like object
+ *
+ * @param obj data to send
+ * @param view filled in, release with PyBuffer_Release()
+ * @return 0, or -1 with an exception set
+ */
+static int get_tx(PyObject *obj, Py_buffer *view) {
+
+    PyObject *copy;
+    int ret;
+
+    if (!PyList_Check(obj)) {
+        return PyObject_GetBuffer(obj, view, PyBUF_SIMPLE);
+    }
+    if ((copy = PyByteArray_FromObject(obj)) == NULL) {
+        return -1;
+    }
+    /* the view keeps the copy alive */
+    ret = PyObject_GetBuffer(copy, view, PyBUF_SIMPLE);
+    Py_DECREF(copy);
+    return ret;
+}
+
+/**
+ * Write then read the slave device in one I2C_RDWR, with a repeated start
+ * between the two and no stop
+ *
+ * @param tx_obj bytes to send, a list of ints or a bytes-like object
+ * @param rx_len number of bytes to read back
+ * @return bytes read
+ */
+static PyObject* write_read(PyObject *tx_obj, Py_ssize_t rx_len) {
+
+    PyObject *rx;
+    Py_buffer view;
+    int ret, err = 0;
+
+    if (rx_len < 0 || rx_len > I2C_MAX_MSG_LEN) {
+        PyErr_Format(PyExc_ValueError, "i2c write_read: number of bytes to read must be between 0 and %d",
+                     I2C_MAX_MSG_LEN);
+        return NULL;
+    }
+    if (get_tx(tx_obj, &view) < 0) {
+        return NULL;
+    }
+    if (view.len > I2C_MAX_MSG_LEN) {
+        PyErr_Format(PyExc_ValueError, "i2c write_read: at most %d bytes can be sent", I2C_MAX_MSG_LEN);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    if ((rx = PyBytes_FromStringAndSize(NULL, rx_len)) == NULL) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if ((ret = i2c_write_read(fd, address, (const uint8_t *)view.buf, view.len,
+                              (uint8_t *)PyBytes_AS_STRING(rx), rx_len)) < 0) {
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if (ret < 0) {
+        Py_DECREF(rx);
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    return rx;
+}
+
+/**
+ * Write bytes to I2C slave device and read its answer, with a repeated
+ * start in between
+ *
+ * @param self
+ * @param args bytes to send and number of bytes to read
+ * @return bytes read
+ */
+static PyObject* py_write_read(PyObject* self, PyObject* args) {
+
+    PyObject *tx;
+    Py_ssize_t rx_len;
+
+    /* Parse arguments */
+    if (!PyArg_ParseTuple(args, "On", &tx, &rx_len)) {
+        return NULL;
+    }
+    return write_read(tx, rx_len);
+}
+
+/**
+ * Read n registers of the I2C slave device from reg on
+ *
+ * @param self
+ * @param args register number and number of bytes to read
+ * @return bytes read
+ */
+static PyObject* py_read_register(PyObject* self, PyObject* args) {
+
+    PyObject *tx, *rx;
+    int reg;
+    Py_ssize_t bytes;
+
+    /* Parse arguments */
+    if (!PyArg_ParseTuple(args, "in", &reg, &bytes)) {
+        return NULL;
+    }
+    if (reg < 0 || reg > 0xff) {
+        PyErr_SetString(PyExc_ValueError, "i2c read_register: register must be between 0 and 255");
+        return NULL;
+    }
+    if (bytes <= 0) {
+        PyErr_SetString(PyExc_ValueError, "i2c read_register: invalid number of bytes to read");
+        return NULL;
+    }
+
+    if ((tx = PyByteArray_FromStringAndSize(NULL, 1)) == NULL) {
+        return NULL;
+    }
+    PyByteArray_AS_STRING(tx)[0] = (char)reg;
+    rx = write_read(tx, bytes);
+    Py_DECREF(tx);
+    return rx;
+}
+
+/**
+ * Parse one item of a batch: (address, data) writes, (address, n) reads n
+ * bytes and (address, data, n) writes then reads with a repeated start
+ *
+ * @param item the tuple
+ * @param msgs filled in with the item's one or two messages, read buffers
+ * left NULL
+ * @param view filled in for a write, release with PyBuffer_Release()
+ * @return number of messages, or -1 with an exception set
+ */
+static int parse_item(PyObject *item, struct i2c_msg *msgs, Py_buffer *view) {
+
+    PyObject *data = NULL, *length = NULL;
+    long addr;
+    Py_ssize_t n = 0;
+    int count = 0;
+
+    view->obj = NULL;
+    if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) < 2 || PyTuple_GET_SIZE(item) > 3) {
+        PyErr_SetString(PyExc_TypeError, "i2c transfer: messages must be (address, data), (address, n) or (address, data, n) tuples");
+        return -1;
+    }
+    addr = PyInt_AsLong(PyTuple_GET_ITEM(item, 0));
+    if (addr == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (addr < 0 || addr > 0x7f) {
+        PyErr_SetString(PyExc_ValueError, "i2c transfer: address must be between 0 and 127");
+        return -1;
+    }
+    if (PyTuple_GET_SIZE(item) == 3) {
+        data = PyTuple_GET_ITEM(item, 1);
+        length = PyTuple_GET_ITEM(item, 2);
+    } else if (PyIndex_Check(PyTuple_GET_ITEM(item, 1))) {
+        length = PyTuple_GET_ITEM(item, 1);
+    } else {
+        data = PyTuple_GET_ITEM(item, 1);
+    }
+
+    if (length != NULL) {
+        n = PyNumber_AsSsize_t(length, PyExc_OverflowError);
+        if (n == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (n < 0 || n > I2C_MAX_MSG_LEN) {
+            PyErr_Format(PyExc_ValueError, "i2c transfer: number of bytes to read must be between 0 and %d",
+                         I2C_MAX_MSG_LEN);
+            return -1;
+        }
+    }
+    if (data != NULL) {
+        if (get_tx(data, view) < 0) {
+            return -1;
+        }
+        if (view->len > I2C_MAX_MSG_LEN) {
+            PyErr_Format(PyExc_ValueError, "i2c transfer: at most %d bytes can be sent in a message",
+                         I2C_MAX_MSG_LEN);
+            PyBuffer_Release(view);
+            view->obj = NULL;
+            return -1;
+        }
+        msgs[count].addr = addr;
+        msgs[count].flags = 0;
+        msgs[count].len = view->len;
+        msgs[count].buf = (uint8_t *)view->buf;
+        count++;
+    }
+    if (length != NULL) {
+        msgs[count].addr = addr;
+        msgs[count].flags = I2C_M_RD;
+        msgs[count].len = n;
+        msgs[count].buf = NULL;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Run a batch of messages, to any addresses, in as few I2C_RDWR calls as
+ * the kernel allows
+ *
+ * @param self
+ * @param args messages - list of (address, data) writes, (address, n)
+ * reads and (address, data, n) write-then-reads - and buffer - optional
+ * writable buffer for the data read
+ * @return (data, status) - every read's bytes one after the other, and 0
+ * or the errno value of each message. Writes are never sent twice, so
+ * when an I2C_RDWR call fails every message of it with a write gets its
+ * errno, and only the plain reads are run again to tell which failed.
+ */
+static PyObject* py_transfer(PyObject* self, PyObject* args, PyObject* kwargs) {
+
+    PyObject *list, *seq, *buffer = NULL, *data = NULL, *status_list = NULL, *result = NULL;
+    Py_buffer out, *views = NULL;
+    struct i2c_msg *msgs = NULL;
+    uint8_t *item_msgs = NULL, *rx;
+    int *status = NULL;
+    Py_ssize_t items, parsed = 0, i, total = 0;
+    int ret, count = 0, n, err = 0;
+
+    static char *kwlist [] = {
+        "messages", "buffer", NULL
+    };
+
+    out.obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &list, &buffer)) {
+        return NULL;
+    }
+    if ((seq = PySequence_Fast(list, "i2c transfer: messages must be a sequence")) == NULL) {
+        return NULL;
+    }
+    items = PySequence_Fast_GET_SIZE(seq);
+
+    views = PyMem_New(Py_buffer, items);
+    msgs = PyMem_New(struct i2c_msg, items * 2);
+    item_msgs = PyMem_New(uint8_t, items);
+    status = PyMem_New(int, items);
+    if (views == NULL || msgs == NULL || item_msgs == NULL || status == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (parsed = 0; parsed < items; parsed++) {
+        if ((n = parse_item(PySequence_Fast_GET_ITEM(seq, parsed), msgs + count, &views[parsed])) < 0) {
+            goto done;
+        }
+        item_msgs[parsed] = n;
+        count += n;
+        if (msgs[count - 1].flags & I2C_M_RD) {
+            total += msgs[count - 1].len;
+        }
+    }
+
+    /* the data read goes into one buffer, each read after the last */
+    if (buffer == NULL || buffer == Py_None) {
+        if ((data = PyBytes_FromStringAndSize(NULL, total)) == NULL) {
+            goto done;
+        }
+        rx = (uint8_t *)PyBytes_AS_STRING(data);
+    } else {
+        if (PyObject_GetBuffer(buffer, &out, PyBUF_WRITABLE) < 0) {
+            goto done;
+        }
+        if (out.len < total) {
+            PyErr_Format(PyExc_ValueError, "i2c transfer: buffer must hold the %ld bytes read",
+                         (long)total);
+            goto done;
+        }
+        Py_INCREF(buffer);
+        data = buffer;
+        rx = (uint8_t *)out.buf;
+    }
+    for (i = 0; i < count; i++) {
+        if (msgs[i].flags & I2C_M_RD) {
+            msgs[i].buf = rx;
+            rx += msgs[i].len;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if ((ret = i2c_transfer_many(fd, msgs, item_msgs, items, status)) < 0) {
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    if (ret < 0) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto done;
+    }
+
+    if ((status_list = PyList_New(items)) == NULL) {
+        goto done;
+    }
+    for (i = 0; i < items; i++) {
+        PyObject *value = PyInt_FromLong(status[i]);
+
+        if (value == NULL) {
+            goto done;
+        }
+        PyList_SET_ITEM(status_list, i, value);
+    }
+    result = Py_BuildValue("(OO)", data, status_list);
+
+done:
+    for (i = 0; i < parsed; i++) {
+        if (views[i].obj != NULL) {
+            PyBuffer_Release(&views[i]);
+        }
+    }
+    if (out.obj != NULL) {
+        PyBuffer_Release(&out);
+    }
+    Py_XDECREF(data);
+    Py_XDECREF(status_list);
+    PyMem_Free(views);
+    PyMem_Free(msgs);
+    PyMem_Free(item_msgs);
+    PyMem_Free(status);
+    Py_DECREF(seq);
+    return result;
+}
+
 /**
  * Close communication with I2C slave device
  * 
@@ -203,6 +532,9 @@ static PyMethodDef module_methods[] = {
     {"close", py_close, METH_NOARGS, "Close file descriptor"},
     {"read", py_read, METH_VARARGS, "Read n bytes from I2C bus"},
     {"write", py_write, METH_VARARGS, "Write n bytes to I2C bus"},
+    {"write_read", py_write_read, METH_VARARGS, "Write bytes - a list or a bytes-like object - then read n bytes back with a repeated start in between, returns bytes"},
+    {"read_register", py_read_register, METH_VARARGS, "Read n bytes from register reg on, with a repeated start after the register number, returns bytes"},
+    {"transfer", (PyCFunction)py_transfer, METH_VARARGS | METH_KEYWORDS, "Run a list of (address, data) writes, (address, n) reads and (address, data, n) write-then-reads in as few I2C_RDWR calls as the kernel allows, returns (data, status) - the bytes read, one message after the other, in a new bytes object or the given buffer, and 0 or an errno value per message - every message with a write in a failed I2C_RDWR call gets its errno, as writes are never sent twice"},
     {NULL, NULL, 0, NULL}
 };
 
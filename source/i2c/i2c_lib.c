@@ -22,17 +22,22 @@
  */
 
 
+
 #include <stdio.h>
 #include <stdint.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 
 #include <sys/ioctl.h>
 
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 
+#include "i2c_lib.h"
+
 int i2c_open(char *device, uint8_t address) {
     int fd;
     int ret;
@@ -60,3 +65,95 @@ int i2c_send(int fd, uint8_t *buffer, uint8_t num_bytes) {
 int i2c_read(int fd, uint8_t *buffer, uint8_t num_bytes) {
     return (read(fd, buffer, num_bytes));
 }
+
+/*
+ * Submit the messages as one I2C_RDWR: one START, a repeated START before
+ * each message after the first and one STOP at the end. At most
+ * I2C_RDWR_MAX_MSGS messages. Returns the number of messages or -1.
+ */
+int i2c_transfer(int fd, struct i2c_msg *msgs, size_t count) {
+    struct i2c_rdwr_ioctl_data data;
+
+    data.msgs = msgs;
+    data.nmsgs = count;
+    return ioctl(fd, I2C_RDWR, &data);
+}
+
+/*
+ * Write tx and read rx_len bytes back with a repeated START in between, so
+ * no other master can get in and devices that drop the register pointer
+ * on a STOP keep it. Either part may be empty.
+ */
+int i2c_write_read(int fd, uint16_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    struct i2c_msg msgs[2];
+    size_t count = 0;
+
+    if (tx_len > 0) {
+        msgs[count].addr = address;
+        msgs[count].flags = 0;
+        msgs[count].len = tx_len;
+        msgs[count].buf = (uint8_t *)tx;
+        count++;
+    }
+    if (rx_len > 0) {
+        msgs[count].addr = address;
+        msgs[count].flags = I2C_M_RD;
+        msgs[count].len = rx_len;
+        msgs[count].buf = rx;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+    return i2c_transfer(fd, msgs, count);
+}
+
+/*
+ * Run a batch of items, each one message or a write and a read that must
+ * stay together, in as few I2C_RDWR calls as i2c-dev allows: item_msgs[i]
+ * is the number of messages of item i, msgs holds them all in order. An
+ * item is never split between calls. status[i] is set to 0 or the errno
+ * value the item failed with. When a call fails there is no telling how
+ * far it got, so writes are never sent again: the items of the call that
+ * only read are run again one at a time to tell which one failed, and
+ * every item with a write gets the errno of the call. The read buffers of
+ * a failed item are zeroed. Returns the number of failed items, or -1 when
+ * the descriptor itself is unusable.
+ */
+int i2c_transfer_many(int fd, struct i2c_msg *msgs, const uint8_t *item_msgs, size_t items, int *status) {
+    size_t item = 0, end, count, i, j;
+    int failed = 0, err, writes;
+
+    while (item < items) {
+        count = 0;
+        for (end = item; end < items && count + item_msgs[end] <= I2C_RDWR_MAX_MSGS; end++)
+            count += item_msgs[end];
+
+        if (i2c_transfer(fd, msgs, count) >= 0) {
+            for (i = item; i < end; i++)
+                status[i] = 0;
+        } else if (errno == EBADF || errno == ENOTTY || errno == EFAULT) {
+            return -1;
+        } else {
+            err = errno;
+            count = 0;
+            for (i = item; i < end; i++) {
+                writes = 0;
+                for (j = 0; j < item_msgs[i]; j++)
+                    writes |= !(msgs[count + j].flags & I2C_M_RD);
+                status[i] = writes ? err : 0;
+                if (!writes && i2c_transfer(fd, msgs + count, item_msgs[i]) < 0)
+                    status[i] = errno;
+                if (status[i] != 0) {
+                    for (j = 0; j < item_msgs[i]; j++)
+                        if (msgs[count + j].flags & I2C_M_RD)
+                            memset(msgs[count + j].buf, 0, msgs[count + j].len);
+                    failed++;
+                }
+                count += item_msgs[i];
+            }
+        }
+        msgs += count;
+        item = end;
+    }
+    return failed;
+}
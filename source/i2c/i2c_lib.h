@@ -24,9 +24,21 @@
 #ifndef _I2C_LIB_H
 #define _I2C_LIB_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+#include <linux/i2c.h>
+
+/* i2c-dev takes at most this many messages per I2C_RDWR */
+#define I2C_RDWR_MAX_MSGS   42
+#define I2C_MAX_MSG_LEN     8192    /* and refuses longer messages */
+
 extern int i2c_open(char *device, uint8_t address);
 extern int i2c_close(int fd);
 extern int i2c_send(int fd, uint8_t *buffer, uint8_t num_bytes);
 extern int i2c_read(int fd, uint8_t *buffer, uint8_t num_bytes);
+extern int i2c_transfer(int fd, struct i2c_msg *msgs, size_t count);
+extern int i2c_write_read(int fd, uint16_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+extern int i2c_transfer_many(int fd, struct i2c_msg *msgs, const uint8_t *item_msgs, size_t items, int *status);
 
 #endif
\ No newline at end of file
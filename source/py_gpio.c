@@ -24,9 +24,13 @@ SOFTWARE.
 #include "c_gpio.h"
 #include "event_gpio.h"
 #include "py_pwm.h"
+#include "py_servo.h"
+#include "py_pdm.h"
+#include "soft_pwm.h"
 #include "cpuinfo.h"
 #include "constants.h"
 #include "common.h"
+#include "gpio_api.h"
 
 #if PY_VERSION_HEX >= 0x03070000 && !defined(PyEval_ThreadsInitialized)
 #define PyEval_ThreadsInitialized() 1
@@ -97,6 +101,7 @@ static PyObject *py_cleanup(PyObject *self, PyObject *args, PyObject *kwargs)
       if (gpio_direction[bcm_gpio] != -1) {
          setup_gpio(gpio, INPUT, PUD_OFF);
          gpio_direction[bcm_gpio] = -1;
+         gpio_release(gpio, GPIO_OWNER_GPIO);
          found = 1;
       }
    }
@@ -140,6 +145,7 @@ static PyObject *py_cleanup(PyObject *self, PyObject *args, PyObject *kwargs)
                //setup_gpio(i, INPUT, PUD_OFF);
                setup_gpio(*(pinToGpioPineA64+i), INPUT, PUD_OFF);
                gpio_direction[i] = -1;
+               gpio_release(*(pinToGpioPineA64+i), GPIO_OWNER_GPIO);
                found = 1;
             }
          }
@@ -209,6 +215,12 @@ static PyObject *py_setup_channel(PyObject *self, PyObject *args, PyObject *kwar
       if (get_gpio_number(channel, &gpio, &bcm_gpio))
          return 0;
 
+      // pins driven by another module, e.g. an SPI chip select, are refused
+      if (gpio_owned_by(gpio) != GPIO_OWNER_GPIO && gpio_claim(gpio, GPIO_OWNER_GPIO)) {
+         PyErr_SetString(PyExc_ValueError, "This channel is in use by another module");
+         return 0;
+      }
+
       func = gpio_function(gpio);
       if (gpio_warnings &&                             // warnings enabled and
           ((func != 0 && func != 1) ||                 // (already one of the alt functions or
@@ -574,7 +586,7 @@ static PyObject *py_getmode(PyObject *self, PyObject *args)
    return value;
 }
 
-static unsigned int chan_from_gpio(unsigned int gpio)
+static int chan_from_gpio(unsigned int gpio)
 {
    int chan;
    int chans;
@@ -816,6 +828,95 @@ static PyObject *py_event_detected(PyObject *self, PyObject *args)
       Py_RETURN_FALSE;
 }
 
+// python function channels = events_pending(bitmask=False)
+static PyObject *py_events_pending(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   uint64_t pending[EVENT_PENDING_WORDS];
+   unsigned long long mask = 0;
+   int bitmask = 0;
+   int i, bit, chan;
+   PyObject *chanlist;
+   PyObject *item;
+   static char *kwlist[] = {"bitmask", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &bitmask))
+      return NULL;
+
+   if (gpio_mode != BOARD && gpio_mode != BCM)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Please set pin numbering mode using GPIO.setmode(GPIO.BOARD) or GPIO.setmode(GPIO.BCM)");
+      return NULL;
+   }
+
+   if ((chanlist = PyList_New(0)) == NULL)
+      return NULL;
+
+   events_fetch(pending);
+   for (i=0; i<EVENT_PENDING_WORDS; i++) {
+      while (pending[i]) {
+         bit = __builtin_ctzll(pending[i]);
+         pending[i] &= pending[i] - 1;
+         if ((chan = chan_from_gpio(i * 64 + bit)) < 0)
+            continue;
+         if (bitmask) {
+            mask |= 1ULL << chan;
+            continue;
+         }
+         item = Py_BuildValue("i", chan);
+         if (item == NULL || PyList_Append(chanlist, item) != 0) {
+            Py_XDECREF(item);
+            Py_DECREF(chanlist);
+            return NULL;
+         }
+         Py_DECREF(item);
+      }
+   }
+
+   if (bitmask) {
+      Py_DECREF(chanlist);
+      return PyLong_FromUnsignedLongLong(mask);
+   }
+   return chanlist;
+}
+
+// python function start_edge_log(path, records=65536)
+static PyObject *py_start_edge_log(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   char *path;
+   int records = 65536;
+   int result;
+   static char *kwlist[] = {"path", "records", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist, &path, &records))
+      return NULL;
+
+   if (records <= 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "records must be greater than 0");
+      return NULL;
+   }
+
+   if ((result = edge_log_open(path, records)) != 0)
+   {
+      if (result == 1) {
+         PyErr_SetString(PyExc_RuntimeError, "Edge log already started");
+         return NULL;
+      } else {
+         PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+         return NULL;
+      }
+   }
+
+   Py_RETURN_NONE;
+}
+
+// python function stop_edge_log()
+static PyObject *py_stop_edge_log(PyObject *self, PyObject *args)
+{
+   edge_log_close();
+   Py_RETURN_NONE;
+}
+
 // python function channel = wait_for_edge(channel, edge, bouncetime=None, timeout=None)
 static PyObject *py_wait_for_edge(PyObject *self, PyObject *args, PyObject *kwargs)
 {
@@ -972,6 +1073,166 @@ static PyObject *py_setwarnings(PyObject *self, PyObject *args)
    Py_RETURN_NONE;
 }
 
+// python function set_pwm_spin(spin_us)
+static PyObject *py_set_pwm_spin(PyObject *self, PyObject *args)
+{
+   double spin_us;
+
+   if (!PyArg_ParseTuple(args, "d", &spin_us))
+      return NULL;
+
+   if (spin_us < 0.0)
+   {
+      PyErr_SetString(PyExc_ValueError, "spin_us must not be negative");
+      return NULL;
+   }
+
+   pwm_set_spin((long long)(spin_us * 1000.0));
+   Py_RETURN_NONE;
+}
+
+// python function pwm_jitter(reset=False)
+static PyObject *py_pwm_jitter(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   struct pwm_jitter jitter;
+   int reset = 0;
+   int i;
+   long long seen = 0;
+   double p50 = 0.0, p99 = 0.0;
+   PyObject *histogram, *entry;
+   static char *kwlist[] = {"reset", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &reset))
+      return NULL;
+
+   pwm_get_jitter(&jitter, reset);
+
+   // percentiles to the resolution of the histogram - the upper bound of the
+   // bucket they fall in
+   if ((histogram = PyList_New(0)) == NULL)
+      return NULL;
+   for (i=0; i<PWM_JITTER_BUCKETS; i++)
+   {
+      if (jitter.buckets[i] == 0)
+         continue;
+      seen += jitter.buckets[i];
+      if (p50 == 0.0 && seen * 2 >= jitter.edges)
+         p50 = (1LL << i) / 1000.0;
+      if (p99 == 0.0 && seen * 100 >= jitter.edges * 99)
+         p99 = (1LL << i) / 1000.0;
+      entry = Py_BuildValue("(dL)", (1LL << i) / 1000.0, jitter.buckets[i]);
+      if (entry == NULL || PyList_Append(histogram, entry) != 0) {
+         Py_XDECREF(entry);
+         Py_DECREF(histogram);
+         return NULL;
+      }
+      Py_DECREF(entry);
+   }
+
+   return Py_BuildValue("{sLsdsdsdsdsdsN}",
+                        "edges", jitter.edges,
+                        "mean_us", jitter.edges ? jitter.total_ns / 1000.0 / jitter.edges : 0.0,
+                        "max_us", jitter.max_ns / 1000.0,
+                        "p50_us", p50,
+                        "p99_us", p99,
+                        "spin_us", jitter.spin_ns / 1000.0,
+                        "histogram", histogram);
+}
+
+// python function set_pwm_priority(priority)
+static PyObject *py_set_pwm_priority(PyObject *self, PyObject *args)
+{
+   int priority;
+
+   if (!PyArg_ParseTuple(args, "i", &priority))
+      return NULL;
+
+   if (priority < 0 || priority > 99)
+   {
+      PyErr_SetString(PyExc_ValueError, "priority must be from 0 to 99");
+      return NULL;
+   }
+
+   if (pwm_set_priority(priority))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Could not set the PWM engine priority.  Try running as root?");
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// python function pwm_benchmark(channels, frequency=1000.0, dutycycle=25.0, seconds=1.0)
+static PyObject *py_pwm_benchmark(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   struct pwm_bench bench;
+   int channels, result;
+   float frequency = 1000.0, dutycycle = 25.0;
+   double seconds = 1.0;
+   static char *kwlist[] = {"channels", "frequency", "dutycycle", "seconds", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|ffd", kwlist, &channels, &frequency, &dutycycle, &seconds))
+      return NULL;
+
+   if (seconds <= 0.0 || seconds > 60.0)
+   {
+      PyErr_SetString(PyExc_ValueError, "seconds must be more than 0 and at most 60");
+      return NULL;
+   }
+
+   Py_BEGIN_ALLOW_THREADS
+   result = pwm_benchmark(channels, frequency, dutycycle, (long long)(seconds * 1e9), &bench);
+   Py_END_ALLOW_THREADS
+
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Not enough free channels for the benchmark");
+      return NULL;
+   }
+   else if (result)
+   {
+      PyErr_SetString(PyExc_ValueError, "channels must be from 1 to 54, with a valid frequency and dutycycle");
+      return NULL;
+   }
+
+   return Py_BuildValue("{sisdsdsdsdsLsLsLsdsdsdsdsdsd}",
+                        "channels", bench.channels,
+                        "frequency", bench.frequency,
+                        "dutycycle", bench.dutycycle,
+                        "frequency_error", bench.frequency_error,
+                        "duty_error", bench.duty_error,
+                        "writes", bench.writes,
+                        "dropped", bench.dropped,
+                        "edges", bench.edges,
+                        "jitter_p50_us", bench.jitter_p50_ns / 1000.0,
+                        "jitter_p90_us", bench.jitter_p90_ns / 1000.0,
+                        "jitter_p99_us", bench.jitter_p99_ns / 1000.0,
+                        "jitter_p999_us", bench.jitter_p999_ns / 1000.0,
+                        "jitter_max_us", bench.jitter_max_ns / 1000.0,
+                        "cpu_percent", bench.cpu_percent);
+}
+
+static int api_map(void)
+{
+   if (setup_error)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Module not imported correctly!");
+      return -1;
+   }
+   return mmap_gpio_mem() ? -1 : 0;
+}
+
+// lent to the other extensions, see gpio_api.h
+static struct gpio_api c_api = {
+   api_map,
+   devmem_path,
+   setup_gpio,
+   output_gpio,
+   gpio_claim,
+   gpio_release,
+   edge_source_open,
+   edge_source_close,
+};
+
 static const char moduledocstring[] = "GPIO functionality of a Raspberry Pi using Python";
 
 PyMethodDef rpi_gpio_methods[] = {
@@ -984,8 +1245,15 @@ PyMethodDef rpi_gpio_methods[] = {
    {"add_event_detect", (PyCFunction)py_add_event_detect, METH_VARARGS | METH_KEYWORDS, "Enable edge detection events for a particular GPIO channel.\nchannel      - either board pin number or BCM number depending on which mode is set.\nedge         - RISING, FALLING or BOTH\n[callback]   - A callback function for the event (optional)\n[bouncetime] - Switch bounce timeout in ms for callback"},
    {"remove_event_detect", py_remove_event_detect, METH_VARARGS, "Remove edge detection for a particular GPIO channel\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"event_detected", py_event_detected, METH_VARARGS, "Returns True if an edge has occured on a given GPIO.  You need to enable edge detection using add_event_detect() first.\nchannel - either board pin number or BCM number depending on which mode is set."},
+   {"events_pending", (PyCFunction)py_events_pending, METH_VARARGS | METH_KEYWORDS, "Returns the channels that have had an edge since the last call and clears them.  You need to enable edge detection using add_event_detect() first.\n[bitmask] - return an integer with bit n set for channel n instead of a list"},
    {"add_event_callback", (PyCFunction)py_add_event_callback, METH_VARARGS | METH_KEYWORDS, "Add a callback for an event already defined using add_event_detect()\nchannel      - either board pin number or BCM number depending on which mode is set.\ncallback     - a callback function"},
    {"wait_for_edge", (PyCFunction)py_wait_for_edge, METH_VARARGS | METH_KEYWORDS, "Wait for an edge.  Returns the channel number or None on timeout.\nchannel      - either board pin number or BCM number depending on which mode is set.\nedge         - RISING, FALLING or BOTH\n[bouncetime] - time allowed between calls to allow for switchbounce\n[timeout]    - timeout in ms"},
+   {"start_edge_log", (PyCFunction)py_start_edge_log, METH_VARARGS | METH_KEYWORDS, "Record every edge seen by event detection to a preallocated ring file\npath      - file to create (overwritten)\n[records] - number of records kept before the oldest are overwritten"},
+   {"stop_edge_log", py_stop_edge_log, METH_NOARGS, "Stop recording edges and flush the edge log"},
+   {"set_pwm_spin", py_set_pwm_spin, METH_VARARGS, "Set how long before each software PWM edge the engine stops sleeping and busy-waits.  Higher values give more accurate edges at the cost of CPU time\nspin_us - microseconds, 0 (default) to always sleep"},
+   {"pwm_jitter", (PyCFunction)py_pwm_jitter, METH_VARARGS | METH_KEYWORDS, "Report how late software PWM edges were over all channels: mean, max and percentiles in microseconds and a histogram of (upper bound in us, count)\n[reset] - start collecting again after reading"},
+   {"set_pwm_priority", py_set_pwm_priority, METH_VARARGS, "Run the software PWM engine thread with real time (SCHED_FIFO) priority\npriority - 1 to 99, or 0 for normal scheduling"},
+   {"pwm_benchmark", (PyCFunction)py_pwm_benchmark, METH_VARARGS | METH_KEYWORDS, "Run simulated channels through the software PWM engine, timestamping each register write instead of performing it, and report the achieved timing and engine CPU use.  Jitter is how far each edge was from its ideal time\nchannels - number of channels\n[frequency] - Hz (default 1000)\n[dutycycle] - 0.0 to 100.0 (default 25)\n[seconds] - how long to run (default 1)"},
    {"gpio_function", py_gpio_function, METH_VARARGS, "Return the current GPIO function (IN, OUT, PWM, SERIAL, I2C, SPI)\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"setwarnings", py_setwarnings, METH_VARARGS, "Enable or disable warning messages"},
    {NULL, NULL, 0, NULL}
@@ -1066,6 +1334,28 @@ PyMODINIT_FUNC init_GPIO(void)
    Py_INCREF(&PWMType);
    PyModule_AddObject(module, "PWM", (PyObject*)&PWMType);
 
+   // Add Servo class
+   if (Servo_init_ServoType() == NULL)
+#if PY_MAJOR_VERSION > 2
+      return NULL;
+#else
+      return;
+#endif
+   Py_INCREF(&ServoType);
+   PyModule_AddObject(module, "Servo", (PyObject*)&ServoType);
+
+   // Add PDM class
+   if (PDM_init_PDMType() == NULL)
+#if PY_MAJOR_VERSION > 2
+      return NULL;
+#else
+      return;
+#endif
+   Py_INCREF(&PDMType);
+   PyModule_AddObject(module, "PDM", (PyObject*)&PDMType);
+
+   PyModule_AddObject(module, "_C_API", PyCapsule_New(&c_api, GPIO_API_CAPSULE, NULL));
+
    if (!PyEval_ThreadsInitialized())
       PyEval_InitThreads();
 
@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Python.h"
+#include <time.h>
+#include "soft_pwm.h"
+#include "py_pdm.h"
+#include "common.h"
+#include "c_gpio.h"
+
+typedef struct
+{
+    PyObject_HEAD
+    unsigned int gpio;
+    int running;
+    double sample_rate;
+    struct pdm_ring ring;
+} PDMObject;
+
+// python method PDM.__init__(self, channel, sample_rate, oversample=32, order=2, buffer_size=4096)
+static int PDM_init(PDMObject *self, PyObject *args, PyObject *kwds)
+{
+    int channel;
+    double sample_rate;
+    int oversample = 32;
+    int order = 2;
+    int buffer_size = 4096;
+    unsigned int real_gpio, size;
+    static char *kwlist[] = {"channel", "sample_rate", "oversample", "order", "buffer_size", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "id|iii", kwlist, &channel, &sample_rate, &oversample, &order, &buffer_size))
+        return -1;
+
+    // convert channel to gpio
+    if (get_gpio_number(channel, &real_gpio, &(self->gpio)))
+        return -1;
+
+    // ensure channel set as output
+    if (gpio_direction[self->gpio] != OUTPUT)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an output first");
+        return -1;
+    }
+
+    if (sample_rate <= 0.0 || oversample < 1 || sample_rate * oversample > 1000000.0)
+    {
+        PyErr_SetString(PyExc_ValueError, "sample_rate and oversample must be positive, with a bit rate of at most 1 MHz");
+        return -1;
+    }
+    if (order != 1 && order != 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "order must be 1 or 2");
+        return -1;
+    }
+    if (buffer_size < 1 || buffer_size > (1 << 24))
+    {
+        PyErr_SetString(PyExc_ValueError, "buffer_size must be from 1 to 16777216");
+        return -1;
+    }
+
+    if (self->running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "PDM has already been started");
+        return -1;
+    }
+
+    // the ring indexes with a mask, so round its size up to a power of two
+    for (size = 2; size < (unsigned int)buffer_size; size <<= 1)
+        ;
+    free(self->ring.samples);
+    memset(&self->ring, 0, sizeof(self->ring));
+    if ((self->ring.samples = malloc(size * sizeof(uint16_t))) == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->ring.size = size;
+    self->sample_rate = sample_rate;
+
+    switch (pdm_start(self->gpio, &self->ring, (long long)(1e9 / (sample_rate * oversample)), oversample, order))
+    {
+        case 0: break;
+        case 1: PyErr_SetString(PyExc_RuntimeError, "A PWM, Servo or PDM object already exists for this GPIO channel");
+                return -1;
+        default: PyErr_SetString(PyExc_RuntimeError, "Failed to start the PWM engine");
+                 return -1;
+    }
+    self->running = 1;
+    return 0;
+}
+
+// python method PDM.write(self, samples, block=True, timeout=None)
+static PyObject *PDM_write(PDMObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *samples, *seq, *timeout = Py_None;
+    int block = 1;
+    uint16_t *values;
+    double value, seconds = -1.0;
+    Py_ssize_t count, i;
+    unsigned int written = 0, wanted;
+    long long wait_ns;
+    struct timespec start, now, delay;
+    static char *kwlist[] = {"samples", "block", "timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iO", kwlist, &samples, &block, &timeout))
+        return NULL;
+
+    if (!self->running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "PDM has been stopped");
+        return NULL;
+    }
+    if (timeout != Py_None && (seconds = PyFloat_AsDouble(timeout)) == -1.0 && PyErr_Occurred())
+        return NULL;
+
+    if ((seq = PySequence_Fast(samples, "samples must be a sequence of numbers from 0.0 to 1.0")) == NULL)
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if ((values = malloc((count ? count : 1) * sizeof(uint16_t))) == NULL)
+    {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    // convert everything first, so a bad value queues nothing
+    for (i=0; i<count; i++)
+    {
+        value = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+        if (value == -1.0 && PyErr_Occurred())
+            break;
+        if (value < 0.0 || value > 1.0)
+        {
+            PyErr_SetString(PyExc_ValueError, "samples must be from 0.0 to 1.0");
+            break;
+        }
+        values[i] = (uint16_t)(value * 65535.0 + 0.5);
+    }
+    Py_DECREF(seq);
+    if (i < count)
+    {
+        free(values);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;)
+    {
+        written += pdm_ring_write(&self->ring, values + written, count - written);
+        if (written == count || !block)
+            break;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (seconds >= 0.0 && (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= seconds)
+            break;
+
+        // sleep until about half the samples still to go would fit
+        wanted = count - written;
+        if (wanted > self->ring.size / 2)
+            wanted = self->ring.size / 2;
+        wait_ns = (long long)(wanted / 2 * 1e9 / self->sample_rate);
+        if (wait_ns < 1000000)
+            wait_ns = 1000000;
+        delay.tv_sec = wait_ns / 1000000000LL;
+        delay.tv_nsec = wait_ns % 1000000000LL;
+        Py_BEGIN_ALLOW_THREADS
+        nanosleep(&delay, NULL);
+        Py_END_ALLOW_THREADS
+        if (PyErr_CheckSignals())
+        {
+            free(values);
+            return NULL;
+        }
+    }
+    free(values);
+    return Py_BuildValue("I", written);
+}
+
+// python method PDM.stats(self, reset=False)
+static PyObject *PDM_stats(PDMObject *self, PyObject *args, PyObject *kwds)
+{
+    struct pwm_stats stats;
+    int reset = 0;
+    static char *kwlist[] = {"reset", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &reset))
+        return NULL;
+
+    if (!self->running || pwm_get_stats(self->gpio, &stats, reset))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "PDM has been stopped");
+        return NULL;
+    }
+
+    return Py_BuildValue("{sIsLsLsdsd}",
+                         "queued", pdm_ring_queued(&self->ring),
+                         "underruns", __atomic_load_n(&self->ring.underruns, __ATOMIC_RELAXED),
+                         "overruns", stats.overruns,
+                         "density", stats.period_ns ? (double)stats.on_ns / stats.period_ns : 0.0,
+                         "max_latency_us", stats.max_latency_ns / 1000.0);
+}
+
+// python method PDM.stop(self)
+static PyObject *PDM_stop(PDMObject *self, PyObject *args)
+{
+    if (self->running)
+        pwm_stop(self->gpio);
+    self->running = 0;
+    Py_RETURN_NONE;
+}
+
+// deallocation method
+static void PDM_dealloc(PDMObject *self)
+{
+    // the engine lets go of the ring in pwm_stop()
+    if (self->running)
+        pwm_stop(self->gpio);
+    free(self->ring.samples);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef
+PDM_methods[] = {
+   { "write", (PyCFunction)PDM_write, METH_VARARGS | METH_KEYWORDS, "Queue samples for output.  Returns the number queued\nsamples - sequence of levels from 0.0 to 1.0\n[block] - wait for room in the buffer (default True)\n[timeout] - seconds to wait for room, default forever" },
+   { "stats", (PyCFunction)PDM_stats, METH_VARARGS | METH_KEYWORDS, "Return the samples queued, samples missed because the buffer was empty, bit clock ticks missed, the measured pulse density and the worst tick latency\n[reset] - start measuring again after reading" },
+   { "stop", (PyCFunction)PDM_stop, METH_NOARGS, "Stop output" },
+   { NULL }
+};
+
+PyTypeObject PDMType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.PDM",            // tp_name
+   sizeof(PDMObject),         // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)PDM_dealloc,   // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   0,                         // tp_repr
+   0,                         // tp_as_number
+   0,                         // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   0,                         // tp_as_buffer
+   Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, // tp_flag
+   "Pulse density modulation class - a first or second order sigma-delta modulator run by the PWM engine, fed with streamed samples",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   PDM_methods,               // tp_methods
+   0,                         // tp_members
+   0,                         // tp_getset
+   0,                         // tp_base
+   0,                         // tp_dict
+   0,                         // tp_descr_get
+   0,                         // tp_descr_set
+   0,                         // tp_dictoffset
+   (initproc)PDM_init,        // tp_init
+   0,                         // tp_alloc
+   0,                         // tp_new
+};
+
+PyTypeObject *PDM_init_PDMType(void)
+{
+   // Fill in some slots in the type, and make it ready
+   PDMType.tp_new = PyType_GenericNew;
+   if (PyType_Ready(&PDMType) < 0)
+      return NULL;
+
+   return &PDMType;
+}
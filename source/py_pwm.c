@@ -22,6 +22,8 @@ SOFTWARE.
 
 #include "Python.h"
 #include "soft_pwm.h"
+#include "hard_pwm.h"
+#include "sysfs_pwm.h"
 #include "py_pwm.h"
 #include "common.h"
 #include "c_gpio.h"
@@ -32,8 +34,65 @@ typedef struct
     unsigned int gpio;
     float freq;
     float dutycycle;
+    int hard;           // hardware PWM in use, -1 for software PWM
+    unsigned int slot;  // software PWM claim last set, for pwm_release()
+    struct sysfs_pwm *sysfs;    // kernel driver for the hardware PWM, if any
+    int channel;
+    int ready;          // __init__ succeeded, so the backend needs cleaning up
 } PWMObject;
 
+// completion callbacks for ramps, by gpio - only touched with the GIL held
+static struct {
+    PyObject *func;
+    int channel;
+} ramp_callbacks[54];
+
+static void clear_ramp_callback(unsigned int gpio)
+{
+    PyObject *func = ramp_callbacks[gpio].func;
+
+    ramp_callbacks[gpio].func = NULL;
+    Py_XDECREF(func);
+}
+
+// called from the soft PWM notify thread when a ramp finishes
+static void run_ramp_callback(unsigned int gpio)
+{
+    PyObject *func, *result;
+    PyGILState_STATE gstate;
+
+    gstate = PyGILState_Ensure();
+    if ((func = ramp_callbacks[gpio].func) != NULL) {
+        ramp_callbacks[gpio].func = NULL;
+        result = PyObject_CallFunction(func, "i", ramp_callbacks[gpio].channel);
+        if (result == NULL && PyErr_Occurred()) {
+            PyErr_Print();
+            PyErr_Clear();
+        }
+        Py_XDECREF(result);
+        Py_DECREF(func);
+    }
+    PyGILState_Release(gstate);
+}
+
+// push the frequency and duty cycle to whichever backend drives the channel
+static int PWM_apply(PWMObject *self)
+{
+    if (self->sysfs != NULL) {
+        if (sysfs_pwm_config(self->sysfs, self->freq, self->dutycycle)) {
+            PyErr_SetFromErrno(PyExc_IOError);
+            return -1;
+        }
+    } else if (self->hard < 0) {
+        pwm_set_frequency(self->gpio, self->freq);
+        self->slot = pwm_set_duty_cycle(self->gpio, self->dutycycle);
+    } else if (hard_pwm_config(self->hard, self->freq, self->dutycycle)) {
+        PyErr_SetString(PyExc_ValueError, "frequency is out of range for hardware PWM");
+        return -1;
+    }
+    return 0;
+}
+
 // python method PWM.__init__(self, channel, frequency)
 static int PWM_init(PWMObject *self, PyObject *args, PyObject *kwds)
 {
@@ -41,12 +100,19 @@ static int PWM_init(PWMObject *self, PyObject *args, PyObject *kwds)
     float frequency;
     unsigned int real_gpio;
 
+    if (self->ready)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "PWM has already been initialised");
+        return -1;
+    }
+
     if (!PyArg_ParseTuple(args, "if", &channel, &frequency))
         return -1;
 
     // convert channel to gpio
     if (get_gpio_number(channel, &real_gpio, &(self->gpio)))
         return -1;
+    self->channel = channel;
 
     // ensure channel set as output
     if (gpio_direction[self->gpio] != OUTPUT)
@@ -55,15 +121,46 @@ static int PWM_init(PWMObject *self, PyObject *args, PyObject *kwds)
         return -1;
     }
 
-    if (frequency <= 0.0)
+    if (frequency <= 0.0 || frequency > PWM_MAX_FREQ)
+    {
+        PyErr_SetString(PyExc_ValueError, "frequency must be greater than 0.0 and at most 1e9");
+        return -1;
+    }
+
+    if (pwm_busy(self->gpio))
     {
-        PyErr_SetString(PyExc_ValueError, "frequency must be greater than 0.0");
+        PyErr_SetString(PyExc_RuntimeError, "A Servo or PDM object already exists for this GPIO channel");
         return -1;
     }
 
     self->freq = frequency;
+    self->dutycycle = 0.0;
+
+    // use the PWM controller if the pin has one - through its kernel driver
+    // if loaded, else directly - and fall back to software
+    self->sysfs = NULL;
+    self->hard = hard_pwm_find(real_gpio);
+    if (self->hard >= 0 && hard_pwm_claim(self->hard))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "A PWM object already exists for this GPIO channel");
+        return -1;
+    }
+    self->ready = 1;
+    if (self->hard >= 0 && (self->sysfs = sysfs_pwm_open(hard_pwm_base(self->hard), 0)) != NULL) {
+        if (sysfs_pwm_config(self->sysfs, self->freq, self->dutycycle) == 0)
+            return 0;
+        sysfs_pwm_close(self->sysfs);
+        self->sysfs = NULL;
+    }
+    if (self->hard >= 0 && (hard_pwm_setup(self->hard) ||
+                            hard_pwm_config(self->hard, self->freq, self->dutycycle))) {
+        hard_pwm_cleanup(self->hard);
+        hard_pwm_release(self->hard);
+        self->hard = -1;
+    }
 
-    pwm_set_frequency(self->gpio, self->freq);
+    if (self->hard < 0)
+        self->slot = pwm_set_frequency(self->gpio, self->freq);
     return 0;
 }
 
@@ -82,8 +179,16 @@ static PyObject *PWM_start(PWMObject *self, PyObject *args)
     }
 
     self->dutycycle = dutycycle;
-    pwm_set_duty_cycle(self->gpio, self->dutycycle);
-    pwm_start(self->gpio);
+    if (PWM_apply(self))
+        return NULL;
+    if (self->sysfs != NULL) {
+        if (sysfs_pwm_enable(self->sysfs, 1))
+            return PyErr_SetFromErrno(PyExc_IOError);
+    } else if (self->hard < 0) {
+        pwm_start(self->gpio);
+    } else {
+        hard_pwm_enable(self->hard, 1);
+    }
     Py_RETURN_NONE;
 }
 
@@ -101,7 +206,13 @@ static PyObject *PWM_ChangeDutyCycle(PWMObject *self, PyObject *args)
     }
 
     self->dutycycle = dutycycle;
-    pwm_set_duty_cycle(self->gpio, self->dutycycle);
+    if (self->sysfs != NULL) {
+        // the period is already set, so this is a single write
+        if (sysfs_pwm_duty(self->sysfs, self->dutycycle))
+            return PyErr_SetFromErrno(PyExc_IOError);
+    } else if (PWM_apply(self)) {
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
@@ -113,38 +224,210 @@ static PyObject *PWM_ChangeFrequency(PWMObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "f", &frequency))
         return NULL;
 
-    if (frequency <= 0.0)
+    if (frequency <= 0.0 || frequency > PWM_MAX_FREQ)
     {
-        PyErr_SetString(PyExc_ValueError, "frequency must be greater than 0.0");
+        PyErr_SetString(PyExc_ValueError, "frequency must be greater than 0.0 and at most 1e9");
         return NULL;
     }
 
     self->freq = frequency;
+    if (self->sysfs == NULL && self->hard < 0)
+        self->slot = pwm_set_frequency(self->gpio, self->freq);  // leaves a running ramp alone
+    else if (PWM_apply(self))
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+// python method PWM.ramp(self, dutycycle, duration_ms, curve=RAMP_LINEAR, callback=None)
+static PyObject *PWM_ramp(PWMObject *self, PyObject *args, PyObject *kwds)
+{
+    float dutycycle, duration_ms;
+    int curve = RAMP_LINEAR;
+    PyObject *cb_func = NULL;
+    static char *kwlist[] = {"dutycycle", "duration_ms", "curve", "callback", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ff|iO", kwlist, &dutycycle, &duration_ms, &curve, &cb_func))
+        return NULL;
+
+    if (dutycycle < 0.0 || dutycycle > 100.0)
+    {
+        PyErr_SetString(PyExc_ValueError, "dutycycle must have a value from 0.0 to 100.0");
+        return NULL;
+    }
+    if (duration_ms < 0.0)
+    {
+        PyErr_SetString(PyExc_ValueError, "duration_ms must not be negative");
+        return NULL;
+    }
+    if (curve != RAMP_LINEAR && curve != RAMP_EXPONENTIAL && curve != RAMP_GAMMA)
+    {
+        PyErr_SetString(PyExc_ValueError, "curve must be RAMP_LINEAR, RAMP_EXPONENTIAL or RAMP_GAMMA");
+        return NULL;
+    }
+    if (cb_func == Py_None)
+        cb_func = NULL;
+    if (cb_func != NULL && !PyCallable_Check(cb_func))
+    {
+        PyErr_SetString(PyExc_TypeError, "Parameter must be callable");
+        return NULL;
+    }
+    if (self->sysfs != NULL || self->hard >= 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "ramp() is only available on software PWM channels");
+        return NULL;
+    }
 
-    pwm_set_frequency(self->gpio, self->freq);
+    clear_ramp_callback(self->gpio);
+    if (cb_func != NULL) {
+        Py_INCREF(cb_func);
+        ramp_callbacks[self->gpio].func = cb_func;
+        ramp_callbacks[self->gpio].channel = self->channel;
+    }
+
+    switch (pwm_ramp(self->gpio, dutycycle, (long long)(duration_ms * 1000000.0), curve,
+                     cb_func != NULL ? run_ramp_callback : NULL))
+    {
+        case 0: break;
+        case 1: clear_ramp_callback(self->gpio);
+                PyErr_SetString(PyExc_RuntimeError, "PWM has not been started");
+                return NULL;
+        default: clear_ramp_callback(self->gpio);
+                 PyErr_SetString(PyExc_RuntimeError, "Failed to start the ramp notify thread");
+                 return NULL;
+    }
+    self->dutycycle = dutycycle;
     Py_RETURN_NONE;
 }
 
+// python method PWM.wait_ramp(self, timeout=None)
+static PyObject *PWM_wait_ramp(PWMObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *timeout = Py_None;
+    long long timeout_ns = -1;
+    int result;
+    static char *kwlist[] = {"timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout))
+        return NULL;
+    if (timeout != Py_None) {
+        double seconds = PyFloat_AsDouble(timeout);
+        if (seconds == -1.0 && PyErr_Occurred())
+            return NULL;
+        timeout_ns = seconds < 0.0 ? 0 : (long long)(seconds * 1e9);
+    }
+
+    if (self->sysfs != NULL || self->hard >= 0)
+        Py_RETURN_TRUE;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = pwm_ramp_wait(self->gpio, timeout_ns);
+    Py_END_ALLOW_THREADS
+
+    if (result)
+        Py_RETURN_FALSE;
+    Py_RETURN_TRUE;
+}
+
+// python method PWM.stats(self, reset=False)
+static PyObject *PWM_stats(PWMObject *self, PyObject *args, PyObject *kwds)
+{
+    struct pwm_stats stats;
+    int reset = 0;
+    double freq = 0.0, duty = 0.0;
+    static char *kwlist[] = {"reset", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &reset))
+        return NULL;
+
+    if (self->hard >= 0)
+    {
+        // the controller produces exactly what was programmed, the only
+        // error is rounding to whole clock cycles or nanoseconds
+        float hfreq, hduty;
+
+        if (self->sysfs != NULL)
+            sysfs_pwm_get(self->sysfs, &hfreq, &hduty);
+        else
+            hard_pwm_get(self->hard, &hfreq, &hduty);
+        return Py_BuildValue("{sdsdsdsdsisd}",
+                             "frequency", (double)hfreq,
+                             "dutycycle", (double)hduty,
+                             "frequency_error", (double)(hfreq - self->freq),
+                             "duty_error", (double)(hduty - self->dutycycle),
+                             "overruns", 0,
+                             "max_latency_us", 0.0);
+    }
+
+    if (pwm_get_stats(self->gpio, &stats, reset))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "PWM has not been started");
+        return NULL;
+    }
+
+    if (stats.periods == 0 || stats.period_ns == 0)
+        return Py_BuildValue("{sOsOsOsOsLsd}",
+                             "frequency", Py_None,
+                             "dutycycle", Py_None,
+                             "frequency_error", Py_None,
+                             "duty_error", Py_None,
+                             "overruns", stats.overruns,
+                             "max_latency_us", stats.max_latency_ns / 1000.0);
+
+    freq = stats.periods * 1e9 / stats.period_ns;
+    duty = stats.on_ns * 100.0 / stats.period_ns;
+    return Py_BuildValue("{sdsdsdsdsLsd}",
+                         "frequency", freq,
+                         "dutycycle", duty,
+                         "frequency_error", freq - self->freq,
+                         "duty_error", duty - self->dutycycle,
+                         "overruns", stats.overruns,
+                         "max_latency_us", stats.max_latency_ns / 1000.0);
+}
+
 // python function PWM.stop(self)
 static PyObject *PWM_stop(PWMObject *self, PyObject *args)
 {
-    pwm_stop(self->gpio);
+    if (self->sysfs != NULL) {
+        if (sysfs_pwm_enable(self->sysfs, 0))
+            return PyErr_SetFromErrno(PyExc_IOError);
+    } else if (self->hard < 0) {
+        // a ramp cannot finish once the slot is gone
+        if (pwm_release(self->gpio, self->slot) == 0)
+            clear_ramp_callback(self->gpio);
+    } else {
+        hard_pwm_enable(self->hard, 0);
+    }
     Py_RETURN_NONE;
 }
 
 // deallocation method
 static void PWM_dealloc(PWMObject *self)
 {
-    pwm_stop(self->gpio);
+    if (self->ready) {
+        if (self->sysfs != NULL) {
+            sysfs_pwm_close(self->sysfs);
+        } else if (self->hard < 0) {
+            // after stop() the pin may belong to another object by now
+            if (pwm_release(self->gpio, self->slot) == 0)
+                clear_ramp_callback(self->gpio);
+        } else {
+            hard_pwm_cleanup(self->hard);
+        }
+        if (self->hard >= 0)
+            hard_pwm_release(self->hard);
+    }
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
 static PyMethodDef
 PWM_methods[] = {
-   { "start", (PyCFunction)PWM_start, METH_VARARGS, "Start software PWM\ndutycycle - the duty cycle (0.0 to 100.0)" },
+   { "start", (PyCFunction)PWM_start, METH_VARARGS, "Start PWM\ndutycycle - the duty cycle (0.0 to 100.0)" },
    { "ChangeDutyCycle", (PyCFunction)PWM_ChangeDutyCycle, METH_VARARGS, "Change the duty cycle\ndutycycle - between 0.0 and 100.0" },
    { "ChangeFrequency", (PyCFunction)PWM_ChangeFrequency, METH_VARARGS, "Change the frequency\nfrequency - frequency in Hz (freq > 1.0)" },
-   { "stop", (PyCFunction)PWM_stop, METH_VARARGS, "Stop software PWM" },
+   { "ramp", (PyCFunction)PWM_ramp, METH_VARARGS | METH_KEYWORDS, "Move the duty cycle to a new value over time, stepped every period by the PWM engine\ndutycycle - the final duty cycle (0.0 to 100.0)\nduration_ms - how long the ramp takes in milliseconds\n[curve] - RAMP_LINEAR (default), RAMP_EXPONENTIAL or RAMP_GAMMA\n[callback] - function called with the channel number when the ramp finishes" },
+   { "wait_ramp", (PyCFunction)PWM_wait_ramp, METH_VARARGS | METH_KEYWORDS, "Wait for a running ramp to finish.  Returns False if it timed out\n[timeout] - seconds to wait, default forever" },
+   { "stats", (PyCFunction)PWM_stats, METH_VARARGS | METH_KEYWORDS, "Return the measured frequency and duty cycle, their error from the requested values, the number of overrun periods and the worst edge latency\n[reset] - start measuring again after reading" },
+   { "stop", (PyCFunction)PWM_stop, METH_VARARGS, "Stop PWM" },
    { NULL }
 };
 
@@ -169,7 +452,7 @@ PyTypeObject PWMType = {
    0,                         // tp_setattro
    0,                         // tp_as_buffer
    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, // tp_flag
-   "Pulse Width Modulation class",    // tp_doc
+   "Pulse Width Modulation class - uses the PWM controller on PWM capable pins, software PWM elsewhere",    // tp_doc
    0,                         // tp_traverse
    0,                         // tp_clear
    0,                         // tp_richcompare
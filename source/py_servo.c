@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Python.h"
+#include "soft_pwm.h"
+#include "py_servo.h"
+#include "common.h"
+#include "c_gpio.h"
+
+#define SERVO_FRAME_US 20000.0
+
+typedef struct
+{
+    PyObject_HEAD
+    unsigned int gpio;
+    int running;
+} ServoObject;
+
+static int pulse_to_ns(double pulse_us, long long *pulse_ns)
+{
+    if (pulse_us < 0.0 || pulse_us > SERVO_FRAME_US)
+    {
+        PyErr_SetString(PyExc_ValueError, "pulse width must be from 0 to 20000 us");
+        return -1;
+    }
+    *pulse_ns = (long long)(pulse_us * 1000.0 + 0.5);
+    return 0;
+}
+
+// python method Servo.__init__(self, channel, pulse_us=0.0)
+static int Servo_init(ServoObject *self, PyObject *args, PyObject *kwds)
+{
+    int channel;
+    double pulse_us = 0.0;
+    long long pulse_ns;
+    unsigned int real_gpio;
+    static char *kwlist[] = {"channel", "pulse_us", NULL};
+
+    self->running = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|d", kwlist, &channel, &pulse_us))
+        return -1;
+
+    // convert channel to gpio
+    if (get_gpio_number(channel, &real_gpio, &(self->gpio)))
+        return -1;
+
+    // ensure channel set as output
+    if (gpio_direction[self->gpio] != OUTPUT)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an output first");
+        return -1;
+    }
+
+    if (pulse_to_ns(pulse_us, &pulse_ns))
+        return -1;
+
+    switch (servo_start(self->gpio, pulse_ns))
+    {
+        case 0: break;
+        case 1: PyErr_SetString(PyExc_RuntimeError, "A PWM or Servo object already exists for this GPIO channel");
+                return -1;
+        default: PyErr_SetString(PyExc_RuntimeError, "Failed to start the PWM engine");
+                 return -1;
+    }
+    self->running = 1;
+    return 0;
+}
+
+// python method Servo.set(self, pulse_us)
+static PyObject *Servo_set(ServoObject *self, PyObject *args)
+{
+    double pulse_us;
+    long long pulse_ns;
+
+    if (!PyArg_ParseTuple(args, "d", &pulse_us))
+        return NULL;
+    if (pulse_to_ns(pulse_us, &pulse_ns))
+        return NULL;
+
+    if (servo_set_many(&self->gpio, &pulse_ns, 1))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Servo has been stopped");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// python static method Servo.set_many([(servo, pulse_us), ...])
+static PyObject *Servo_set_many(PyObject *unused, PyObject *args)
+{
+    PyObject *updates, *seq, *item;
+    ServoObject *servo;
+    unsigned int gpios[54];
+    long long pulses[54];
+    double pulse_us;
+    Py_ssize_t count, i;
+
+    if (!PyArg_ParseTuple(args, "O", &updates))
+        return NULL;
+    if ((seq = PySequence_Fast(updates, "updates must be a sequence of (Servo, pulse_us) pairs")) == NULL)
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count > 54)
+    {
+        PyErr_SetString(PyExc_ValueError, "too many updates");
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    for (i=0; i<count; i++)
+    {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyArg_ParseTuple(item, "O!d", &ServoType, &servo, &pulse_us) ||
+            pulse_to_ns(pulse_us, &pulses[i]))
+        {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        gpios[i] = servo->gpio;
+    }
+    Py_DECREF(seq);
+
+    if (servo_set_many(gpios, pulses, (int)count))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Servo has been stopped");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// python method Servo.pulse_width(self)
+static PyObject *Servo_pulse_width(ServoObject *self, PyObject *args)
+{
+    long long pulse_ns;
+
+    if (servo_get(self->gpio, &pulse_ns))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Servo has been stopped");
+        return NULL;
+    }
+    return Py_BuildValue("d", pulse_ns / 1000.0);
+}
+
+// python method Servo.stop(self)
+static PyObject *Servo_stop(ServoObject *self, PyObject *args)
+{
+    if (self->running)
+        pwm_stop(self->gpio);
+    self->running = 0;
+    Py_RETURN_NONE;
+}
+
+// deallocation method
+static void Servo_dealloc(ServoObject *self)
+{
+    if (self->running)
+        pwm_stop(self->gpio);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef
+Servo_methods[] = {
+   { "set", (PyCFunction)Servo_set, METH_VARARGS, "Set the pulse width from the next frame\npulse_us - pulse width in microseconds (0 to 20000)" },
+   { "set_many", (PyCFunction)Servo_set_many, METH_VARARGS | METH_STATIC, "Set the pulse width of several servos, all taking effect in the same frame\nupdates - sequence of (servo, pulse_us) pairs" },
+   { "pulse_width", (PyCFunction)Servo_pulse_width, METH_NOARGS, "Return the pulse width being output in microseconds" },
+   { "stop", (PyCFunction)Servo_stop, METH_NOARGS, "Stop sending pulses" },
+   { NULL }
+};
+
+PyTypeObject ServoType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.Servo",          // tp_name
+   sizeof(ServoObject),       // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)Servo_dealloc, // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   0,                         // tp_repr
+   0,                         // tp_as_number
+   0,                         // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   0,                         // tp_as_buffer
+   Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, // tp_flag
+   "Servo pulse class - pulse widths in microseconds, sent in a 50 Hz frame shared by all servos",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   Servo_methods,             // tp_methods
+   0,                         // tp_members
+   0,                         // tp_getset
+   0,                         // tp_base
+   0,                         // tp_dict
+   0,                         // tp_descr_get
+   0,                         // tp_descr_set
+   0,                         // tp_dictoffset
+   (initproc)Servo_init,      // tp_init
+   0,                         // tp_alloc
+   0,                         // tp_new
+};
+
+PyTypeObject *Servo_init_ServoType(void)
+{
+   // Fill in some slots in the type, and make it ready
+   ServoType.tp_new = PyType_GenericNew;
+   if (PyType_Ready(&ServoType) < 0)
+      return NULL;
+
+   return &ServoType;
+}
@@ -20,207 +20,1262 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
 #include "c_gpio.h"
 #include "common.h"
 #include "soft_pwm.h"
-static pthread_t threads;
+
+#define PWM_BANKS       12          // sunxi banks A..L
+#define BENCH_BANKS     2           // pseudo banks after the real ones, for benchmark channels
+#define PWM_STACK_SIZE  (64*1024)
+#define SERVO_FRAME_NS  20000000LL  // 50 Hz
+
+// timing requested from Python, see update_params()
+struct pwm_params
+{
+    float freq;
+    float dutycycle;
+    long long period_ns;
+    unsigned int duty_seq;      // bumped by every duty cycle change
+};
 
 struct pwm
 {
+    // read by setters without pwm_lock, and kept by release_slot()
+    int claimed;                // slot belongs to a PWM, Servo or PDM object
+    unsigned int generation;    // bumped by every claim
+    int publishers;             // setters between params_enter() and params_exit()
+
     unsigned int gpio;
-    float freq;
+    unsigned int real_gpio;
+    struct pwm_params params[2];
+    unsigned int params_seq;    // params[params_seq & 1] is the current setting
+    unsigned char params_writer;    // held by a setter while it fills the other buffer
+    unsigned int applied_seq, applied_duty_seq;
+    float freq;                 // what the engine is producing
     float dutycycle;
-    float basetime;
-    float slicetime;
-    struct timespec req_on, req_off;
+    long long period_ns;
+    long long on_ns, off_ns;
     int running;
-    struct pwm *next;
+    int high;                   // level the engine last drove
+    int phase;                  // 0 - next edge starts a period, 1 - next edge ends the on time
+    long long period_start;     // start of the current period (CLOCK_MONOTONIC ns)
+    long long deadline;         // time of the next edge
+    int queue_index;            // position in pwm_queue, -1 if not queued
+    struct pwm_stats stats;
+    long long last_start;       // when the engine actually started the last period
+    long long last_rise;        // when the engine actually raised the pin
+    int servo;                  // part of the shared servo frame
+    long long pending_on_ns;    // servo pulse width for the next frame, -1 if none
+    int ramp_active;            // duty cycle is being ramped by the engine
+    int ramp_curve;
+    float ramp_from, ramp_to;
+    long long ramp_begin, ramp_duration_ns;
+    void (*ramp_done)(unsigned int gpio);
+    int pdm;                    // pulse density modulated, one edge per bit clock tick
+    struct pdm_ring *ring;      // samples, owned by the caller of pdm_start()
+    int pdm_order;
+    int ticks_per_sample, pdm_tick;
+    int sample;                 // current sample, offset to -32768..32767
+    long long integ1, integ2;   // modulator state
 };
-struct pwm *pwm_list = NULL;
+static struct pwm pwm_slots[54];
 
 extern int pinea64_found;
 
-void remove_pwm(unsigned int gpio)
+// All running channels are served by one engine thread.  Channels sit in a
+// binary min-heap ordered by their next edge, and pwm_lock protects the heap
+// and the engine side of each slot.  Deadlines are absolute and locked to the
+// start of each period, so wakeup latency never accumulates into the period.
+// Frequency and duty cycle changes only take the lock to claim a free slot -
+// the values themselves are published in the slot's params and picked up at
+// the next period start.
+static pthread_mutex_t pwm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pwm_cond;
+static pthread_once_t pwm_once = PTHREAD_ONCE_INIT;
+static pthread_t engine_thread;
+static int engine_started = 0;
+static struct pwm *pwm_queue[54];
+static int pwm_queued = 0;
+
+// With a spin threshold set, the engine sleeps until that long before the
+// next edge and busy-waits the rest, trading a CPU for edges that do not
+// depend on timer slack and wakeup latency.  Lateness of every edge goes in
+// pwm_jitter.
+static long long spin_ns = 0;
+static struct pwm_jitter pwm_jitter;
+static int engine_priority = 0;     // SCHED_FIFO priority, 0 for SCHED_OTHER
+
+// Benchmark channels drive pins in the pseudo banks, whose writes are
+// timestamped into bench_records instead of reaching the registers.
+struct bench_record
 {
-    struct pwm *p = pwm_list;
-    struct pwm *prev = NULL;
-    struct pwm *temp;
+    long long time;
+    uint64_t set, clr;
+};
+static struct bench_record *bench_records;
+static long long bench_capacity, bench_count, bench_dropped;
 
-    while (p != NULL)
-    {
-        if (p->gpio == gpio)
-        {
-            if (prev == NULL)
-                pwm_list = p->next;
-            else
-                prev->next = p->next;
-            temp = p;
-            p = p->next;
-            free(temp);
-        } else {
-            prev = p;
-            p = p->next;
-        }
+// Servo channels all use the same 20 ms period, with period starts aligned to
+// servo_origin.  New pulse widths are staged in pending_on_ns and picked up at
+// the start of the next frame, so widths staged under one hold of pwm_lock
+// reach every servo in the same frame.
+static long long servo_origin;
+static int servo_count = 0;
+
+// Ramps are stepped by the engine at the start of each period.  Finished
+// ramps that have a completion function are handed to the notify thread, so
+// the engine never waits for the function (or the GIL it may need).
+static pthread_cond_t ramp_cond;
+static pthread_t notify_thread;
+static int notify_started = 0;
+static struct {
+    unsigned int gpio;
+    void (*func)(unsigned int gpio);
+} ramp_notify[54];
+static int ramp_notified = 0;
+
+/************* time helpers ************/
+static long long monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct timespec ns_to_ts(long long ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
+}
+
+/************* deadline queue ************/
+static void queue_set(int i, struct pwm *p)
+{
+    pwm_queue[i] = p;
+    p->queue_index = i;
+}
+
+static void queue_sift_up(int i)
+{
+    struct pwm *p = pwm_queue[i];
+
+    while (i > 0 && p->deadline < pwm_queue[(i-1)/2]->deadline) {
+        queue_set(i, pwm_queue[(i-1)/2]);
+        i = (i-1)/2;
     }
+    queue_set(i, p);
 }
 
-void calculate_times(struct pwm *p)
+static void queue_sift_down(int i)
 {
-    long long usec;
+    struct pwm *p = pwm_queue[i];
+    int child;
 
-    usec = (long long)(p->dutycycle * p->slicetime * 1000.0);
-    p->req_on.tv_sec = (int)(usec / 1000000LL);
-    usec -= (long long)p->req_on.tv_sec * 1000000LL;
-    p->req_on.tv_nsec = (long)usec * 1000L;
+    while ((child = 2*i + 1) < pwm_queued) {
+        if (child + 1 < pwm_queued && pwm_queue[child+1]->deadline < pwm_queue[child]->deadline)
+            child++;
+        if (pwm_queue[child]->deadline >= p->deadline)
+            break;
+        queue_set(i, pwm_queue[child]);
+        i = child;
+    }
+    queue_set(i, p);
+}
 
-    usec = (long long)((100.0-p->dutycycle) * p->slicetime * 1000.0);
-    p->req_off.tv_sec = (int)(usec / 1000000LL);
-    usec -= (long long)p->req_off.tv_sec * 1000000LL;
-    p->req_off.tv_nsec = (long)usec * 1000L;
+static void queue_push(struct pwm *p)
+{
+    queue_set(pwm_queued++, p);
+    queue_sift_up(p->queue_index);
 }
 
-void full_sleep(struct timespec *req)
+static void queue_remove(struct pwm *p)
 {
-    struct timespec rem = {0};
+    int i = p->queue_index;
 
-    if (nanosleep(req,&rem) == -1)
-        full_sleep(&rem);
+    if (i < 0)
+        return;
+    p->queue_index = -1;
+    if (--pwm_queued == i)
+        return;
+    queue_set(i, pwm_queue[pwm_queued]);
+    queue_sift_up(i);
+    queue_sift_down(pwm_queue[i]->queue_index);
 }
 
-void *pwm_thread(void *threadarg)
+/************* channel slots ************/
+// the pin behind a channel, -1 if the channel has none
+static int channel_pin(unsigned int gpio)
 {
-    struct pwm *p = (struct pwm *)threadarg;
+    if (!pinea64_found)
+        return (int)gpio;
+    if (gpio >= sizeof(pinToGpioPineA64) / sizeof(pinToGpioPineA64[0]))
+        return -1;
+    return pinToGpioPineA64[gpio];
+}
 
-    while (p->running)
-    {
+#define SLOT_PWM        0
+#define SLOT_SERVO      1
+#define SLOT_PDM        2
 
-        if (p->dutycycle > 0.0)
-        {
-          if (pinea64_found)
-            output_gpio(*(pinToGpioPineA64 + p->gpio), 1);
-          else
-            output_gpio(p->gpio, 1);
-            full_sleep(&p->req_on);
-        }
+// called with pwm_lock held, kind is fixed before setters can see the claim
+static void init_slot(struct pwm *p, unsigned int real_gpio, int kind)
+{
+    // default to 1 kHz frequency, dutycycle 0.0
+    p->gpio = p - pwm_slots;
+    p->real_gpio = real_gpio;
+    p->queue_index = -1;
+    p->params[0].freq = 1000.0;
+    p->params[0].dutycycle = 0.0;
+    p->params[0].period_ns = 1000000;
+    p->params[0].duty_seq = 0;
+    p->params_seq = 0;
+    p->applied_seq = ~0u;
+    p->applied_duty_seq = 0;
+    p->servo = kind == SLOT_SERVO;
+    p->pdm = kind == SLOT_PDM;
+    if (++p->generation == 0)
+        p->generation = 1;      // 0 is never a claim
+    __atomic_store_n(&p->claimed, 1, __ATOMIC_RELEASE);
+}
+
+// called with pwm_lock held, returns NULL if the channel has no pin.  A slot
+// that is already claimed is returned as it is, whatever its kind.
+static struct pwm *claim_slot(unsigned int gpio, int kind)
+{
+    struct pwm *p = &pwm_slots[gpio];
+    int pin;
+
+    if (__atomic_load_n(&p->claimed, __ATOMIC_ACQUIRE))
+        return p;
+    if ((pin = channel_pin(gpio)) < 0)
+        return NULL;
+    init_slot(p, (unsigned int)pin, kind);
+    return p;
+}
 
-        if (p->dutycycle < 100.0)
-        {
-          if (pinea64_found)
-            output_gpio(*(pinToGpioPineA64 + p->gpio), 0);
-          else
-            output_gpio(p->gpio, 0);
-            full_sleep(&p->req_off);
+// called with pwm_lock held.  Withdraws the claim before wiping the slot, so
+// a setter either sees the slot free or is waited for, see params_enter().
+static void release_slot(struct pwm *p)
+{
+    if (p->servo && p->running)
+        servo_count--;
+    queue_remove(p);
+    __atomic_store_n(&p->claimed, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&p->publishers, __ATOMIC_SEQ_CST))
+        sched_yield();
+    memset(&p->gpio, 0, sizeof(struct pwm) - offsetof(struct pwm, gpio));
+    p->queue_index = -1;
+}
+
+static struct pwm *running_slot(unsigned int gpio)
+{
+    if (gpio >= 54 || !pwm_slots[gpio].running)
+        return NULL;
+    return &pwm_slots[gpio];
+}
+
+/************* timing parameters ************/
+// never 0, which the engine divides by
+static long long period_ns_of(float freq)
+{
+    long long period_ns = (long long)(1000000000.0 / freq);
+
+    return period_ns > 0 ? period_ns : 1;
+}
+
+// Setters fill the buffer the engine is not using and publish it by bumping
+// params_seq.  Setters are serialised against each other by params_writer,
+// but never wait for the engine.
+static void update_params(struct pwm *p, const float *freq, const float *dutycycle)
+{
+    struct pwm_params next;
+    unsigned int seq;
+
+    while (__atomic_test_and_set(&p->params_writer, __ATOMIC_ACQUIRE))
+        ;
+    seq = __atomic_load_n(&p->params_seq, __ATOMIC_RELAXED);
+    next = p->params[seq & 1];
+    if (freq != NULL) {
+        next.freq = *freq;
+        next.period_ns = period_ns_of(*freq);
+    }
+    if (dutycycle != NULL) {
+        next.dutycycle = *dutycycle;
+        next.duty_seq++;
+    }
+
+    // a reader that sees any of these writes must also see params_seq move
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p->params[(seq + 1) & 1] = next;
+    __atomic_store_n(&p->params_seq, seq + 1, __ATOMIC_RELEASE);
+    __atomic_clear(&p->params_writer, __ATOMIC_RELEASE);
+}
+
+// called with pwm_lock held, by the engine at period starts and by functions
+// that need the latest setting right away
+static void apply_params(struct pwm *p)
+{
+    struct pwm_params params;
+    unsigned int seq, check;
+
+    if (p->servo || p->pdm || __atomic_load_n(&p->params_seq, __ATOMIC_ACQUIRE) == p->applied_seq)
+        return;
+
+    // retry if a setter published again while we were copying
+    do {
+        seq = __atomic_load_n(&p->params_seq, __ATOMIC_ACQUIRE);
+        params = p->params[seq & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        check = __atomic_load_n(&p->params_seq, __ATOMIC_RELAXED);
+    } while (seq != check);
+
+    p->applied_seq = seq;
+    p->freq = params.freq;
+    p->period_ns = params.period_ns;
+    if (params.duty_seq != p->applied_duty_seq) {
+        // a new duty cycle replaces any ramp in progress
+        p->applied_duty_seq = params.duty_seq;
+        p->dutycycle = params.dutycycle;
+        if (p->ramp_active) {
+            p->ramp_active = 0;
+            pthread_cond_broadcast(&ramp_cond);
         }
     }
+    p->on_ns = (long long)(p->period_ns * (p->dutycycle / 100.0));
+    p->off_ns = p->period_ns - p->on_ns;
 
-    // clean up
-  if (pinea64_found)
-    output_gpio(*(pinToGpioPineA64 + p->gpio), 0);
-  else
-    output_gpio(p->gpio, 0);
-    remove_pwm(p->gpio);
-    pthread_exit(NULL);
+    // measure the new setting from scratch
+    memset(&p->stats, 0, sizeof(p->stats));
+    p->last_start = 0;
 }
 
-struct pwm *add_new_pwm(unsigned int gpio)
+/************* ramps ************/
+static double ramp_ease(int curve, double x)
 {
-    struct pwm *new_pwm;
+    switch (curve)
+    {
+        case RAMP_EXPONENTIAL: return (pow(2.0, 10.0 * x) - 1.0) / 1023.0;
+        case RAMP_GAMMA:       return pow(x, 2.2);
+        default:               return x;
+    }
+}
 
-    new_pwm = malloc(sizeof(struct pwm));
-    new_pwm->gpio = gpio;
-    new_pwm->running = 0;
-    new_pwm->next = NULL;
-    // default to 1 kHz frequency, dutycycle 0.0
-    new_pwm->freq = 1000.0;
-    new_pwm->dutycycle = 0.0;
-    new_pwm->basetime = 1.0;    // 1 ms
-    new_pwm->slicetime = 0.01;  // 0.01 ms
-    calculate_times(new_pwm);
-    return new_pwm;
+static void ramp_step(struct pwm *p, long long now)
+{
+    double t = 1.0;
+    float low, high;
+
+    if (now - p->ramp_begin < p->ramp_duration_ns)
+        t = (double)(now - p->ramp_begin) / p->ramp_duration_ns;
+
+    // the curve runs from the low to the high duty cycle, and backwards for
+    // a falling ramp, so a fade looks the same in both directions
+    low = p->ramp_from < p->ramp_to ? p->ramp_from : p->ramp_to;
+    high = p->ramp_from < p->ramp_to ? p->ramp_to : p->ramp_from;
+    if (p->ramp_to < p->ramp_from)
+        t = 1.0 - t;
+    p->dutycycle = low + (high - low) * ramp_ease(p->ramp_curve, t);
+    p->on_ns = (long long)(p->period_ns * (p->dutycycle / 100.0));
+    p->off_ns = p->period_ns - p->on_ns;
+
+    if (now - p->ramp_begin < p->ramp_duration_ns)
+        return;
+
+    p->dutycycle = p->ramp_to;
+    p->ramp_active = 0;
+    if (p->ramp_done != NULL && ramp_notified < 54) {
+        ramp_notify[ramp_notified].gpio = p->gpio;
+        ramp_notify[ramp_notified].func = p->ramp_done;
+        ramp_notified++;
+    }
+    pthread_cond_broadcast(&ramp_cond);
 }
 
-struct pwm *find_pwm(unsigned int gpio)
+static void *ramp_notifier(void *threadarg)
 {
-    struct pwm *p = pwm_list;
+    unsigned int gpio;
+    void (*func)(unsigned int gpio);
 
-    if (pwm_list == NULL)
+    pthread_mutex_lock(&pwm_lock);
+    for (;;)
     {
-        pwm_list = add_new_pwm(gpio);
-        return pwm_list;
+        while (ramp_notified == 0)
+            pthread_cond_wait(&ramp_cond, &pwm_lock);
+        gpio = ramp_notify[0].gpio;
+        func = ramp_notify[0].func;
+        memmove(ramp_notify, ramp_notify + 1, --ramp_notified * sizeof(ramp_notify[0]));
+        pthread_mutex_unlock(&pwm_lock);
+        func(gpio);
+        pthread_mutex_lock(&pwm_lock);
+    }
+    return NULL;
+}
+
+/************* pulse density modulation ************/
+// Single producer (the Python object), single consumer (the engine) ring,
+// so neither side takes a lock.
+unsigned int pdm_ring_write(struct pdm_ring *ring, const uint16_t *samples, unsigned int count)
+{
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    unsigned int i;
+
+    if (count > ring->size - (head - tail))
+        count = ring->size - (head - tail);
+    for (i=0; i<count; i++)
+        ring->samples[(head + i) & (ring->size - 1)] = samples[i];
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+unsigned int pdm_ring_queued(struct pdm_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+static void pdm_next_sample(struct pwm *p)
+{
+    struct pdm_ring *ring = p->ring;
+    unsigned int tail = ring->tail;
+
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+        // nothing queued - hold the last sample
+        __atomic_add_fetch(&ring->underruns, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    p->sample = (int)ring->samples[tail & (ring->size - 1)] - 32768;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void pdm_edge(struct pwm *p, long long now, uint32_t *set, uint32_t *clr)
+{
+    uint32_t bit = 1 << (p->real_gpio % 32);
+    int bank = p->real_gpio / 32;
+    long long ticks = (now - p->deadline) / p->period_ns + 1;
+    long long fb;
+    int out;
+
+    // ticks we were too late for keep the previous level, but samples are
+    // still consumed at the right rate
+    p->stats.overruns += ticks - 1;
+    p->stats.periods += ticks;
+    p->stats.period_ns += ticks * p->period_ns;
+    if (p->high)
+        p->stats.on_ns += ticks * p->period_ns;
+    for (p->pdm_tick += ticks; p->pdm_tick >= p->ticks_per_sample; p->pdm_tick -= p->ticks_per_sample)
+        pdm_next_sample(p);
+
+    // the output is +-32768, the integrators accumulate the error against
+    // the sample
+    fb = p->high ? 32768 : -32768;
+    p->integ1 += p->sample - fb;
+    if (p->pdm_order == 2) {
+        p->integ2 += p->integ1 - fb;
+        out = p->integ2 >= 0;
+    } else {
+        out = p->integ1 >= 0;
     }
 
-    while (p != NULL)
+    if (out && !p->high)
+        set[bank] |= bit;
+    else if (!out && p->high)
+        clr[bank] |= bit;
+    p->high = out;
+    p->deadline += ticks * p->period_ns;
+}
+
+/************* engine ************/
+static void bench_write(const uint32_t *set, const uint32_t *clr)
+{
+    struct bench_record *r;
+
+    if (bench_count >= bench_capacity) {
+        bench_dropped++;
+        return;
+    }
+    r = &bench_records[bench_count++];
+    r->time = monotonic_ns();
+    r->set = set[0] | (uint64_t)set[1] << 32;
+    r->clr = clr[0] | (uint64_t)clr[1] << 32;
+}
+
+static void apply_priority(void)
+{
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = engine_priority;
+    pthread_setschedparam(engine_thread, engine_priority ? SCHED_FIFO : SCHED_OTHER, &param);
+}
+
+static void record_jitter(long long late_ns)
+{
+    int bucket = late_ns > 0 ? 64 - __builtin_clzll(late_ns) : 0;
+
+    if (bucket >= PWM_JITTER_BUCKETS)
+        bucket = PWM_JITTER_BUCKETS - 1;
+    pwm_jitter.buckets[bucket]++;
+    pwm_jitter.edges++;
+    pwm_jitter.total_ns += late_ns;
+    if (pwm_jitter.max_ns < late_ns)
+        pwm_jitter.max_ns = late_ns;
+}
+
+static void pwm_edge(struct pwm *p, long long now, uint32_t *set, uint32_t *clr)
+{
+    uint32_t bit = 1 << (p->real_gpio % 32);
+    int bank = p->real_gpio / 32;
+    long long missed;
+
+    if (p->stats.max_latency_ns < now - p->deadline)
+        p->stats.max_latency_ns = now - p->deadline;
+    record_jitter(now - p->deadline);
+
+    if (p->pdm) {
+        pdm_edge(p, now, set, clr);
+        return;
+    }
+
+    if (p->phase == 1) {    // end of the on time
+        clr[bank] |= bit;
+        p->high = 0;
+        if (p->last_start)  // only count periods that are being measured
+            p->stats.on_ns += now - p->last_rise;
+        p->phase = 0;
+        p->period_start += p->period_ns;
+        p->deadline = p->period_start;
+        return;
+    }
+
+    // start of a period - skip any whole periods we were too late for
+    if (now - p->period_start >= p->period_ns) {
+        missed = (now - p->period_start) / p->period_ns;
+        p->period_start += missed * p->period_ns;
+        p->stats.overruns += missed;
+    }
+
+    apply_params(p);
+    if (p->ramp_active)
+        ramp_step(p, now);
+
+    if (p->servo && p->pending_on_ns >= 0) {
+        p->on_ns = p->pending_on_ns;
+        p->off_ns = p->period_ns - p->on_ns;
+        p->pending_on_ns = -1;
+    }
+
+    if (p->last_start) {
+        p->stats.periods++;
+        p->stats.period_ns += now - p->last_start;
+        if (p->high)    // 100% - the pin was on for the whole period
+            p->stats.on_ns += now - p->last_start;
+    }
+    p->last_start = now;
+
+    if (p->on_ns > 0 && !p->high) {
+        set[bank] |= bit;
+        p->high = 1;
+    } else if (p->on_ns == 0 && p->high) {
+        clr[bank] |= bit;
+        p->high = 0;
+    }
+    p->last_rise = now;
+
+    if (p->on_ns > 0 && p->off_ns > 0) {
+        p->phase = 1;
+        p->deadline = p->period_start + p->on_ns;
+    } else {    // 0% or 100% - nothing to do until the next period
+        p->period_start += p->period_ns;
+        p->deadline = p->period_start;
+    }
+}
+
+static void *pwm_engine(void *threadarg)
+{
+    uint32_t set[PWM_BANKS + BENCH_BANKS], clr[PWM_BANKS + BENCH_BANKS];
+    struct timespec wake;
+    long long now, deadline;
+    int bank;
+
+    pthread_mutex_lock(&pwm_lock);
+    for (;;)
     {
-        if (p->gpio == gpio)
-            return p;
-        if (p->next == NULL)
-        {
-            p->next = add_new_pwm(gpio);
-            return p->next;
+        if (pwm_queued == 0) {
+            pthread_cond_wait(&pwm_cond, &pwm_lock);
+            continue;
+        }
+
+        now = monotonic_ns();
+        deadline = pwm_queue[0]->deadline;
+        if (now < deadline - spin_ns) {
+            // absolute CLOCK_MONOTONIC sleep, woken early whenever a channel
+            // is added or removed
+            wake = ns_to_ts(deadline - spin_ns);
+            pthread_cond_timedwait(&pwm_cond, &pwm_lock, &wake);
+            continue;
+        }
+        if (now < deadline) {
+            // inside the spin threshold - busy-wait without the lock, then
+            // look at the queue again in case it changed meanwhile
+            pthread_mutex_unlock(&pwm_lock);
+            while (monotonic_ns() < deadline)
+                ;
+            pthread_mutex_lock(&pwm_lock);
+            continue;
         }
-        p = p->next;
+
+        // handle every channel that is due in one pass, so edges that fall
+        // at the same instant cost one register write per bank
+        memset(set, 0, sizeof(set));
+        memset(clr, 0, sizeof(clr));
+        while (pwm_queued > 0 && pwm_queue[0]->deadline <= now) {
+            pwm_edge(pwm_queue[0], now, set, clr);
+            queue_sift_down(0);
+        }
+
+        for (bank=0; bank<PWM_BANKS; bank++)
+            if (set[bank] | clr[bank])
+                output_gpio_bank(bank, set[bank], clr[bank]);
+        if (set[PWM_BANKS] | clr[PWM_BANKS] | set[PWM_BANKS+1] | clr[PWM_BANKS+1])
+            bench_write(set + PWM_BANKS, clr + PWM_BANKS);
     }
     return NULL;
 }
 
-void pwm_set_duty_cycle(unsigned int gpio, float dutycycle)
+static void pwm_engine_init(void)
+{
+    pthread_condattr_t cattr;
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pwm_cond, &cattr);
+    pthread_cond_init(&ramp_cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+}
+
+static int pwm_engine_start(void)
+{
+    pthread_attr_t attr;
+    int result;
+
+    if (engine_started)
+        return 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PWM_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    result = pthread_create(&engine_thread, &attr, pwm_engine, NULL);
+    pthread_attr_destroy(&attr);
+    if (result != 0)
+        return -1;
+    engine_started = 1;
+    if (engine_priority)
+        apply_priority();
+    return 0;
+}
+
+/************* public functions ************/
+static void params_exit(struct pwm *p)
+{
+    __atomic_sub_fetch(&p->publishers, 1, __ATOMIC_SEQ_CST);
+}
+
+// Gets the slot of a PWM channel for a setter, claiming it if it is free, and
+// NULL if the channel is a servo or PDM output or has no pin.  The setter
+// counts itself in publishers before it looks at the claim, and
+// release_slot() withdraws the claim before it waits for publishers to drop
+// to 0, so the slot cannot be wiped under an update.  Only claiming a free
+// slot takes pwm_lock, which the engine holds while it handles edges.
+static struct pwm *params_enter(unsigned int gpio, unsigned int *generation)
+{
+    struct pwm *p = &pwm_slots[gpio];
+    int pin_found;
+
+    *generation = 0;
+    for (;;) {
+        __atomic_add_fetch(&p->publishers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&p->claimed, __ATOMIC_SEQ_CST)) {
+            // the claim cannot change until we leave publishers
+            if (p->servo || p->pdm) {
+                params_exit(p);
+                return NULL;
+            }
+            *generation = p->generation;
+            return p;
+        }
+        params_exit(p);
+
+        pthread_mutex_lock(&pwm_lock);
+        pin_found = claim_slot(gpio, SLOT_PWM) != NULL;
+        pthread_mutex_unlock(&pwm_lock);
+        if (!pin_found)
+            return NULL;
+    }
+}
+
+unsigned int pwm_set_duty_cycle(unsigned int gpio, float dutycycle)
+// returns the generation of the claim that was set, for pwm_release(), or 0
 {
     struct pwm *p;
+    unsigned int generation;
 
-    if (dutycycle < 0.0 || dutycycle > 100.0)
+    if (dutycycle < 0.0 || dutycycle > 100.0 || gpio >= 54)
     {
         // btc fixme - error
-        return;
+        return 0;
     }
 
-    if ((p = find_pwm(gpio)) != NULL)
-    {
-        p->dutycycle = dutycycle;
-        calculate_times(p);
+    if ((p = params_enter(gpio, &generation)) != NULL) {
+        update_params(p, NULL, &dutycycle);
+        params_exit(p);
     }
+    return generation;
 }
 
-void pwm_set_frequency(unsigned int gpio, float freq)
+unsigned int pwm_set_frequency(unsigned int gpio, float freq)
+// returns the generation of the claim that was set, for pwm_release(), or 0
 {
     struct pwm *p;
+    unsigned int generation;
 
-    if (freq <= 0.0) // to avoid divide by zero
+    if (freq <= 0.0 || freq > PWM_MAX_FREQ || gpio >= 54) // to avoid divide by zero
     {
         // btc fixme - error
-        return;
+        return 0;
     }
 
-    if ((p = find_pwm(gpio)) != NULL)
-    {
-        p->basetime = 1000.0 / freq;    // calculated in ms
-        p->slicetime = p->basetime / 100.0;
-        calculate_times(p);
+    if ((p = params_enter(gpio, &generation)) != NULL) {
+        update_params(p, &freq, NULL);
+        params_exit(p);
     }
+    return generation;
 }
 
 void pwm_start(unsigned int gpio)
 {
     struct pwm *p;
 
-    if (((p = find_pwm(gpio)) == NULL) || p->running)
+    if (gpio >= 54)
         return;
 
-    p->running = 1;
-    if (pthread_create(&threads, NULL, pwm_thread, (void *)p) != 0)
+    pthread_once(&pwm_once, pwm_engine_init);
+    pthread_mutex_lock(&pwm_lock);
+    p = claim_slot(gpio, SLOT_PWM);
+    if (p == NULL || p->running || pwm_engine_start() != 0)
     {
         // btc fixme - error
-        p->running = 0;
+        pthread_mutex_unlock(&pwm_lock);
         return;
     }
+
+    apply_params(p);
+    p->running = 1;
+    p->high = 0;
+    p->phase = 0;
+    output_gpio(p->real_gpio, 0);
+    p->period_start = p->deadline = monotonic_ns();
+    p->last_start = 0;
+    memset(&p->stats, 0, sizeof(p->stats));
+    queue_push(p);
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
 }
 
-void pwm_stop(unsigned int gpio)
+int pwm_busy(unsigned int gpio)
+// return values:
+// 0 - Channel free for a PWM object
+// 1 - Channel in use by a servo or PDM output
+{
+    int result;
+
+    if (gpio >= 54)
+        return 0;
+    pthread_mutex_lock(&pwm_lock);
+    result = pwm_slots[gpio].servo || pwm_slots[gpio].pdm;
+    pthread_mutex_unlock(&pwm_lock);
+    return result;
+}
+
+int servo_start(unsigned int gpio, long long pulse_ns)
+// return values:
+// 0 - Success
+// 1 - Channel already in use
+// 2 - Other error
+{
+    struct pwm *p;
+    long long now;
+
+    if (gpio >= 54)
+        return 2;
+
+    pthread_once(&pwm_once, pwm_engine_init);
+    pthread_mutex_lock(&pwm_lock);
+    if (pwm_slots[gpio].claimed) {  // in use by a PWM object
+        pthread_mutex_unlock(&pwm_lock);
+        return 1;
+    }
+    if ((p = claim_slot(gpio, SLOT_SERVO)) == NULL) {
+        pthread_mutex_unlock(&pwm_lock);
+        return 2;
+    }
+    if (pwm_engine_start() != 0) {
+        release_slot(p);
+        pthread_mutex_unlock(&pwm_lock);
+        return 2;
+    }
+
+    p->freq = 1000000000.0 / SERVO_FRAME_NS;
+    p->period_ns = SERVO_FRAME_NS;
+    p->on_ns = 0;
+    p->off_ns = SERVO_FRAME_NS;
+    p->pending_on_ns = pulse_ns;
+    memset(&p->stats, 0, sizeof(p->stats));
+    p->last_start = 0;
+
+    // join the frame the other servos are running in
+    now = monotonic_ns();
+    if (servo_count++ == 0)
+        servo_origin = now;
+    p->period_start = servo_origin + (now - servo_origin + SERVO_FRAME_NS - 1) / SERVO_FRAME_NS * SERVO_FRAME_NS;
+    p->deadline = p->period_start;
+
+    p->running = 1;
+    p->high = 0;
+    p->phase = 0;
+    output_gpio(p->real_gpio, 0);
+    queue_push(p);
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
+    return 0;
+}
+
+int servo_set_many(const unsigned int *gpios, const long long *pulse_ns, int count)
+// return values:
+// 0 - Success
+// 1 - A channel is not a running servo, nothing was changed
+{
+    struct pwm *p;
+    int i;
+
+    pthread_mutex_lock(&pwm_lock);
+    for (i=0; i<count; i++)
+    {
+        if ((p = running_slot(gpios[i])) == NULL || !p->servo) {
+            pthread_mutex_unlock(&pwm_lock);
+            return 1;
+        }
+    }
+    for (i=0; i<count; i++)
+        pwm_slots[gpios[i]].pending_on_ns = pulse_ns[i];
+    pthread_mutex_unlock(&pwm_lock);
+    return 0;
+}
+
+int servo_get(unsigned int gpio, long long *pulse_ns)
+// return values:
+// 0 - Success
+// 1 - Channel is not a running servo
+{
+    struct pwm *p;
+    int result = 1;
+
+    pthread_mutex_lock(&pwm_lock);
+    if ((p = running_slot(gpio)) != NULL && p->servo)
+    {
+        *pulse_ns = p->on_ns;
+        result = 0;
+    }
+    pthread_mutex_unlock(&pwm_lock);
+    return result;
+}
+
+int pdm_start(unsigned int gpio, struct pdm_ring *ring, long long tick_ns, int ticks_per_sample, int order)
+// return values:
+// 0 - Success
+// 1 - Channel already in use
+// 2 - Other error
+{
+    struct pwm *p;
+
+    if (gpio >= 54 || tick_ns <= 0 || ticks_per_sample <= 0)
+        return 2;
+
+    pthread_once(&pwm_once, pwm_engine_init);
+    pthread_mutex_lock(&pwm_lock);
+    if (pwm_slots[gpio].claimed) {
+        pthread_mutex_unlock(&pwm_lock);
+        return 1;
+    }
+    if ((p = claim_slot(gpio, SLOT_PDM)) == NULL) {
+        pthread_mutex_unlock(&pwm_lock);
+        return 2;
+    }
+    if (pwm_engine_start() != 0) {
+        release_slot(p);
+        pthread_mutex_unlock(&pwm_lock);
+        return 2;
+    }
+
+    p->ring = ring;
+    p->pdm_order = order;
+    p->period_ns = tick_ns;
+    p->freq = 1000000000.0 / tick_ns;
+    p->ticks_per_sample = ticks_per_sample;
+    p->pdm_tick = ticks_per_sample - 1;     // take the first sample on the first tick
+    p->sample = -32768;
+    p->integ1 = p->integ2 = 0;
+
+    p->running = 1;
+    p->high = 0;
+    output_gpio(p->real_gpio, 0);
+    p->deadline = monotonic_ns();
+    queue_push(p);
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
+    return 0;
+}
+
+int pwm_ramp(unsigned int gpio, float dutycycle, long long duration_ns, int curve, void (*done)(unsigned int gpio))
+// return values:
+// 0 - Success
+// 1 - Channel not running
+// 2 - Other error
+{
+    struct pwm *p;
+    pthread_attr_t attr;
+
+    pthread_mutex_lock(&pwm_lock);
+    if ((p = running_slot(gpio)) == NULL || p->servo || p->pdm) {
+        pthread_mutex_unlock(&pwm_lock);
+        return 1;
+    }
+
+    if (done != NULL && !notify_started) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        notify_started = pthread_create(&notify_thread, &attr, ramp_notifier, NULL) == 0;
+        pthread_attr_destroy(&attr);
+        if (!notify_started) {
+            pthread_mutex_unlock(&pwm_lock);
+            return 2;
+        }
+    }
+
+    // start from the latest setting, so a pending change cannot cancel the ramp
+    apply_params(p);
+    p->ramp_from = p->dutycycle;
+    p->ramp_to = dutycycle;
+    p->ramp_curve = curve;
+    p->ramp_begin = monotonic_ns();
+    p->ramp_duration_ns = duration_ns;
+    p->ramp_done = done;
+    p->ramp_active = 1;
+    pthread_mutex_unlock(&pwm_lock);
+    return 0;
+}
+
+int pwm_ramp_wait(unsigned int gpio, long long timeout_ns)
+// return values:
+// 0 - No ramp running on the channel
+// 1 - Timed out
+{
+    struct pwm *p;
+    struct timespec wake;
+    long long until = monotonic_ns() + timeout_ns;
+
+    pthread_once(&pwm_once, pwm_engine_init);
+    wake = ns_to_ts(until);
+    pthread_mutex_lock(&pwm_lock);
+    for (;;)
+    {
+        if ((p = running_slot(gpio)) == NULL || !p->ramp_active) {
+            pthread_mutex_unlock(&pwm_lock);
+            return 0;
+        }
+        if (timeout_ns >= 0 && monotonic_ns() >= until) {
+            pthread_mutex_unlock(&pwm_lock);
+            return 1;
+        }
+        if (timeout_ns >= 0)
+            pthread_cond_timedwait(&ramp_cond, &pwm_lock, &wake);
+        else
+            pthread_cond_wait(&ramp_cond, &pwm_lock);
+    }
+}
+
+void pwm_set_spin(long long ns)
+{
+    pthread_once(&pwm_once, pwm_engine_init);
+    pthread_mutex_lock(&pwm_lock);
+    spin_ns = ns < 0 ? 0 : ns;
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
+}
+
+int pwm_set_priority(int priority)
+// return values:
+// 0 - Success
+// 1 - Could not apply the priority (not permitted)
+{
+    int result = 0;
+    struct sched_param param;
+
+    pthread_mutex_lock(&pwm_lock);
+    if (engine_started) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        result = pthread_setschedparam(engine_thread, priority ? SCHED_FIFO : SCHED_OTHER, &param) != 0;
+    }
+    if (result == 0)
+        engine_priority = priority;
+    pthread_mutex_unlock(&pwm_lock);
+    return result;
+}
+
+void pwm_get_jitter(struct pwm_jitter *jitter, int reset)
+{
+    pthread_mutex_lock(&pwm_lock);
+    *jitter = pwm_jitter;
+    jitter->spin_ns = spin_ns;
+    if (reset)
+        memset(&pwm_jitter, 0, sizeof(pwm_jitter));
+    pthread_mutex_unlock(&pwm_lock);
+}
+
+int pwm_get_stats(unsigned int gpio, struct pwm_stats *stats, int reset)
+// return values:
+// 0 - Success
+// 1 - Channel not running
 {
     struct pwm *p;
+    int result = 1;
+
+    pthread_mutex_lock(&pwm_lock);
+    if ((p = running_slot(gpio)) != NULL)
+    {
+        *stats = p->stats;
+        if (reset) {
+            memset(&p->stats, 0, sizeof(p->stats));
+            p->last_start = 0;
+        }
+        result = 0;
+    }
+    pthread_mutex_unlock(&pwm_lock);
+    return result;
+}
+
+// called with pwm_lock held
+static void stop_slot(struct pwm *p)
+{
+    if (p->running)
+        output_gpio(p->real_gpio, 0);
+    release_slot(p);
+    if (engine_started) {
+        pthread_cond_signal(&pwm_cond);
+        pthread_cond_broadcast(&ramp_cond);
+    }
+}
+
+void pwm_stop(unsigned int gpio)
+{
+    if (gpio >= 54)
+        return;
+
+    pthread_mutex_lock(&pwm_lock);
+    if (pwm_slots[gpio].claimed)
+        stop_slot(&pwm_slots[gpio]);
+    pthread_mutex_unlock(&pwm_lock);
+}
+
+int pwm_release(unsigned int gpio, unsigned int generation)
+// stop the channel if the slot is still the claim a setter returned
+// generation for - after a stop, the pin may have been claimed again by a
+// servo, a PDM output or another PWM object
+// return values:
+// 0 - Stopped
+// 1 - Slot no longer held by that claim
+{
+    int result = 1;
+
+    if (gpio >= 54 || generation == 0)
+        return 1;
+
+    pthread_mutex_lock(&pwm_lock);
+    if (pwm_slots[gpio].claimed && pwm_slots[gpio].generation == generation) {
+        stop_slot(&pwm_slots[gpio]);
+        result = 0;
+    }
+    pthread_mutex_unlock(&pwm_lock);
+    return result;
+}
+
+/************* benchmark ************/
+static int compare_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static long long percentile(const long long *sorted, long long count, double fraction)
+{
+    long long i = (long long)(fraction * (count - 1) + 0.5);
+
+    return count ? sorted[i] : 0;
+}
+
+// measure one benchmark channel from the recorded writes: frequency and
+// duty cycle from its edges, and how far each edge was from the grid of
+// ideal edges that starts at its first rising edge
+static void bench_channel(int bit, long long period_ns, long long on_ns, struct pwm_bench *result,
+                          long long *deviations, long long *deviation_count)
+{
+    uint64_t mask = (uint64_t)1 << bit;
+    long long first = -1, last = 0, rises = 0, on_total = 0, rise = -1;
+    long long i, k, ideal;
+    double freq, duty;
+
+    for (i=0; i<bench_count; i++)
+    {
+        if (bench_records[i].set & mask) {
+            if (first < 0)
+                first = bench_records[i].time;
+            rise = last = bench_records[i].time;
+            rises++;
+            k = (rise - first + period_ns / 2) / period_ns;
+            ideal = first + k * period_ns;
+            deviations[(*deviation_count)++] = llabs(rise - ideal);
+        } else if ((bench_records[i].clr & mask) && rise >= 0) {
+            on_total += bench_records[i].time - rise;
+            k = (rise - first + period_ns / 2) / period_ns;
+            ideal = first + k * period_ns + on_ns;
+            deviations[(*deviation_count)++] = llabs(bench_records[i].time - ideal);
+        }
+    }
+    if (rises < 2)
+        return;
+
+    freq = (rises - 1) * 1e9 / (last - first);
+    duty = on_total * 100.0 / ((double)rises * period_ns);
+    result->frequency += freq / result->channels;
+    result->dutycycle += duty / result->channels;
+    if (fabs(freq - result->requested_frequency) > fabs(result->frequency_error))
+        result->frequency_error = freq - result->requested_frequency;
+    if (fabs(duty - result->requested_dutycycle) > fabs(result->duty_error))
+        result->duty_error = duty - result->requested_dutycycle;
+}
+
+int pwm_benchmark(int channels, float freq, float dutycycle, long long duration_ns, struct pwm_bench *result)
+// return values:
+// 0 - Success
+// 1 - Not enough free channel slots
+// 2 - Other error
+{
+    struct pwm *bench[54];
+    struct timespec cpu_start, cpu_end, delay;
+    clockid_t cpu_clock;
+    long long start, wall, *deviations, deviation_count = 0, i;
+    int n = 0;
+
+    if (channels < 1 || channels > 54 || freq <= 0.0 || freq > PWM_MAX_FREQ || dutycycle < 0.0 || dutycycle > 100.0)
+        return 2;
+
+    memset(result, 0, sizeof(*result));
+    result->channels = channels;
+    result->requested_frequency = freq;
+    result->requested_dutycycle = dutycycle;
+
+    // every channel makes two edges per period, and each may be a write of its own
+    bench_capacity = (long long)(2.0 * channels * freq * duration_ns / 1e9 * 1.25) + 1024;
+    if (bench_capacity > 4000000)
+        bench_capacity = 4000000;
+    bench_count = bench_dropped = 0;
+    if ((bench_records = malloc(bench_capacity * sizeof(struct bench_record))) == NULL)
+        return 2;
+
+    pthread_once(&pwm_once, pwm_engine_init);
+    pthread_mutex_lock(&pwm_lock);
+    for (i=0; i<54 && n<channels; i++)
+        if (!pwm_slots[i].claimed)
+            bench[n++] = &pwm_slots[i];
+    if (n < channels || pwm_engine_start() != 0) {
+        pthread_mutex_unlock(&pwm_lock);
+        free(bench_records);
+        bench_records = NULL;
+        return n < channels ? 1 : 2;
+    }
+
+    // all channels start together - the worst case for edges falling due at
+    // the same time
+    start = monotonic_ns() + 1000000;
+    for (i=0; i<channels; i++)
+    {
+        // benchmark channels drive pseudo pins, not the pin of their slot
+        init_slot(bench[i], PWM_BANKS * 32 + i, SLOT_PWM);
+        bench[i]->freq = freq;
+        bench[i]->dutycycle = dutycycle;
+        bench[i]->period_ns = period_ns_of(freq);
+        bench[i]->on_ns = (long long)(bench[i]->period_ns * (dutycycle / 100.0));
+        bench[i]->off_ns = bench[i]->period_ns - bench[i]->on_ns;
+        bench[i]->applied_seq = bench[i]->params_seq;
+        bench[i]->running = 1;
+        bench[i]->period_start = bench[i]->deadline = start;
+        queue_push(bench[i]);
+    }
+    pthread_getcpuclockid(engine_thread, &cpu_clock);
+    clock_gettime(cpu_clock, &cpu_start);
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
+
+    delay = ns_to_ts(duration_ns + 1000000);
+    nanosleep(&delay, NULL);
+
+    pthread_mutex_lock(&pwm_lock);
+    clock_gettime(cpu_clock, &cpu_end);
+    wall = monotonic_ns() - start;
+    for (i=0; i<channels; i++)
+        release_slot(bench[i]);
+    pthread_cond_signal(&pwm_cond);
+    pthread_mutex_unlock(&pwm_lock);
+
+    result->writes = bench_count;
+    result->dropped = bench_dropped;
+    result->cpu_percent = ((cpu_end.tv_sec - cpu_start.tv_sec) * 1e9 +
+                           (cpu_end.tv_nsec - cpu_start.tv_nsec)) * 100.0 / wall;
+
+    // a merged write carries an edge for every channel that was due
+    for (i=0; i<bench_count; i++)
+        deviation_count += __builtin_popcountll(bench_records[i].set | bench_records[i].clr);
+    deviations = malloc((deviation_count + 1) * sizeof(long long));
+    deviation_count = 0;
+    if (deviations != NULL)
+    {
+        for (i=0; i<channels; i++)
+            bench_channel(i, period_ns_of(freq),
+                          (long long)(period_ns_of(freq) * (dutycycle / 100.0)),
+                          result, deviations, &deviation_count);
+        qsort(deviations, deviation_count, sizeof(long long), compare_ll);
+        result->edges = deviation_count;
+        result->jitter_p50_ns = percentile(deviations, deviation_count, 0.50);
+        result->jitter_p90_ns = percentile(deviations, deviation_count, 0.90);
+        result->jitter_p99_ns = percentile(deviations, deviation_count, 0.99);
+        result->jitter_p999_ns = percentile(deviations, deviation_count, 0.999);
+        result->jitter_max_ns = deviation_count ? deviations[deviation_count-1] : 0;
+        free(deviations);
+    }
 
-    if ((p = find_pwm(gpio)) != NULL)
-        p->running = 0;
+    free(bench_records);
+    bench_records = NULL;
+    return 0;
 }
@@ -20,9 +20,83 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-/* Software PWM using threads */
- 
-void pwm_set_duty_cycle(unsigned int gpio, float dutycycle);
-void pwm_set_frequency(unsigned int gpio, float freq);
+/* Software PWM driven by a single engine thread */
+
+#include <stdint.h>
+
+#define RAMP_LINEAR      0
+#define RAMP_EXPONENTIAL 1
+#define RAMP_GAMMA       2
+
+// highest frequency, a period of the engine's 1 ns time unit
+#define PWM_MAX_FREQ     1000000000.0
+
+// what the engine actually produced since the channel was started, its
+// settings last changed or the stats were last reset
+struct pwm_stats
+{
+    long long periods;          // complete periods measured
+    long long period_ns;        // total measured length of those periods
+    long long on_ns;            // total time the pin was high in them
+    long long overruns;         // whole periods skipped because the engine was late
+    long long max_latency_ns;   // worst lateness of any edge
+};
+
+// lateness of every edge the engine produced, over all channels
+#define PWM_JITTER_BUCKETS 32
+struct pwm_jitter
+{
+    long long edges;
+    long long total_ns;
+    long long max_ns;
+    long long spin_ns;          // spin threshold in use
+    long long buckets[PWM_JITTER_BUCKETS];  // bucket n counts edges less than 2^n ns late
+};
+
+unsigned int pwm_set_duty_cycle(unsigned int gpio, float dutycycle);
+unsigned int pwm_set_frequency(unsigned int gpio, float freq);
 void pwm_start(unsigned int gpio);
 void pwm_stop(unsigned int gpio);
+int pwm_release(unsigned int gpio, unsigned int generation);
+int pwm_busy(unsigned int gpio);
+int pwm_ramp(unsigned int gpio, float dutycycle, long long duration_ns, int curve, void (*done)(unsigned int gpio));
+int pwm_ramp_wait(unsigned int gpio, long long timeout_ns);
+void pwm_set_spin(long long ns);
+int pwm_set_priority(int priority);
+void pwm_get_jitter(struct pwm_jitter *jitter, int reset);
+int pwm_get_stats(unsigned int gpio, struct pwm_stats *stats, int reset);
+
+// pulse density modulation - samples are 0..65535, queued in a ring of a
+// power of two size that the caller allocates and keeps until pwm_stop()
+struct pdm_ring
+{
+    uint16_t *samples;
+    unsigned int size;
+    unsigned int head, tail;
+    long long underruns;        // samples due when the ring was empty
+};
+
+int pdm_start(unsigned int gpio, struct pdm_ring *ring, long long tick_ns, int ticks_per_sample, int order);
+unsigned int pdm_ring_write(struct pdm_ring *ring, const uint16_t *samples, unsigned int count);
+unsigned int pdm_ring_queued(struct pdm_ring *ring);
+
+// servo mode - pulse widths in a 50 Hz frame shared by all servo channels
+int servo_start(unsigned int gpio, long long pulse_ns);
+int servo_set_many(const unsigned int *gpios, const long long *pulse_ns, int count);
+int servo_get(unsigned int gpio, long long *pulse_ns);
+
+// timing benchmark - simulated channels run by the engine, with every
+// register write timestamped instead of performed
+struct pwm_bench
+{
+    int channels;
+    double requested_frequency, requested_dutycycle;
+    double frequency, dutycycle;            // measured, mean over channels
+    double frequency_error, duty_error;     // worst channel
+    long long writes, dropped;              // bank writes recorded, and not recorded for lack of room
+    long long edges;
+    long long jitter_p50_ns, jitter_p90_ns, jitter_p99_ns, jitter_p999_ns, jitter_max_ns;
+    double cpu_percent;                     // engine thread CPU time over wall time
+};
+
+int pwm_benchmark(int channels, float freq, float dutycycle, long long duration_ns, struct pwm_bench *result);
@@ -30,6 +30,11 @@
 
 
 #include "spi_lib.h"
+#include "spi_device.h"
+#include "spi_acquisition.h"
+#include "spi_framebuffer.h"
+#include "spi_flash.h"
+#include "../event_gpio.h"
 
 #include <errno.h>
 #include <stdio.h>
@@ -37,7 +42,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-int fd;
+#include <linux/spi/spidev.h>
 
 #ifdef __DEBUG
 #define debug(format, args...) printf(format, args);
@@ -46,173 +51,273 @@ int fd;
 #endif
 
 
+/* The module level functions drive this device, opened by open() */
+static SPIDeviceObject *default_device = NULL;
+
 /**
  * Read n bytes from slave device
  * 
  * @param self
  * @param args number of bytes
- * @return tuple with read elements
+ * @return bytes read
  */
 static PyObject* py_read(PyObject *self, PyObject* args){
 
-    PyObject *rx_list = 0;
-    PyObject *item = 0;
-    uint8_t rx_len = 0;
+    return SPIDevice_read(default_device, args);
+}
 
-    /* Parse arguments */
-    if(!PyArg_ParseTuple(args, "i", &rx_len)){
-        return NULL;
-    }
+/**
+ * Read from slave device into a buffer, filling it
+ *
+ * @param self
+ * @param args writable buffer
+ * @return number of bytes read
+ */
+static PyObject* py_readinto(PyObject *self, PyObject* args){
 
-    /* Alocate memmory for buffer*/
-    uint8_t *rx_buffer = (uint8_t*)malloc(rx_len * sizeof(uint8_t));
-    memset(rx_buffer, 0, sizeof(uint8_t)*rx_len);
+    return SPIDevice_readinto(default_device, args);
+}
 
-    /* Read from device*/
-    if(spi_read(fd, rx_buffer, rx_len) < 0){
-        return PyErr_SetFromErrno(PyExc_IOError);
-    }
+/**
+ * Write bytes to slave device
+ * 
+ * @param self
+ * @param args data to write - bytes-like object or list of integers
+ * @return none
+ */
+static PyObject* py_write(PyObject *self, PyObject* args){
 
-    /* Make list */
-    rx_list = PyList_New(rx_len);
+    return SPIDevice_write(default_device, args);
+}
 
-    /* Populate list */
-    uint8_t i;
-    for(i = 0; i < rx_len; i++){
-        item = PyInt_FromLong(rx_buffer[i]);
-        PyList_SET_ITEM(rx_list, i, item);
-    }
 
-    /* Do cleanup*/
-    free(rx_buffer);
-    //Py_DECREF(item);
+/**
+ * Do transfer of data to slave device
+ * 
+ * @param self
+ * @param args data to send and number of bytes to read
+ * @return bytes read
+ */
+static PyObject* py_xfer(PyObject* self, PyObject* args){
 
-    /* Return list */
-    return rx_list;
+    return SPIDevice_xfer(default_device, args);
 }
 
 /**
- * Write bytes to slave device
- * 
+ * Do transfer of data to slave device, reading into a buffer
+ *
  * @param self
- * @param args Tuple with data to write
- * @return none
+ * @param args data to send and writable buffer to fill
+ * @return number of bytes read
  */
-static PyObject* py_write(PyObject *self, PyObject* args){
+static PyObject* py_xfer_into(PyObject* self, PyObject* args){
 
-    PyObject *tx_list;
-    PyObject *item = 0;
-    uint8_t tx_len = 0;
+    return SPIDevice_xfer_into(default_device, args);
+}
 
-    /* Parse arguments */
-    if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &tx_list)){
-        return NULL;
-    }
+/**
+ * Write words to slave device
+ *
+ * @param self
+ * @param args words to write and the word layout
+ * @return none
+ */
+static PyObject* py_write_words(PyObject* self, PyObject* args, PyObject* kwargs){
 
-    /* Get length of list */
-    tx_len = PyList_Size(tx_list);
+    return SPIDevice_write_words(default_device, args, kwargs);
+}
 
-    /* Allocate memory for output buffer */
-    uint8_t *tx_buffer = (uint8_t *)malloc(tx_len * sizeof(uint8_t));
-    memset(tx_buffer, 0, sizeof(uint8_t));
+/**
+ * Read words from slave device
+ *
+ * @param self
+ * @param args number of words to read and the word layout
+ * @return array of the words read
+ */
+static PyObject* py_read_words(PyObject* self, PyObject* args, PyObject* kwargs){
 
-    /* Populate output buffer */
-    int i;
-    for(i = 0; i < tx_len; i++){
-        item = PyList_GetItem(tx_list, i);
-        tx_buffer[i] = (uint8_t)PyInt_AsLong(item);
-#ifdef __DEBUG
-        printf("tx[%d]=%02X\n", i, tx_buffer[i]);
-#endif
-    }
+    return SPIDevice_read_words(default_device, args, kwargs);
+}
 
-    /* Send data */
-    uint8_t *ptr = tx_buffer;
-    while (tx_len > 63) {
-        if(spi_write(fd, ptr, 64) < 0){
-            return PyErr_SetFromErrno(PyExc_IOError);
-        }
-        ptr += 64;
-        tx_len -= 64;
-    }
-    if (tx_len > 0) {
-        if(spi_write(fd, ptr, tx_len) < 0){
-            return PyErr_SetFromErrno(PyExc_IOError);
-        }
-    }
+/**
+ * Read words from slave device into a buffer, filling it
+ *
+ * @param self
+ * @param args writable buffer and the word layout
+ * @return number of words read
+ */
+static PyObject* py_readinto_words(PyObject* self, PyObject* args, PyObject* kwargs){
 
-    /* Do cleanup */
-    free(tx_buffer);
+    return SPIDevice_readinto_words(default_device, args, kwargs);
+}
 
-    //Py_DECREF(item);
-//    Py_DECREF(tx_list);
-    
-    Py_RETURN_NONE;
+/**
+ * Do transfer of words to slave device
+ *
+ * @param self
+ * @param args words to send, number of words to read and the word layout
+ * @return array of the words read
+ */
+static PyObject* py_xfer_words(PyObject* self, PyObject* args, PyObject* kwargs){
+
+    return SPIDevice_xfer_words(default_device, args, kwargs);
 }
 
+/**
+ * Do transfer of words to slave device, reading into a buffer
+ *
+ * @param self
+ * @param args words to send, writable buffer and the word layout
+ * @return number of words read
+ */
+static PyObject* py_xfer_words_into(PyObject* self, PyObject* args, PyObject* kwargs){
+
+    return SPIDevice_xfer_words_into(default_device, args, kwargs);
+}
 
 /**
- * Do transfer of data to slave device
- * 
+ * Run a list of segments as one transaction
+ *
  * @param self
- * @param args tuple of data to read and 
- * @return list with read data
+ * @param args list of segments
+ * @return memoryview of the bytes read per segment
  */
-static PyObject* py_xfer(PyObject* self, PyObject* args){
+static PyObject* py_transfer(PyObject* self, PyObject* args){
 
-    PyObject *tx_list = 0;
-    PyObject *rx_list = 0;
-    PyObject *item = 0;
+    return SPIDevice_transfer(default_device, args);
+}
 
-    uint tx_len = 0;
-    uint rx_len = 0;
+static int compare_devices(const void *a, const void *b){
 
-    /* Parse arguments */
-    if(!PyArg_ParseTuple(args, "O!i", &PyList_Type, &tx_list, &rx_len)){
-        return NULL;
-    }
+    uintptr_t x = (uintptr_t)*(SPIDeviceObject * const *)a, y = (uintptr_t)*(SPIDeviceObject * const *)b;
 
-    /* Get length of output data */
-    tx_len = PyList_Size(tx_list);
+    return x < y ? -1 : x > y;
+}
 
-    /* Allocate memory for sending */
-    uint8_t* tx_buffer;
-    uint8_t* rx_buffer;
-    
-    tx_buffer = (uint8_t *)malloc(tx_len * sizeof(uint8_t));
-    rx_buffer = (uint8_t *)malloc(rx_len * sizeof(uint8_t));
+/**
+ * Do transfers on several devices, the whole batch with the GIL released and
+ * no Python between transfers. The devices are locked in address order, so
+ * batches sharing devices cannot deadlock.
+ *
+ * @param self
+ * @param args list of (device, data, n) - data a bytes-like object or list
+ * of integers to send, n bytes to read
+ * @return list of the bytes read per transfer
+ */
+static PyObject* py_xfer_many(PyObject* self, PyObject* args){
 
-    memset(rx_buffer, 0, sizeof(uint8_t)*rx_len);
+    PyObject *list, *seq, *tx_obj, *tmp, *result = NULL;
+    SPIDeviceObject **devices = NULL, **locked = NULL;
+    Py_buffer *views = NULL;
+    spi_segment_t *segments = NULL;
+    Py_ssize_t count, i, parsed = 0, rx_len, common, nlocked = 0, n;
+    uint8_t *rx;
+    int err = 0;
 
-    /* Populate both output buffer */
-    int i;
-    for(i = 0; i < tx_len; i++){
-        item = PyList_GetItem(tx_list, i);
-        tx_buffer[i] = (uint8_t)PyInt_AsLong(item);
+    if(!PyArg_ParseTuple(args, "O", &list)){
+        return NULL;
     }
-
-    /* Do the transaction */
-    if(spi_xfer(fd, tx_buffer, tx_len, rx_buffer, rx_len) < 0){
-        return PyErr_SetFromErrno(PyExc_IOError);
+    if((seq = PySequence_Fast(list, "transfers must be a sequence")) == NULL){
+        return NULL;
     }
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    devices = PyMem_New(SPIDeviceObject *, count);
+    locked = PyMem_New(SPIDeviceObject *, count);
+    views = PyMem_New(Py_buffer, count);
+    segments = PyMem_New(spi_segment_t, 2 * count);
+    if(devices == NULL || locked == NULL || views == NULL || segments == NULL){
+        PyErr_NoMemory();
+        goto done;
+    }
+    if((result = PyList_New(count)) == NULL){
+        goto done;
+    }
+    memset(segments, 0, 2 * count * sizeof(spi_segment_t));
 
-    /* Make new list*/
-    rx_list = PyList_New(rx_len);
-
-    /* Populate the new list */
-    for(i = 0; i < rx_len; i++){
-        item = PyInt_FromLong(rx_buffer[i]);
-        PyList_SET_ITEM(rx_list, i, item);
+    for(parsed = 0; parsed < count; parsed++){
+        if(!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, parsed), "O!On;transfers must be (device, data, n)",
+            &SPIDeviceType, &devices[parsed], &tx_obj, &rx_len)){
+            goto fail;
+        }
+        if(rx_len < 0){
+            PyErr_SetString(PyExc_ValueError, "length must not be negative");
+            goto fail;
+        }
+        /* lists become a buffer of their own, the device scratch buffer
+         * could be needed by a later transfer on the same device */
+        if(PyList_Check(tx_obj)){
+            if((tmp = PyByteArray_FromObject(tx_obj)) == NULL){
+                goto fail;
+            }
+        }else{
+            Py_INCREF(tx_obj);
+            tmp = tx_obj;
+        }
+        err = PyObject_GetBuffer(tmp, &views[parsed], PyBUF_SIMPLE);
+        Py_DECREF(tmp);
+        if(err < 0){
+            goto fail;
+        }
+        if((tmp = PyBytes_FromStringAndSize(NULL, rx_len)) == NULL){
+            PyBuffer_Release(&views[parsed]);
+            goto fail;
+        }
+        PyList_SET_ITEM(result, parsed, tmp);
+        rx = (uint8_t *)PyBytes_AS_STRING(tmp);
+
+        /* full duplex over max(tx, n) bytes, as xfer() */
+        common = views[parsed].len < rx_len ? views[parsed].len : rx_len;
+        segments[2 * parsed].tx = views[parsed].buf;
+        segments[2 * parsed].rx = rx;
+        segments[2 * parsed].len = common;
+        segments[2 * parsed + 1].tx = views[parsed].len > common ? (const uint8_t *)views[parsed].buf + common : NULL;
+        segments[2 * parsed + 1].rx = rx_len > common ? rx + common : NULL;
+        segments[2 * parsed + 1].len = (views[parsed].len > rx_len ? views[parsed].len : rx_len) - common;
     }
 
-    /* Do cleanup */
-    free(tx_buffer);
-    free(rx_buffer);
+    memcpy(locked, devices, count * sizeof(SPIDeviceObject *));
+    qsort(locked, count, sizeof(SPIDeviceObject *), compare_devices);
+    for(i = 0; i < count; i++){
+        if(nlocked > 0 && locked[nlocked - 1] == locked[i]){
+            continue;
+        }
+        spi_device_lock(locked[i]);
+        locked[nlocked++] = locked[i];
+        if(locked[i]->fd < 0){
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+            goto fail;
+        }
+    }
 
-//    Py_DECREF(tx_list);
-//    Py_DECREF(item);
+    err = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for(i = 0; i < count && err == 0; i++){
+        err = spi_device_transfer(devices[i], &segments[2 * i], 2);
+    }
+    Py_END_ALLOW_THREADS
+    if(err){
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto fail;
+    }
+    goto done;
 
-    return rx_list;
+fail:
+    Py_CLEAR(result);
+done:
+    for(n = 0; n < nlocked; n++){
+        spi_device_unlock(locked[n]);
+    }
+    for(i = 0; i < parsed; i++){
+        PyBuffer_Release(&views[i]);
+    }
+    PyMem_Free(devices);
+    PyMem_Free(locked);
+    PyMem_Free(views);
+    PyMem_Free(segments);
+    Py_DECREF(seq);
+    return result;
 }
 
 /**
@@ -225,15 +330,10 @@ static PyObject* py_xfer(PyObject* self, PyObject* args){
  */
 static PyObject* py_open(PyObject* self, PyObject* args, PyObject* kwargs){
 
-    int ret;
     char *device;
-    spi_config_t config = {0};
-
-    /* Set default values */
-    config.mode = 0;
-    config.bits_per_word = 8;
-    config.speed = 100000;
-    config.delay = 0;
+    spi_config_t config;
+    int mode = 0, bits_per_word = 8, delay = 0;
+    long speed = 100000;
 
     /* Define keywords */
     static char *kwlist [] = {
@@ -242,22 +342,21 @@ static PyObject* py_open(PyObject* self, PyObject* args, PyObject* kwargs){
 
     /* Parse arguments */
     if(!PyArg_ParseTupleAndKeywords(
-        args, kwargs, "s|iiii", kwlist,
+        args, kwargs, "s|iili", kwlist,
         &device,
-        &config.mode,
-        &config.bits_per_word,
-        &config.speed,
-        &config.delay)){
+        &mode,
+        &bits_per_word,
+        &speed,
+        &delay)){
+        return NULL;
+    }
+    if(spi_device_config(&config, mode, bits_per_word, speed, delay) < 0){
         return NULL;
     }
 
     /* Open the device */
-    ret = spi_open(device, config);
-
-    if(ret < 0 ){
-        return PyErr_SetFromErrno(PyExc_IOError);
-    }else{
-        fd = ret;
+    if(spi_device_open(default_device, device, config) < 0){
+        return NULL;
     }
 
     Py_RETURN_NONE;
@@ -272,22 +371,22 @@ static PyObject* py_open(PyObject* self, PyObject* args, PyObject* kwargs){
  */
 static PyObject* py_close(PyObject* self, PyObject* args){
 
-    int ret;
-
-    ret = spi_close(fd);
-    if(ret < 0){
-        return PyErr_SetFromErrno(PyExc_IOError);
-    }else{
-        fd = 0;
-    }
-
-    Py_RETURN_NONE;
+    return SPIDevice_close(default_device, NULL);
 }
  PyMethodDef module_methods[] = {
     {"open", (PyCFunction)py_open, METH_VARARGS | METH_KEYWORDS, "Open file dssescriptor"},
-    {"xfer", py_xfer, METH_VARARGS, "Transfer data"},
-    {"write", py_write, METH_VARARGS, "Write data"},
-    {"read", py_read, METH_VARARGS, "Read data"},
+    {"xfer", py_xfer, METH_VARARGS, "Transfer data - send a bytes-like object or list of integers while reading n bytes, returned as bytes"},
+    {"xfer_into", py_xfer_into, METH_VARARGS, "Transfer data - send a bytes-like object or list of integers while reading into a writable buffer, returns the number of bytes read"},
+    {"write", py_write, METH_VARARGS, "Write data - a bytes-like object or list of integers"},
+    {"read", py_read, METH_VARARGS, "Read n bytes, returned as bytes"},
+    {"readinto", py_readinto, METH_VARARGS, "Read into a writable buffer, filling it, returns the number of bytes read"},
+    {"write_words", (PyCFunction)py_write_words, METH_VARARGS | METH_KEYWORDS, "Write words - a buffer of width bit items (array, NumPy, ...) or list of integers, sent in byteorder with each byte LSB first if lsb_first"},
+    {"read_words", (PyCFunction)py_read_words, METH_VARARGS | METH_KEYWORDS, "Read count words of width bits, returned as an array"},
+    {"readinto_words", (PyCFunction)py_readinto_words, METH_VARARGS | METH_KEYWORDS, "Read words into a writable buffer of width bit items, filling it, returns the number of words read"},
+    {"xfer_words", (PyCFunction)py_xfer_words, METH_VARARGS | METH_KEYWORDS, "Transfer words - send a buffer of width bit items or list of integers while reading count words, returned as an array"},
+    {"xfer_words_into", (PyCFunction)py_xfer_words_into, METH_VARARGS | METH_KEYWORDS, "Transfer words - send a buffer of width bit items or list of integers while reading into a writable buffer of width bit items, returns the number of words read"},
+    {"transfer", py_transfer, METH_VARARGS, "Run a list of segments as one transaction, returns a memoryview of the bytes read per segment"},
+    {"xfer_many", py_xfer_many, METH_VARARGS, "Transfer data on several devices in one call - a list of (device, data, n), returns a list of the n bytes read by each"},
     {"close", py_close, METH_NOARGS, "Close file descriptor"},
     {NULL, NULL, 0, NULL}
 };
@@ -318,6 +417,70 @@ PyMODINIT_FUNC
     module = Py_InitModule("RPi._SPI", module_methods);
 #endif
 
+    if(SPIDevice_init_SPIDeviceType() == NULL){
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
+    }
+    Py_INCREF(&SPIDeviceType);
+    PyModule_AddObject(module, "Device", (PyObject*)&SPIDeviceType);
+
+    if(SPIAcquisition_init_SPIAcquisitionType() == NULL){
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
+    }
+    Py_INCREF(&SPIAcquisitionType);
+    PyModule_AddObject(module, "Acquisition", (PyObject*)&SPIAcquisitionType);
+
+    if(SPIFramebuffer_init_SPIFramebufferType() == NULL){
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
+    }
+    Py_INCREF(&SPIFramebufferType);
+    PyModule_AddObject(module, "Framebuffer", (PyObject*)&SPIFramebufferType);
+
+    if(SPIFlash_init_SPIFlashType() == NULL){
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
+    }
+    Py_INCREF(&SPIFlashType);
+    PyModule_AddObject(module, "Flash", (PyObject*)&SPIFlashType);
+
+    /* Mode bits for a gpio chip select, SPI_CS_HIGH makes it active high
+     * and SPI_NO_CS keeps the spidev node's own line idle where the
+     * controller driver supports that */
+    PyModule_AddIntConstant(module, "CS_HIGH", SPI_CS_HIGH);
+    PyModule_AddIntConstant(module, "NO_CS", SPI_NO_CS);
+
+    /* DRDY edges for Acquisition */
+    PyModule_AddIntConstant(module, "RISING", RISING_EDGE);
+    PyModule_AddIntConstant(module, "FALLING", FALLING_EDGE);
+    PyModule_AddIntConstant(module, "BOTH", BOTH_EDGE);
+
+    /* Which spi_pack() kernel the word transfers use */
+    PyModule_AddStringConstant(module, "PACK_KERNEL", spi_pack_kernel());
+
+    /* Not opened until open() */
+    default_device = (SPIDeviceObject *)SPIDeviceType.tp_new(&SPIDeviceType, NULL, NULL);
+    if(default_device == NULL){
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
+    }
+
 
 #if PY_MAJOR_VERSION >= 3
         return module;
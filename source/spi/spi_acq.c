@@ -0,0 +1,241 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_acq.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include "spi_acq.h"
+
+static void *acq_thread(void *arg) {
+    struct spi_acq *acq = (struct spi_acq *)arg;
+    struct pollfd fds[2];
+    spi_segment_t segment;
+    uint64_t head, tail, one = 1;
+    char value[4];
+    int ret;
+
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = acq->tx;
+    segment.len = acq->frame_len;
+
+    fds[0].fd = acq->drdy_fd;
+    fds[0].events = POLLPRI | POLLERR;
+    fds[1].fd = acq->stop_fd;
+    fds[1].events = POLLIN;
+
+    /* the value file starts out readable, clear that before waiting */
+    lseek(acq->drdy_fd, 0, SEEK_SET);
+    read(acq->drdy_fd, value, sizeof(value));
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            __atomic_add_fetch(&acq->errors, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!(fds[0].revents & (POLLPRI | POLLERR)))
+            continue;
+        lseek(acq->drdy_fd, 0, SEEK_SET);
+        read(acq->drdy_fd, value, sizeof(value));
+
+        head = acq->head;
+        tail = __atomic_load_n(&acq->tail, __ATOMIC_ACQUIRE);
+        if (head - tail < acq->capacity)
+            segment.rx = acq->ring + (head & (acq->capacity - 1)) * acq->frame_len;
+        else
+            segment.rx = acq->spare;
+
+        spi_bus_lock(acq->bus);
+        ret = spi_transfer(acq->fd, &acq->config, &segment, 1);
+        spi_bus_unlock(acq->bus);
+        if (ret < 0) {
+            __atomic_add_fetch(&acq->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_add_fetch(&acq->frames, 1, __ATOMIC_RELAXED);
+        if (segment.rx == acq->spare) {
+            __atomic_add_fetch(&acq->overruns, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* publish, then wake the reader if it went to sleep on an empty
+         * ring - both sides store then load, so sequentially consistent */
+        __atomic_store_n(&acq->head, head + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&acq->waiting, __ATOMIC_SEQ_CST))
+            write(acq->wake_fd, &one, sizeof(one));
+    }
+    return NULL;
+}
+
+/*
+ * Start acquiring frames of frame_len bytes, sending tx (zeros if NULL) with
+ * each while holding bus. capacity is the ring size in frames and must be a
+ * power of two. The engine takes over fd, even when starting fails, and
+ * closes it in spi_acq_stop(); drdy_fd stays with the caller.
+ */
+int spi_acq_start(struct spi_acq *acq, int fd, int drdy_fd, struct spi_bus *bus, spi_config_t config,
+                  const uint8_t *tx, size_t frame_len, size_t capacity) {
+    int err;
+
+    memset(acq, 0, sizeof(*acq));
+    acq->fd = fd;
+    acq->drdy_fd = drdy_fd;
+    acq->bus = bus;
+    acq->config = config;
+    acq->frame_len = frame_len;
+    acq->capacity = capacity;
+    acq->wake_fd = eventfd(0, EFD_NONBLOCK);
+    acq->stop_fd = eventfd(0, 0);
+    acq->ring = malloc(capacity * frame_len);
+    acq->spare = malloc(frame_len);
+    if (tx != NULL && (acq->tx = malloc(frame_len)) != NULL)
+        memcpy(acq->tx, tx, frame_len);
+
+    if (acq->wake_fd < 0 || acq->stop_fd < 0 || acq->ring == NULL ||
+        acq->spare == NULL || (tx != NULL && acq->tx == NULL)) {
+        err = acq->wake_fd < 0 || acq->stop_fd < 0 ? errno : ENOMEM;
+        goto fail;
+    }
+    if ((err = pthread_create(&acq->thread, NULL, acq_thread, acq)) != 0)
+        goto fail;
+    acq->running = 1;
+    return 0;
+
+fail:
+    spi_acq_stop(acq);
+    errno = err;
+    return -1;
+}
+
+/*
+ * Tell the thread and a reader in spi_acq_wait() that the engine is being
+ * stopped, without waiting for either. Needs no lock, but the engine must
+ * still be running.
+ */
+void spi_acq_cancel(struct spi_acq *acq) {
+    uint64_t one = 1;
+
+    write(acq->stop_fd, &one, sizeof(one));
+}
+
+void spi_acq_stop(struct spi_acq *acq) {
+    uint64_t one = 1;
+
+    if (acq->running) {
+        write(acq->stop_fd, &one, sizeof(one));
+        pthread_join(acq->thread, NULL);
+        acq->running = 0;
+    }
+    if (acq->wake_fd >= 0)
+        close(acq->wake_fd);
+    if (acq->stop_fd >= 0)
+        close(acq->stop_fd);
+    if (acq->fd >= 0)
+        close(acq->fd);
+    acq->wake_fd = acq->stop_fd = acq->fd = -1;
+    free(acq->ring);
+    free(acq->spare);
+    free(acq->tx);
+    acq->ring = acq->spare = acq->tx = NULL;
+}
+
+size_t spi_acq_queued(struct spi_acq *acq) {
+    return __atomic_load_n(&acq->head, __ATOMIC_SEQ_CST) - acq->tail;
+}
+
+/*
+ * Copy up to max_frames of the oldest frames to out and free their slots.
+ * Returns the number of frames copied.
+ */
+size_t spi_acq_read(struct spi_acq *acq, uint8_t *out, size_t max_frames) {
+    uint64_t tail = acq->tail;
+    size_t count = spi_acq_queued(acq), first, mask = acq->capacity - 1;
+
+    if (count > max_frames)
+        count = max_frames;
+
+    /* at most two copies, the second from the start of the ring */
+    first = acq->capacity - (tail & mask);
+    if (first > count)
+        first = count;
+    memcpy(out, acq->ring + (tail & mask) * acq->frame_len, first * acq->frame_len);
+    memcpy(out + first * acq->frame_len, acq->ring, (count - first) * acq->frame_len);
+
+    __atomic_store_n(&acq->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Wait up to timeout_ms (-1 forever) for a frame to be queued. A wake that
+ * finds the ring still empty waits again for what is left of the timeout.
+ * Returns 1 when frames are queued, 0 on timeout and -1 once
+ * spi_acq_cancel() was called. stop_fd is left readable for the thread.
+ */
+int spi_acq_wait(struct spi_acq *acq, int timeout_ms) {
+    struct pollfd fds[2];
+    uint64_t count;
+    long long deadline = 0, left;
+    int ready;
+
+    if (spi_acq_queued(acq) > 0)
+        return 1;
+
+    if (timeout_ms > 0)
+        deadline = now_ms() + timeout_ms;
+    fds[0].fd = acq->wake_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = acq->stop_fd;
+    fds[1].events = POLLIN;
+    __atomic_store_n(&acq->waiting, 1, __ATOMIC_SEQ_CST);
+    while ((ready = spi_acq_queued(acq) > 0) == 0) {
+        if (poll(fds, 2, timeout_ms) <= 0)
+            break;
+        if (fds[1].revents) {
+            ready = -1;
+            break;
+        }
+        read(acq->wake_fd, &count, sizeof(count));
+        if (timeout_ms > 0) {
+            left = deadline - now_ms();
+            timeout_ms = left > 0 ? (int)left : 0;
+        }
+    }
+    __atomic_store_n(&acq->waiting, 0, __ATOMIC_SEQ_CST);
+    return ready < 0 ? -1 : ready || spi_acq_queued(acq) > 0;
+}
@@ -0,0 +1,71 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_acq.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef _SPI_ACQ_H
+#define _SPI_ACQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "spi_lib.h"
+#include "spi_bus.h"
+
+/*
+ * Data ready triggered acquisition. A thread waits for an edge on the DRDY
+ * value file, clocks one frame out of the device and appends it to a ring
+ * that a single reader drains. head is only written by the thread and tail
+ * only by the reader. When the ring is full the frame is still read, so the
+ * device releases DRDY, but dropped and counted as an overrun.
+ */
+struct spi_acq {
+    int fd;
+    int drdy_fd;
+    struct spi_bus *bus;
+    spi_config_t config;
+    uint8_t *tx;
+    size_t frame_len;
+    uint8_t *ring;
+    uint8_t *spare;
+    size_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t frames;
+    uint64_t overruns;
+    uint64_t errors;
+    int waiting;
+    int wake_fd;
+    int stop_fd;
+    pthread_t thread;
+    int running;
+};
+
+extern int spi_acq_start(struct spi_acq *acq, int fd, int drdy_fd, struct spi_bus *bus, spi_config_t config,
+                         const uint8_t *tx, size_t frame_len, size_t capacity);
+extern void spi_acq_cancel(struct spi_acq *acq);
+extern void spi_acq_stop(struct spi_acq *acq);
+extern size_t spi_acq_queued(struct spi_acq *acq);
+extern size_t spi_acq_read(struct spi_acq *acq, uint8_t *out, size_t max_frames);
+extern int spi_acq_wait(struct spi_acq *acq, int timeout_ms);
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_acquisition.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include "spi_acquisition.h"
+#include "spi_device.h"
+#include "spi_acq.h"
+#include "spi_gpio.h"
+#include "../event_gpio.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct {
+    PyObject_HEAD
+    struct spi_acq acq;
+    unsigned int drdy;
+    int started;
+    PyThread_type_lock lock;
+} SPIAcquisitionObject;
+
+static PyObject *SPIAcquisition_new(PyTypeObject *type, PyObject *args, PyObject *kwargs){
+
+    SPIAcquisitionObject *self;
+
+    if((self = (SPIAcquisitionObject *)type->tp_alloc(type, 0)) == NULL){
+        return NULL;
+    }
+    if((self->lock = PyThread_allocate_lock()) == NULL){
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+/**
+ * Stop the engine and give the DRDY gpio back
+ */
+static void stop(SPIAcquisitionObject *self){
+
+    if(!self->started){
+        return;
+    }
+    /* cleared while the GIL is held, so SPIAcquisition_stop() cannot cancel
+     * an engine whose descriptors are being closed */
+    self->started = 0;
+    Py_BEGIN_ALLOW_THREADS
+    spi_acq_stop(&self->acq);
+    Py_END_ALLOW_THREADS
+    gpio_api->edge_source_close(self->drdy);
+    gpio_api->release(self->drdy, GPIO_OWNER_SPI);
+}
+
+/**
+ * Acquisition(device, drdy, frame, edge=FALLING, capacity=1024)
+ */
+static int SPIAcquisition_init(SPIAcquisitionObject *self, PyObject *args, PyObject *kwargs){
+
+    SPIDeviceObject *device;
+    PyObject *frame;
+    Py_buffer view;
+    unsigned int drdy;
+    int edge = FALLING_EDGE, fd, drdy_fd, soft_cs, ret;
+    Py_ssize_t capacity = 1024, frame_len, size;
+    spi_config_t config;
+    struct spi_bus *bus;
+
+    static char *kwlist [] = {
+        "device", "drdy", "frame", "edge", "capacity", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!IO|in", kwlist,
+        &SPIDeviceType, &device, &drdy, &frame, &edge, &capacity)){
+        return -1;
+    }
+    if(self->started){
+        PyErr_SetString(PyExc_RuntimeError, "acquisition already running");
+        return -1;
+    }
+    if(edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE){
+        PyErr_SetString(PyExc_ValueError, "edge must be RISING, FALLING or BOTH");
+        return -1;
+    }
+    if(drdy >= EVENT_GPIO_MAX){
+        PyErr_SetString(PyExc_ValueError, "invalid DRDY gpio");
+        return -1;
+    }
+    if(capacity < 1 || capacity > (1 << 24)){
+        PyErr_SetString(PyExc_ValueError, "capacity must be between 1 and 16777216 frames");
+        return -1;
+    }
+    for(size = 2; size < capacity; size <<= 1)
+        ;
+
+    /* Frame - the bytes to send, or just a length to clock zeros */
+    view.obj = NULL;
+    view.buf = NULL;
+    if(PyLong_Check(frame)
+#if PY_MAJOR_VERSION < 3
+        || PyInt_Check(frame)
+#endif
+        ){
+        if((frame_len = PyNumber_AsSsize_t(frame, PyExc_OverflowError)) == -1 && PyErr_Occurred()){
+            return -1;
+        }
+    }else{
+        if(PyObject_GetBuffer(frame, &view, PyBUF_SIMPLE) < 0){
+            return -1;
+        }
+        frame_len = view.len;
+    }
+    if(frame_len < 1 || (size_t)frame_len > spi_bufsiz()){
+        PyErr_Format(PyExc_ValueError, "frame must be between 1 and %lu bytes", (unsigned long)spi_bufsiz());
+        goto fail;
+    }
+
+    /* The engine gets its own descriptor, so closing the device does not
+     * pull it from under the thread */
+    spi_device_lock(device);
+    soft_cs = device->cs_gpio >= 0;
+    fd = device->fd >= 0 && !soft_cs ? dup(device->fd) : -1;
+    config = device->config;
+    bus = spi_bus_get(device->bus);
+    spi_device_unlock(device);
+    if(soft_cs){
+        PyErr_SetString(PyExc_ValueError, "acquisition needs a device whose spidev node selects the chip");
+        goto fail;
+    }
+    if(fd < 0){
+        if(device->fd < 0){
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+        }else{
+            PyErr_SetFromErrno(PyExc_IOError);
+        }
+        goto fail;
+    }
+
+    if(spi_gpio_import() < 0){
+        close(fd);
+        goto fail;
+    }
+    if(gpio_api->claim(drdy, GPIO_OWNER_SPI)){
+        close(fd);
+        PyErr_Format(PyExc_ValueError, "gpio %u is in use by the GPIO module", drdy);
+        goto fail;
+    }
+    if((drdy_fd = gpio_api->edge_source_open(drdy, edge)) < 0){
+        close(fd);
+        gpio_api->release(drdy, GPIO_OWNER_SPI);
+        PyErr_Format(PyExc_RuntimeError, "could not set up edge detection on gpio %u", drdy);
+        goto fail;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = spi_acq_start(&self->acq, fd, drdy_fd, bus, config, (const uint8_t *)view.buf, frame_len, size);
+    Py_END_ALLOW_THREADS
+    if(ret < 0){
+        PyErr_SetFromErrno(PyExc_IOError);
+        gpio_api->edge_source_close(drdy);
+        gpio_api->release(drdy, GPIO_OWNER_SPI);
+        goto fail;
+    }
+    self->drdy = drdy;
+    self->started = 1;
+
+    if(view.obj != NULL){
+        PyBuffer_Release(&view);
+    }
+    return 0;
+
+fail:
+    if(view.obj != NULL){
+        PyBuffer_Release(&view);
+    }
+    return -1;
+}
+
+static void SPIAcquisition_dealloc(SPIAcquisitionObject *self){
+
+    stop(self);
+    if(self->lock != NULL){
+        PyThread_free_lock(self->lock);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/**
+ * Take the frames acquired so far
+ *
+ * @param self
+ * @param args largest number of frames to take, -1 for all, and how long
+ * to wait for the first one in seconds, None for ever
+ * @return bytes holding whole frames back to back
+ */
+static PyObject *SPIAcquisition_read(SPIAcquisitionObject *self, PyObject *args, PyObject *kwargs){
+
+    PyObject *result, *timeout_obj = NULL;
+    Py_ssize_t max_frames = -1;
+    size_t count;
+    double timeout = 0.0;
+    int timeout_ms, ret = 1;
+
+    static char *kwlist [] = {
+        "max_frames", "timeout", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|nO", kwlist, &max_frames, &timeout_obj)){
+        return NULL;
+    }
+    if(timeout_obj == Py_None){
+        timeout_ms = -1;
+    }else{
+        if(timeout_obj != NULL && (timeout = PyFloat_AsDouble(timeout_obj)) == -1.0 && PyErr_Occurred()){
+            return NULL;
+        }
+        timeout_ms = timeout > 0.0 ? (int)(timeout * 1000.0 + 0.5) : 0;
+    }
+
+    if(!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)){
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    if(!self->started){
+        PyThread_release_lock(self->lock);
+        PyErr_SetString(PyExc_ValueError, "acquisition stopped");
+        return NULL;
+    }
+    if(timeout_ms != 0){
+        Py_BEGIN_ALLOW_THREADS
+        ret = spi_acq_wait(&self->acq, timeout_ms);
+        Py_END_ALLOW_THREADS
+    }
+    if(ret < 0){
+        /* stop() is waiting for the lock */
+        PyThread_release_lock(self->lock);
+        PyErr_SetString(PyExc_ValueError, "acquisition stopped");
+        return NULL;
+    }
+
+    count = spi_acq_queued(&self->acq);
+    if(max_frames >= 0 && count > (size_t)max_frames){
+        count = max_frames;
+    }
+    if((result = PyBytes_FromStringAndSize(NULL, count * self->acq.frame_len)) != NULL){
+        spi_acq_read(&self->acq, (uint8_t *)PyBytes_AS_STRING(result), count);
+    }
+    PyThread_release_lock(self->lock);
+
+    return result;
+}
+
+/**
+ * Engine counters
+ *
+ * @param self
+ * @param args reset - clear the counters after reading them
+ * @return dict with frames, overruns, errors and queued
+ */
+static PyObject *SPIAcquisition_stats(SPIAcquisitionObject *self, PyObject *args, PyObject *kwargs){
+
+    int reset = 0;
+    unsigned long long frames, overruns, errors;
+
+    static char *kwlist [] = {
+        "reset", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &reset)){
+        return NULL;
+    }
+    if(reset){
+        frames = __atomic_exchange_n(&self->acq.frames, 0, __ATOMIC_RELAXED);
+        overruns = __atomic_exchange_n(&self->acq.overruns, 0, __ATOMIC_RELAXED);
+        errors = __atomic_exchange_n(&self->acq.errors, 0, __ATOMIC_RELAXED);
+    }else{
+        frames = __atomic_load_n(&self->acq.frames, __ATOMIC_RELAXED);
+        overruns = __atomic_load_n(&self->acq.overruns, __ATOMIC_RELAXED);
+        errors = __atomic_load_n(&self->acq.errors, __ATOMIC_RELAXED);
+    }
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:n}",
+        "frames", frames,
+        "overruns", overruns,
+        "errors", errors,
+        "queued", self->started ? (Py_ssize_t)spi_acq_queued(&self->acq) : 0);
+}
+
+/**
+ * Stop acquiring, frames not read are lost. A read() waiting for frames is
+ * woken first, as it holds the lock.
+ */
+static PyObject *SPIAcquisition_stop(SPIAcquisitionObject *self, PyObject *args){
+
+    if(self->started){
+        spi_acq_cancel(&self->acq);
+    }
+    if(!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)){
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    stop(self);
+    PyThread_release_lock(self->lock);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *SPIAcquisition_enter(SPIAcquisitionObject *self, PyObject *args){
+
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *SPIAcquisition_exit(SPIAcquisitionObject *self, PyObject *args){
+
+    return SPIAcquisition_stop(self, NULL);
+}
+
+static PyObject *SPIAcquisition_get_frame_size(SPIAcquisitionObject *self, void *closure){
+
+    return PyLong_FromSize_t(self->acq.frame_len);
+}
+
+static PyGetSetDef SPIAcquisition_getset[] = {
+    {"frame_size", (getter)SPIAcquisition_get_frame_size, NULL, "Bytes per frame", NULL},
+    {NULL}
+};
+
+static PyMethodDef SPIAcquisition_methods[] = {
+    {"read", (PyCFunction)SPIAcquisition_read, METH_VARARGS | METH_KEYWORDS, "Take up to max_frames acquired frames, waiting up to timeout seconds (None for ever) for the first, returned as bytes"},
+    {"stats", (PyCFunction)SPIAcquisition_stats, METH_VARARGS | METH_KEYWORDS, "Return frames, overruns, errors and queued frames, clearing the counters if reset is true"},
+    {"stop", (PyCFunction)SPIAcquisition_stop, METH_NOARGS, "Stop acquiring and release the DRDY gpio"},
+    {"__enter__", (PyCFunction)SPIAcquisition_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)SPIAcquisition_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject SPIAcquisitionType = {
+    PyVarObject_HEAD_INIT(NULL,0)
+    "RPi._SPI.Acquisition",         /* tp_name */
+    sizeof(SPIAcquisitionObject),   /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor)SPIAcquisition_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    "Data ready triggered acquisition - Acquisition(device, drdy, frame, edge=FALLING, capacity=1024) reads a frame from device on every edge of sysfs gpio drdy", /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    SPIAcquisition_methods,         /* tp_methods */
+    0,                              /* tp_members */
+    SPIAcquisition_getset,          /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    (initproc)SPIAcquisition_init,  /* tp_init */
+    0,                              /* tp_alloc */
+    SPIAcquisition_new,             /* tp_new */
+};
+
+PyTypeObject *SPIAcquisition_init_SPIAcquisitionType(void){
+
+    if(PyType_Ready(&SPIAcquisitionType) < 0){
+        return NULL;
+    }
+    return &SPIAcquisitionType;
+}
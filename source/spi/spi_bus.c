@@ -0,0 +1,72 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_bus.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "spi_bus.h"
+
+#define SPI_BUS_SPINS       200
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()         __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax()         __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax()         __asm__ __volatile__("" ::: "memory")
+#endif
+
+/* one per controller, plus one shared by nodes whose bus is not known */
+static struct spi_bus buses[SPI_BUSES + 1];
+
+struct spi_bus *spi_bus_get(int bus) {
+    return bus >= 0 && bus < SPI_BUSES ? &buses[bus] : &buses[SPI_BUSES];
+}
+
+void spi_bus_lock(struct spi_bus *bus) {
+    /* sequentially consistent against the unlock below, so either it sees
+     * this ticket and wakes, or the futex sees the new owner */
+    uint32_t ticket = __atomic_fetch_add(&bus->next, 1, __ATOMIC_SEQ_CST);
+    uint32_t owner;
+    int i;
+
+    for (i = 0; i < SPI_BUS_SPINS; i++) {
+        if (__atomic_load_n(&bus->owner, __ATOMIC_ACQUIRE) == ticket)
+            return;
+        cpu_relax();
+    }
+    while ((owner = __atomic_load_n(&bus->owner, __ATOMIC_ACQUIRE)) != ticket)
+        syscall(SYS_futex, &bus->owner, FUTEX_WAIT_PRIVATE, owner, NULL, NULL, 0);
+}
+
+void spi_bus_unlock(struct spi_bus *bus) {
+    uint32_t owner = __atomic_add_fetch(&bus->owner, 1, __ATOMIC_SEQ_CST);
+
+    /* a ticket taken after this load is already the owner */
+    if (__atomic_load_n(&bus->next, __ATOMIC_SEQ_CST) != owner)
+        syscall(SYS_futex, &bus->owner, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
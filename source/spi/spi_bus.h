@@ -0,0 +1,48 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_bus.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef _SPI_BUS_H
+#define _SPI_BUS_H
+
+#include <stdint.h>
+
+#define SPI_BUSES           2
+
+/*
+ * Serializes the users of one bus within the process, so that a chip
+ * select driven from a gpio stays the only one asserted while its transfers
+ * run. A ticket lock: taking a ticket is one atomic add and the bus is
+ * handed over in ticket order, so no waiter starves. Waiters spin briefly
+ * and then sleep on the owner word.
+ */
+struct spi_bus {
+    uint32_t next;
+    uint32_t owner;
+};
+
+extern struct spi_bus *spi_bus_get(int bus);
+extern void spi_bus_lock(struct spi_bus *bus);
+extern void spi_bus_unlock(struct spi_bus *bus);
+
+#endif
@@ -0,0 +1,1459 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_device.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include "spi_device.h"
+#include "spi_gpio.h"
+#include "../c_gpio.h"
+#include "../event_gpio.h"
+
+#if PY_MAJOR_VERSION >= 3
+    #define PyInt_FromLong PyLong_FromLong
+    #define PyInt_AsLong PyLong_AsLong
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <linux/spi/spidev.h>
+
+/**
+ * Take the device lock, letting other threads run while waiting for it
+ */
+void spi_device_lock(SPIDeviceObject *self){
+
+    if(!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)){
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+void spi_device_unlock(SPIDeviceObject *self){
+
+    PyThread_release_lock(self->lock);
+}
+
+/**
+ * Map the gpio registers for the lines this module drives and claim gpio
+ * for this module. The registers are the ones RPi._GPIO maps, so both
+ * modules share one mapping and one idea of who drives which pin.
+ *
+ * @return 0, or -1 with an exception set
+ */
+int spi_claim_gpio(unsigned int gpio){
+
+    if(spi_gpio_import() < 0 || gpio_api->map() < 0){
+        return -1;
+    }
+    if(gpio_api->claim(gpio, GPIO_OWNER_SPI)){
+        PyErr_Format(PyExc_ValueError, "gpio %u is in use by the GPIO module", gpio);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Drive a gpio chip select to its idle level, call with the lock held
+ */
+static void cs_release(SPIDeviceObject *self){
+
+    if(self->cs_gpio >= 0){
+        gpio_api->output_gpio(self->cs_gpio, !(self->config.mode & SPI_CS_HIGH));
+    }
+}
+
+/**
+ * Check that the device is open, call with the lock held
+ *
+ * @return 0, or -1 with an exception set
+ */
+static int check_open(SPIDeviceObject *self){
+
+    if(self->fd < 0){
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Make the scratch buffer at least size bytes, call with the lock held
+ *
+ * @return 0, or -1 with an exception set
+ */
+static int grow_scratch(SPIDeviceObject *self, size_t size){
+
+    uint8_t *grown;
+
+    if(size > self->scratch_size){
+        if((grown = (uint8_t *)realloc(self->scratch, size)) == NULL){
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->scratch = grown;
+        self->scratch_size = size;
+    }
+    return 0;
+}
+
+/**
+ * Get the bytes to send from a list of integers or any object supporting
+ * the buffer protocol (bytes, bytearray, memoryview, array, NumPy, ...).
+ * Lists are converted into the device scratch buffer, so call with the lock
+ * held and keep it until the transfer is done.
+ *
+ * @param self device
+ * @param obj data to send
+ * @param view filled in for buffer objects, release with release_tx()
+ * @param data set to the bytes to send
+ * @param len set to the number of bytes
+ * @return 0, or -1 with an exception set
+ */
+static int get_tx(SPIDeviceObject *self, PyObject *obj, Py_buffer *view, const uint8_t **data, Py_ssize_t *len){
+
+    Py_ssize_t i;
+    long value;
+
+    view->obj = NULL;
+    if(!PyList_Check(obj)){
+        if(PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) < 0){
+            return -1;
+        }
+        *data = (const uint8_t *)view->buf;
+        *len = view->len;
+        return 0;
+    }
+
+    *len = PyList_GET_SIZE(obj);
+    if(grow_scratch(self, *len) < 0){
+        return -1;
+    }
+    for(i = 0; i < *len; i++){
+        value = PyInt_AsLong(PyList_GET_ITEM(obj, i));
+        if(value == -1 && PyErr_Occurred()){
+            return -1;
+        }
+        self->scratch[i] = (uint8_t)value;
+#ifdef __DEBUG
+        printf("tx[%ld]=%02X\n", (long)i, self->scratch[i]);
+#endif
+    }
+    *data = self->scratch;
+    return 0;
+}
+
+static void release_tx(Py_buffer *view){
+
+    if(view->obj != NULL){
+        PyBuffer_Release(view);
+    }
+}
+
+/**
+ * Run the segments on the controller registers when they fit, through
+ * spidev otherwise
+ */
+static int run(SPIDeviceObject *self, const spi_segment_t *segments, size_t count){
+
+    if(self->direct != NULL && sunxi_spi_fits(&self->config, segments, count)){
+        return sunxi_spi_transfer(self->direct, self->cs, &self->config, segments, count) < 0 ? errno : 0;
+    }
+    return spi_transfer(self->fd, &self->config, segments, count) < 0 ? errno : 0;
+}
+
+/**
+ * Run the segments with the bus to ourselves. A gpio chip select is
+ * asserted around each run of segments up to one with cs_change. Call with
+ * the lock held, the GIL is not needed.
+ *
+ * @return 0, or errno of the failed transfer
+ */
+int spi_device_transfer(SPIDeviceObject *self, const spi_segment_t *segments, size_t count){
+
+    struct spi_bus *bus = spi_bus_get(self->bus);
+    int active = (self->config.mode & SPI_CS_HIGH) != 0, ret = 0;
+    size_t start = 0, end;
+
+    spi_bus_lock(bus);
+    if(self->cs_gpio < 0){
+        ret = run(self, segments, count);
+    }else{
+        while(start < count && ret == 0){
+            end = start;
+            while(end < count && !segments[end++].cs_change)
+                ;
+            gpio_api->output_gpio(self->cs_gpio, active);
+            ret = run(self, segments + start, end - start);
+            gpio_api->output_gpio(self->cs_gpio, !active);
+            start = end;
+        }
+    }
+    spi_bus_unlock(bus);
+    return ret;
+}
+
+/**
+ * Run the segments with the GIL released, call with the lock held
+ *
+ * @return 0, or errno of the failed transfer
+ */
+static int transfer(SPIDeviceObject *self, const spi_segment_t *segments, size_t count){
+
+    int ret;
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = spi_device_transfer(self, segments, count);
+    Py_END_ALLOW_THREADS
+    return ret;
+}
+
+/**
+ * Full duplex transfer of max(tx_len, rx_len) bytes, padding the output with
+ * zeros and discarding input past rx_len. Zero bits_per_word keeps the
+ * device setting.
+ */
+static int duplex(SPIDeviceObject *self, const uint8_t *tx, Py_ssize_t tx_len, uint8_t *rx, Py_ssize_t rx_len,
+                  uint8_t bits_per_word){
+
+    spi_segment_t segments[2];
+    Py_ssize_t common = tx_len < rx_len ? tx_len : rx_len;
+
+    memset(segments, 0, sizeof(segments));
+    segments[0].bits_per_word = segments[1].bits_per_word = bits_per_word;
+    segments[0].tx = tx;
+    segments[0].rx = rx;
+    segments[0].len = common;
+    segments[1].tx = tx_len > common ? tx + common : NULL;
+    segments[1].rx = rx_len > common ? rx + common : NULL;
+    segments[1].len = (tx_len > rx_len ? tx_len : rx_len) - common;
+    return transfer(self, segments, 2);
+}
+
+static PyObject *io_error(int err){
+
+    errno = err;
+    return PyErr_SetFromErrno(PyExc_IOError);
+}
+
+/**
+ * Check and store the device settings
+ *
+ * @return 0, or -1 with an exception set
+ */
+int spi_device_config(spi_config_t *config, int mode, int bits, long speed, int delay){
+
+    if(mode < 0 || mode > 0xff){
+        PyErr_SetString(PyExc_ValueError, "invalid mode");
+        return -1;
+    }
+    if(bits < 1 || bits > 32){
+        PyErr_SetString(PyExc_ValueError, "bits per word must be between 1 and 32");
+        return -1;
+    }
+    if(speed < 1 || speed > 0xffffffffL){
+        PyErr_SetString(PyExc_ValueError, "invalid speed");
+        return -1;
+    }
+    if(delay < 0 || delay > 0xffff){
+        PyErr_SetString(PyExc_ValueError, "delay must be between 0 and 65535 us");
+        return -1;
+    }
+    config->mode = mode;
+    config->bits_per_word = bits;
+    config->speed = speed;
+    config->delay = delay;
+    return 0;
+}
+
+/**
+ * Switch direct register access on or off, call with the lock held
+ *
+ * @return 0, or -1 with an exception set
+ */
+static int set_direct(SPIDeviceObject *self, int enable){
+
+    if(!enable){
+        if(self->direct != NULL){
+            sunxi_spi_close(self->direct);
+            self->direct = NULL;
+        }
+        return 0;
+    }
+    if(self->direct != NULL){
+        return 0;
+    }
+    if(self->bus < 0){
+        PyErr_SetString(PyExc_ValueError, "direct access needs a device opened as /dev/spidevB.C");
+        return -1;
+    }
+    if(spi_gpio_import() < 0){
+        return -1;
+    }
+    if((self->direct = sunxi_spi_open(self->bus, gpio_api->devmem_path())) == NULL){
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Open the spidev node, closing whatever the device had open before
+ *
+ * @return 0, or -1 with an exception set
+ */
+int spi_device_open(SPIDeviceObject *self, const char *path, spi_config_t config){
+
+    unsigned int bus, cs;
+    char end;
+    int fd, err = 0;
+
+    spi_device_lock(self);
+    set_direct(self, 0);
+    self->bus = self->cs = -1;
+    Py_BEGIN_ALLOW_THREADS
+    if(self->fd >= 0){
+        spi_close(self->fd);
+        self->fd = -1;
+    }
+    if((fd = spi_open((char *)path, config)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    if(fd >= 0){
+        self->fd = fd;
+        self->config = config;
+        if(sscanf(path, "/dev/spidev%u.%u%c", &bus, &cs, &end) == 2 && bus < SUNXI_SPI_BUSES && cs < 4){
+            self->bus = bus;
+            self->cs = cs;
+        }
+    }
+    spi_device_unlock(self);
+
+    if(err){
+        errno = err;
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)path);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *SPIDevice_new(PyTypeObject *type, PyObject *args, PyObject *kwargs){
+
+    SPIDeviceObject *self;
+
+    if((self = (SPIDeviceObject *)type->tp_alloc(type, 0)) == NULL){
+        return NULL;
+    }
+    self->fd = -1;
+    self->bus = self->cs = -1;
+    self->cs_gpio = -1;
+    if((self->lock = PyThread_allocate_lock()) == NULL){
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+/**
+ * Device(path, mode=0, speed=100000, bits=8, delay=0, direct=False, cs_gpio=None)
+ */
+static int SPIDevice_init(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    char *path;
+    int mode = 0, bits = 8, delay = 0, direct = 0, ret;
+    long speed = 100000, cs_gpio = -1;
+    PyObject *cs_obj = Py_None;
+    spi_config_t config;
+
+    static char *kwlist [] = {
+        "path", "mode", "speed", "bits", "delay", "direct", "cs_gpio", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iliiiO", kwlist,
+        &path, &mode, &speed, &bits, &delay, &direct, &cs_obj)){
+        return -1;
+    }
+    if(spi_device_config(&config, mode, bits, speed, delay) < 0){
+        return -1;
+    }
+    if(cs_obj != Py_None){
+        if((cs_gpio = PyInt_AsLong(cs_obj)) == -1 && PyErr_Occurred()){
+            return -1;
+        }
+        if(cs_gpio < 0 || cs_gpio >= EVENT_GPIO_MAX){
+            PyErr_SetString(PyExc_ValueError, "invalid chip select gpio");
+            return -1;
+        }
+        if(spi_claim_gpio(cs_gpio) < 0){
+            return -1;
+        }
+    }
+    if(spi_device_open(self, path, config) < 0){
+        if(cs_gpio >= 0){
+            gpio_api->release(cs_gpio, GPIO_OWNER_SPI);
+        }
+        return -1;
+    }
+    spi_device_lock(self);
+    if(self->cs_gpio >= 0){
+        gpio_api->release(self->cs_gpio, GPIO_OWNER_SPI);
+    }
+    self->cs_gpio = cs_gpio;
+    if(cs_gpio >= 0){
+        cs_release(self);
+        gpio_api->setup_gpio(cs_gpio, OUTPUT, PUD_OFF);
+    }
+    ret = set_direct(self, direct);
+    spi_device_unlock(self);
+    return ret;
+}
+
+static void SPIDevice_dealloc(SPIDeviceObject *self){
+
+    if(self->fd >= 0){
+        spi_close(self->fd);
+    }
+    set_direct(self, 0);
+    if(self->cs_gpio >= 0){
+        gpio_api->release(self->cs_gpio, GPIO_OWNER_SPI);
+    }
+    if(self->lock != NULL){
+        PyThread_free_lock(self->lock);
+    }
+    free(self->scratch);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/**
+ * Close the device, further transfers fail until it is opened again
+ *
+ * @param self
+ * @param args
+ * @return none
+ */
+PyObject *SPIDevice_close(SPIDeviceObject *self, PyObject *args){
+
+    int ret = 0;
+
+    spi_device_lock(self);
+    set_direct(self, 0);
+    if(self->fd >= 0){
+        ret = spi_close(self->fd);
+        self->fd = -1;
+    }
+    spi_device_unlock(self);
+    if(ret < 0){
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Read n bytes from slave device
+ *
+ * @param self
+ * @param args number of bytes
+ * @return bytes read
+ */
+PyObject *SPIDevice_read(SPIDeviceObject *self, PyObject *args){
+
+    PyObject *rx;
+    Py_ssize_t rx_len = 0;
+    spi_segment_t segment;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "n", &rx_len)){
+        return NULL;
+    }
+    if(rx_len < 0){
+        PyErr_SetString(PyExc_ValueError, "length must not be negative");
+        return NULL;
+    }
+
+    /* Read straight into the result */
+    if((rx = PyBytes_FromStringAndSize(NULL, rx_len)) == NULL){
+        return NULL;
+    }
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = NULL;
+    segment.rx = (uint8_t *)PyBytes_AS_STRING(rx);
+    segment.len = rx_len;
+
+    spi_device_lock(self);
+    if(check_open(self) < 0){
+        spi_device_unlock(self);
+        Py_DECREF(rx);
+        return NULL;
+    }
+    err = transfer(self, &segment, 1);
+    spi_device_unlock(self);
+    if(err){
+        Py_DECREF(rx);
+        return io_error(err);
+    }
+
+    return rx;
+}
+
+/**
+ * Read from slave device into a buffer, filling it
+ *
+ * @param self
+ * @param args writable buffer
+ * @return number of bytes read
+ */
+PyObject *SPIDevice_readinto(SPIDeviceObject *self, PyObject *args){
+
+    Py_buffer view;
+    spi_segment_t segment;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "w*", &view)){
+        return NULL;
+    }
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = NULL;
+    segment.rx = (uint8_t *)view.buf;
+    segment.len = view.len;
+
+    spi_device_lock(self);
+    if(check_open(self) < 0){
+        spi_device_unlock(self);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    err = transfer(self, &segment, 1);
+    spi_device_unlock(self);
+    PyBuffer_Release(&view);
+    if(err){
+        return io_error(err);
+    }
+
+    return PyInt_FromLong((long)view.len);
+}
+
+/**
+ * Write bytes to slave device
+ *
+ * @param self
+ * @param args data to write - bytes-like object or list of integers
+ * @return none
+ */
+PyObject *SPIDevice_write(SPIDeviceObject *self, PyObject *args){
+
+    PyObject *tx_obj;
+    Py_buffer view;
+    spi_segment_t segment;
+    const uint8_t *tx;
+    Py_ssize_t tx_len;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "O", &tx_obj)){
+        return NULL;
+    }
+
+    spi_device_lock(self);
+    if(check_open(self) < 0 || get_tx(self, tx_obj, &view, &tx, &tx_len) < 0){
+        spi_device_unlock(self);
+        return NULL;
+    }
+
+    /* Send data - split into bufsiz messages by spi_transfer() */
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = tx;
+    segment.rx = NULL;
+    segment.len = tx_len;
+    err = transfer(self, &segment, 1);
+    spi_device_unlock(self);
+    release_tx(&view);
+    if(err){
+        return io_error(err);
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Do transfer of data to slave device
+ *
+ * @param self
+ * @param args data to send and number of bytes to read
+ * @return bytes read
+ */
+PyObject *SPIDevice_xfer(SPIDeviceObject *self, PyObject *args){
+
+    PyObject *tx_obj, *rx;
+    Py_buffer view;
+    const uint8_t *tx;
+    Py_ssize_t tx_len = 0;
+    Py_ssize_t rx_len = 0;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "On", &tx_obj, &rx_len)){
+        return NULL;
+    }
+    if(rx_len < 0){
+        PyErr_SetString(PyExc_ValueError, "length must not be negative");
+        return NULL;
+    }
+    if((rx = PyBytes_FromStringAndSize(NULL, rx_len)) == NULL){
+        return NULL;
+    }
+
+    spi_device_lock(self);
+    if(check_open(self) < 0 || get_tx(self, tx_obj, &view, &tx, &tx_len) < 0){
+        spi_device_unlock(self);
+        Py_DECREF(rx);
+        return NULL;
+    }
+
+    /* Do the transaction */
+    err = duplex(self, tx, tx_len, (uint8_t *)PyBytes_AS_STRING(rx), rx_len, 0);
+    spi_device_unlock(self);
+    release_tx(&view);
+    if(err){
+        Py_DECREF(rx);
+        return io_error(err);
+    }
+
+    return rx;
+}
+
+/**
+ * Do transfer of data to slave device, reading into a buffer
+ *
+ * @param self
+ * @param args data to send and writable buffer to fill
+ * @return number of bytes read
+ */
+PyObject *SPIDevice_xfer_into(SPIDeviceObject *self, PyObject *args){
+
+    PyObject *tx_obj;
+    Py_buffer tx_view, rx_view;
+    const uint8_t *tx;
+    Py_ssize_t tx_len;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "Ow*", &tx_obj, &rx_view)){
+        return NULL;
+    }
+
+    spi_device_lock(self);
+    if(check_open(self) < 0 || get_tx(self, tx_obj, &tx_view, &tx, &tx_len) < 0){
+        spi_device_unlock(self);
+        PyBuffer_Release(&rx_view);
+        return NULL;
+    }
+
+    err = duplex(self, tx, tx_len, (uint8_t *)rx_view.buf, rx_view.len, 0);
+    spi_device_unlock(self);
+    release_tx(&tx_view);
+    PyBuffer_Release(&rx_view);
+    if(err){
+        return io_error(err);
+    }
+
+    return PyInt_FromLong((long)rx_view.len);
+}
+
+/* Layout of the words of a typed transfer: bytes per word, the spi_pack()
+ * flags taking them to and from the wire and the array typecode */
+typedef struct {
+    unsigned int width;
+    unsigned int flags;
+    const char *typecode;
+} word_format_t;
+
+/**
+ * Check the word arguments of a typed transfer
+ *
+ * @param width bits per word, 8, 16 or 32
+ * @param byteorder order of the bytes of a word on the wire, "big" or "little"
+ * @param lsb_first send the bits of each byte least significant first
+ * @param format filled in
+ * @return 0, or -1 with an exception set
+ */
+static int word_format(int width, const char *byteorder, int lsb_first, word_format_t *format){
+
+    int big;
+
+    if(width != 8 && width != 16 && width != 32){
+        PyErr_SetString(PyExc_ValueError, "width must be 8, 16 or 32");
+        return -1;
+    }
+    if(strcmp(byteorder, "big") == 0){
+        big = 1;
+    }else if(strcmp(byteorder, "little") == 0){
+        big = 0;
+    }else{
+        PyErr_SetString(PyExc_ValueError, "byteorder must be 'big' or 'little'");
+        return -1;
+    }
+    format->width = width / 8;
+    format->typecode = width == 8 ? "B" : width == 16 ? "H" : "I";
+    format->flags = lsb_first ? SPI_PACK_REVERSE : 0;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if(!big){
+#else
+    if(big){
+#endif
+        format->flags |= SPI_PACK_SWAP;
+    }
+    return 0;
+}
+
+/**
+ * Get a buffer of words, whose items must be as wide as the words
+ *
+ * @return 0, or -1 with an exception set
+ */
+static int get_words(PyObject *obj, Py_buffer *view, int flags, const word_format_t *format){
+
+    if(PyObject_GetBuffer(obj, view, flags) < 0){
+        return -1;
+    }
+    if(view->itemsize != (Py_ssize_t)format->width){
+        PyErr_Format(PyExc_ValueError, "expected %d byte items, got %d byte items",
+                     (int)format->width, (int)view->itemsize);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Get the bytes to send from a list of integers or a buffer of words, packed
+ * into the scratch buffer unless the words are already in wire order. Call
+ * with the lock held and keep it until the transfer is done.
+ *
+ * @param self device
+ * @param obj words to send
+ * @param format word layout
+ * @param view filled in for buffer objects, release with release_tx()
+ * @param data set to the bytes to send
+ * @param len set to the number of bytes
+ * @return 0, or -1 with an exception set
+ */
+static int get_tx_words(SPIDeviceObject *self, PyObject *obj, const word_format_t *format, Py_buffer *view,
+                        const uint8_t **data, Py_ssize_t *len){
+
+    Py_ssize_t count, i;
+    unsigned long value;
+
+    view->obj = NULL;
+    if(!PyList_Check(obj)){
+        if(get_words(obj, view, PyBUF_SIMPLE, format) < 0){
+            return -1;
+        }
+        *data = (const uint8_t *)view->buf;
+        *len = view->len;
+        if(format->flags){
+            if(grow_scratch(self, *len) < 0){
+                release_tx(view);
+                return -1;
+            }
+            spi_pack(self->scratch, *data, *len / format->width, format->width, format->flags);
+            *data = self->scratch;
+        }
+        return 0;
+    }
+
+    count = PyList_GET_SIZE(obj);
+    *len = count * format->width;
+    if(grow_scratch(self, *len) < 0){
+        return -1;
+    }
+    for(i = 0; i < count; i++){
+        value = PyLong_AsUnsignedLongMask(PyList_GET_ITEM(obj, i));
+        if(value == (unsigned long)-1 && PyErr_Occurred()){
+            return -1;
+        }
+        switch(format->width){
+        case 1:
+            self->scratch[i] = (uint8_t)value;
+            break;
+        case 2:
+            ((uint16_t *)self->scratch)[i] = (uint16_t)value;
+            break;
+        default:
+            ((uint32_t *)self->scratch)[i] = (uint32_t)value;
+            break;
+        }
+    }
+    spi_pack(self->scratch, self->scratch, count, format->width, format->flags);
+    *data = self->scratch;
+    return 0;
+}
+
+/**
+ * Send words while reading rx_count words into rx, which are unpacked in
+ * place once the transfer is done
+ *
+ * @param self device
+ * @param tx_obj words to send, or NULL to send zeros
+ * @param format word layout
+ * @param rx buffer for the words read
+ * @param rx_count number of words to read
+ * @return 0, or -1 with an exception set
+ */
+static int words_duplex(SPIDeviceObject *self, PyObject *tx_obj, const word_format_t *format,
+                        uint8_t *rx, Py_ssize_t rx_count){
+
+    Py_buffer view;
+    const uint8_t *tx = NULL;
+    Py_ssize_t tx_len = 0;
+    int err;
+
+    view.obj = NULL;
+    spi_device_lock(self);
+    if(check_open(self) < 0 || (tx_obj != NULL && get_tx_words(self, tx_obj, format, &view, &tx, &tx_len) < 0)){
+        spi_device_unlock(self);
+        return -1;
+    }
+    /* the words are in wire order already, so they go out a byte at a time
+     * whatever the bits per word of the device */
+    err = duplex(self, tx, tx_len, rx, rx_count * format->width, 8);
+    spi_device_unlock(self);
+    release_tx(&view);
+    if(err){
+        io_error(err);
+        return -1;
+    }
+    spi_pack(rx, rx, rx_count, format->width, format->flags);
+    return 0;
+}
+
+/**
+ * New array.array of count zero words
+ */
+static PyObject *new_words(const word_format_t *format, Py_ssize_t count){
+
+    static PyObject *array_type = NULL;
+    PyObject *module, *one, *words;
+
+    if(array_type == NULL){
+        if((module = PyImport_ImportModule("array")) == NULL){
+            return NULL;
+        }
+        array_type = PyObject_GetAttrString(module, "array");
+        Py_DECREF(module);
+        if(array_type == NULL){
+            return NULL;
+        }
+    }
+    if((one = PyObject_CallFunction(array_type, "s(i)", format->typecode, 0)) == NULL){
+        return NULL;
+    }
+    words = PySequence_Repeat(one, count);
+    Py_DECREF(one);
+    return words;
+}
+
+/**
+ * Read words into a new array
+ */
+static PyObject *read_words(SPIDeviceObject *self, PyObject *tx_obj, const word_format_t *format, Py_ssize_t count){
+
+    PyObject *words;
+    Py_buffer view;
+    int ret;
+
+    if(count < 0){
+        PyErr_SetString(PyExc_ValueError, "count must not be negative");
+        return NULL;
+    }
+    if((words = new_words(format, count)) == NULL){
+        return NULL;
+    }
+    if(PyObject_GetBuffer(words, &view, PyBUF_WRITABLE) < 0){
+        Py_DECREF(words);
+        return NULL;
+    }
+    ret = words_duplex(self, tx_obj, format, (uint8_t *)view.buf, count);
+    PyBuffer_Release(&view);
+    if(ret < 0){
+        Py_DECREF(words);
+        return NULL;
+    }
+    return words;
+}
+
+/**
+ * Read words into a writable buffer, filling it
+ */
+static PyObject *read_words_into(SPIDeviceObject *self, PyObject *tx_obj, const word_format_t *format, PyObject *rx_obj){
+
+    Py_buffer view;
+    Py_ssize_t count;
+    int ret;
+
+    if(get_words(rx_obj, &view, PyBUF_WRITABLE, format) < 0){
+        return NULL;
+    }
+    count = view.len / format->width;
+    ret = words_duplex(self, tx_obj, format, (uint8_t *)view.buf, count);
+    PyBuffer_Release(&view);
+    if(ret < 0){
+        return NULL;
+    }
+    return PyInt_FromLong((long)count);
+}
+
+/**
+ * Write words to slave device
+ *
+ * @param self
+ * @param args words to write - a buffer of width bit items (array, NumPy,
+ * ...) or list of integers, and the word layout
+ * @return none
+ */
+PyObject *SPIDevice_write_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    PyObject *tx_obj;
+    word_format_t format;
+    int width = 16, lsb_first = 0;
+    const char *byteorder = "big";
+
+    static char *kwlist [] = {
+        "data", "width", "byteorder", "lsb_first", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|isi", kwlist, &tx_obj, &width, &byteorder, &lsb_first)){
+        return NULL;
+    }
+    if(word_format(width, byteorder, lsb_first, &format) < 0 || words_duplex(self, tx_obj, &format, NULL, 0) < 0){
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Read words from slave device
+ *
+ * @param self
+ * @param args number of words to read and the word layout
+ * @return array of the words read
+ */
+PyObject *SPIDevice_read_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    Py_ssize_t count;
+    word_format_t format;
+    int width = 16, lsb_first = 0;
+    const char *byteorder = "big";
+
+    static char *kwlist [] = {
+        "count", "width", "byteorder", "lsb_first", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "n|isi", kwlist, &count, &width, &byteorder, &lsb_first)){
+        return NULL;
+    }
+    if(word_format(width, byteorder, lsb_first, &format) < 0){
+        return NULL;
+    }
+    return read_words(self, NULL, &format, count);
+}
+
+/**
+ * Read words from slave device into a buffer, filling it
+ *
+ * @param self
+ * @param args writable buffer of width bit items and the word layout
+ * @return number of words read
+ */
+PyObject *SPIDevice_readinto_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    PyObject *rx_obj;
+    word_format_t format;
+    int width = 16, lsb_first = 0;
+    const char *byteorder = "big";
+
+    static char *kwlist [] = {
+        "buffer", "width", "byteorder", "lsb_first", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|isi", kwlist, &rx_obj, &width, &byteorder, &lsb_first)){
+        return NULL;
+    }
+    if(word_format(width, byteorder, lsb_first, &format) < 0){
+        return NULL;
+    }
+    return read_words_into(self, NULL, &format, rx_obj);
+}
+
+/**
+ * Do transfer of words to slave device
+ *
+ * @param self
+ * @param args words to send, number of words to read and the word layout
+ * @return array of the words read
+ */
+PyObject *SPIDevice_xfer_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    PyObject *tx_obj;
+    Py_ssize_t count;
+    word_format_t format;
+    int width = 16, lsb_first = 0;
+    const char *byteorder = "big";
+
+    static char *kwlist [] = {
+        "data", "count", "width", "byteorder", "lsb_first", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "On|isi", kwlist, &tx_obj, &count, &width, &byteorder, &lsb_first)){
+        return NULL;
+    }
+    if(word_format(width, byteorder, lsb_first, &format) < 0){
+        return NULL;
+    }
+    return read_words(self, tx_obj, &format, count);
+}
+
+/**
+ * Do transfer of words to slave device, reading into a buffer
+ *
+ * @param self
+ * @param args words to send, writable buffer of width bit items and the
+ * word layout
+ * @return number of words read
+ */
+PyObject *SPIDevice_xfer_words_into(SPIDeviceObject *self, PyObject *args, PyObject *kwargs){
+
+    PyObject *tx_obj, *rx_obj;
+    word_format_t format;
+    int width = 16, lsb_first = 0;
+    const char *byteorder = "big";
+
+    static char *kwlist [] = {
+        "data", "buffer", "width", "byteorder", "lsb_first", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|isi", kwlist, &tx_obj, &rx_obj, &width, &byteorder, &lsb_first)){
+        return NULL;
+    }
+    if(word_format(width, byteorder, lsb_first, &format) < 0){
+        return NULL;
+    }
+    return read_words_into(self, tx_obj, &format, rx_obj);
+}
+
+/**
+ * Parse one transaction segment: a bytes-like object to send, a number of
+ * bytes to read, or a dict with the keys tx, rx, cs_change, delay_usecs,
+ * speed_hz and bits_per_word
+ *
+ * @param item segment
+ * @param view filled in with the data to send, release with release_tx()
+ * @param rx_len set to the number of bytes to read
+ * @param segment settings of the segment
+ * @return 0, or -1 with an exception set
+ */
+static int parse_segment(PyObject *item, Py_buffer *view, Py_ssize_t *rx_len, spi_segment_t *segment){
+
+    static const char *keys[] = {"cs_change", "delay_usecs", "speed_hz", "bits_per_word"};
+    static const long limits[] = {1, 0xffff, 0xffffffffL, 32};
+    PyObject *tx = NULL, *value, *bytes;
+    long setting;
+    int i, ret;
+
+    view->obj = NULL;
+    view->buf = NULL;
+    view->len = 0;
+    *rx_len = 0;
+    if(PyDict_Check(item)){
+        tx = PyDict_GetItemString(item, "tx");
+        if((value = PyDict_GetItemString(item, "rx")) != NULL){
+            if((*rx_len = PyNumber_AsSsize_t(value, PyExc_OverflowError)) == -1 && PyErr_Occurred()){
+                return -1;
+            }
+        }
+        for(i = 0; i < 4; i++){
+            if((value = PyDict_GetItemString(item, keys[i])) == NULL){
+                continue;
+            }
+            setting = i == 0 ? PyObject_IsTrue(value) : PyInt_AsLong(value);
+            if(setting == -1 && PyErr_Occurred()){
+                return -1;
+            }
+            if(setting < 0 || setting > limits[i]){
+                PyErr_Format(PyExc_ValueError, "%s out of range", keys[i]);
+                return -1;
+            }
+            switch(i){
+            case 0: segment->cs_change = setting; break;
+            case 1: segment->delay = setting; break;
+            case 2: segment->speed = setting; break;
+            default: segment->bits_per_word = setting; break;
+            }
+        }
+    }else if(PyLong_Check(item)
+#if PY_MAJOR_VERSION < 3
+        || PyInt_Check(item)
+#endif
+        ){
+        if((*rx_len = PyNumber_AsSsize_t(item, PyExc_OverflowError)) == -1 && PyErr_Occurred()){
+            return -1;
+        }
+    }else{
+        tx = item;
+    }
+    if(*rx_len < 0){
+        PyErr_SetString(PyExc_ValueError, "length must not be negative");
+        return -1;
+    }
+
+    if(tx == NULL || tx == Py_None){
+        return 0;
+    }
+    /* Lists of integers are copied, the view keeps the copy alive */
+    if(PyList_Check(tx)){
+        if((bytes = PyByteArray_FromObject(tx)) == NULL){
+            return -1;
+        }
+        ret = PyObject_GetBuffer(bytes, view, PyBUF_SIMPLE);
+        Py_DECREF(bytes);
+        return ret;
+    }
+    return PyObject_GetBuffer(tx, view, PyBUF_SIMPLE);
+}
+
+/**
+ * Run a transaction: the segments go out back to back in one
+ * SPI_IOC_MESSAGE, with chip select held between them unless a segment sets
+ * cs_change. Each segment clocks max(len(tx), rx) bytes.
+ *
+ * @param self
+ * @param args list of segments
+ * @return list with a memoryview of the bytes read for each segment, all
+ * slices of one buffer, or None for segments that read nothing
+ */
+PyObject *SPIDevice_transfer(SPIDeviceObject *self, PyObject *args){
+
+    PyObject *list, *seq = NULL, *rx = NULL, *rx_view = NULL, *result = NULL, *slice;
+    Py_buffer *views = NULL;
+    Py_ssize_t *rx_lens = NULL;
+    spi_segment_t *pieces = NULL, *settings = NULL;
+    Py_ssize_t count, i, parsed = 0, rx_total = 0, offset, tx_len, common;
+    uint8_t *rx_buf;
+    size_t n = 0;
+    int err;
+
+    if(!PyArg_ParseTuple(args, "O", &list)){
+        return NULL;
+    }
+    if((seq = PySequence_Fast(list, "segments must be a sequence")) == NULL){
+        return NULL;
+    }
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    /* Up to two pieces per segment, the part sending and reading and the
+     * part doing only one of them */
+    views = PyMem_New(Py_buffer, count);
+    rx_lens = PyMem_New(Py_ssize_t, count);
+    settings = PyMem_New(spi_segment_t, count);
+    pieces = PyMem_New(spi_segment_t, 2 * count);
+    if(views == NULL || rx_lens == NULL || settings == NULL || pieces == NULL){
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(settings, 0, count * sizeof(spi_segment_t));
+
+    for(parsed = 0; parsed < count; parsed++){
+        if(parse_segment(PySequence_Fast_GET_ITEM(seq, parsed), &views[parsed], &rx_lens[parsed], &settings[parsed]) < 0){
+            goto done;
+        }
+        rx_total += rx_lens[parsed];
+    }
+
+    /* One buffer for everything read, handed out as slices */
+    if((rx = PyByteArray_FromStringAndSize(NULL, rx_total)) == NULL){
+        goto done;
+    }
+    rx_buf = (uint8_t *)PyByteArray_AS_STRING(rx);
+    for(i = 0, offset = 0; i < count; i++){
+        tx_len = views[i].len;
+        common = tx_len < rx_lens[i] ? tx_len : rx_lens[i];
+
+        memset(&pieces[n], 0, sizeof(spi_segment_t));
+        pieces[n].tx = views[i].buf;
+        pieces[n].rx = rx_buf + offset;
+        pieces[n].len = common;
+        pieces[n].speed = settings[i].speed;
+        pieces[n].bits_per_word = settings[i].bits_per_word;
+        if(common > 0){
+            n++;
+        }
+        pieces[n] = settings[i];
+        pieces[n].tx = tx_len > common ? (const uint8_t *)views[i].buf + common : NULL;
+        pieces[n].rx = rx_lens[i] > common ? rx_buf + offset + common : NULL;
+        pieces[n].len = (tx_len > rx_lens[i] ? tx_len : rx_lens[i]) - common;
+        if(pieces[n].len > 0){
+            n++;
+        }else if(n > 0){
+            /* the segment ends with its first piece */
+            pieces[n-1].delay = settings[i].delay;
+            pieces[n-1].cs_change = settings[i].cs_change;
+        }
+        offset += rx_lens[i];
+    }
+
+    spi_device_lock(self);
+    if(check_open(self) < 0){
+        spi_device_unlock(self);
+        goto done;
+    }
+    err = transfer(self, pieces, n);
+    spi_device_unlock(self);
+    if(err){
+        io_error(err);
+        goto done;
+    }
+
+    if((rx_view = PyMemoryView_FromObject(rx)) == NULL || (result = PyList_New(count)) == NULL){
+        goto done;
+    }
+    for(i = 0, offset = 0; i < count; i++){
+        if(rx_lens[i] == 0){
+            Py_INCREF(Py_None);
+            PyList_SET_ITEM(result, i, Py_None);
+            continue;
+        }
+        if((slice = PySequence_GetSlice(rx_view, offset, offset + rx_lens[i])) == NULL){
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, i, slice);
+        offset += rx_lens[i];
+    }
+
+done:
+    for(i = 0; i < parsed; i++){
+        release_tx(&views[i]);
+    }
+    PyMem_Free(views);
+    PyMem_Free(rx_lens);
+    PyMem_Free(settings);
+    PyMem_Free(pieces);
+    Py_XDECREF(rx_view);
+    Py_XDECREF(rx);
+    Py_DECREF(seq);
+    return result;
+}
+
+static PyObject *SPIDevice_fileno(SPIDeviceObject *self, PyObject *args){
+
+    return PyInt_FromLong(self->fd);
+}
+
+static PyObject *SPIDevice_enter(SPIDeviceObject *self, PyObject *args){
+
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *SPIDevice_exit(SPIDeviceObject *self, PyObject *args){
+
+    return SPIDevice_close(self, NULL);
+}
+
+/*
+ * Settings. The mode belongs to the chip and is written to it right away,
+ * the others go with every transfer, so devices sharing a bus or a spidev
+ * node do not disturb each other.
+ */
+static PyObject *SPIDevice_get_mode(SPIDeviceObject *self, void *closure){
+
+    return PyInt_FromLong(self->config.mode);
+}
+
+static PyObject *SPIDevice_get_speed(SPIDeviceObject *self, void *closure){
+
+    return PyLong_FromUnsignedLong(self->config.speed);
+}
+
+static PyObject *SPIDevice_get_bits(SPIDeviceObject *self, void *closure){
+
+    return PyInt_FromLong(self->config.bits_per_word);
+}
+
+static PyObject *SPIDevice_get_delay(SPIDeviceObject *self, void *closure){
+
+    return PyInt_FromLong(self->config.delay);
+}
+
+static int SPIDevice_set(SPIDeviceObject *self, PyObject *value, void *closure){
+
+    spi_config_t config;
+    long v;
+    int ret = 0;
+
+    if(value == NULL){
+        PyErr_SetString(PyExc_AttributeError, "cannot delete SPI device settings");
+        return -1;
+    }
+    v = PyInt_AsLong(value);
+    if(v == -1 && PyErr_Occurred()){
+        return -1;
+    }
+
+    spi_device_lock(self);
+    config = self->config;
+    switch((intptr_t)closure){
+    case 0:
+        ret = spi_device_config(&config, (int)v, config.bits_per_word, config.speed, config.delay);
+        if(ret == 0 && self->fd >= 0 && config.mode != self->config.mode
+            && spi_set_mode(self->fd, config.mode) < 0){
+            PyErr_SetFromErrno(PyExc_IOError);
+            ret = -1;
+        }
+        break;
+    case 1:
+        ret = spi_device_config(&config, config.mode, config.bits_per_word, v, config.delay);
+        break;
+    case 2:
+        ret = spi_device_config(&config, config.mode, (int)v, config.speed, config.delay);
+        break;
+    default:
+        ret = spi_device_config(&config, config.mode, config.bits_per_word, config.speed, (int)v);
+        break;
+    }
+    if(ret == 0){
+        self->config = config;
+        cs_release(self);
+    }
+    spi_device_unlock(self);
+
+    return ret;
+}
+
+static PyObject *SPIDevice_get_direct(SPIDeviceObject *self, void *closure){
+
+    return PyBool_FromLong(self->direct != NULL);
+}
+
+static int SPIDevice_set_direct(SPIDeviceObject *self, PyObject *value, void *closure){
+
+    int enable, ret;
+
+    if(value == NULL || (enable = PyObject_IsTrue(value)) < 0){
+        if(value == NULL){
+            PyErr_SetString(PyExc_AttributeError, "cannot delete SPI device settings");
+        }
+        return -1;
+    }
+    spi_device_lock(self);
+    ret = enable && check_open(self) < 0 ? -1 : set_direct(self, enable);
+    spi_device_unlock(self);
+    return ret;
+}
+
+static PyObject *SPIDevice_get_cs_gpio(SPIDeviceObject *self, void *closure){
+
+    if(self->cs_gpio < 0){
+        Py_RETURN_NONE;
+    }
+    return PyInt_FromLong(self->cs_gpio);
+}
+
+static PyGetSetDef SPIDevice_getset[] = {
+    {"mode", (getter)SPIDevice_get_mode, (setter)SPIDevice_set, "SPI mode, CPOL and CPHA", (void *)0},
+    {"speed", (getter)SPIDevice_get_speed, (setter)SPIDevice_set, "Clock speed in Hz", (void *)1},
+    {"bits", (getter)SPIDevice_get_bits, (setter)SPIDevice_set, "Bits per word", (void *)2},
+    {"delay", (getter)SPIDevice_get_delay, (setter)SPIDevice_set, "Delay after each transfer in us", (void *)3},
+    {"cs_gpio", (getter)SPIDevice_get_cs_gpio, NULL, "Gpio driven as chip select, None when the spidev node selects the chip", NULL},
+    {"direct", (getter)SPIDevice_get_direct, (setter)SPIDevice_set_direct, "Run transfers that fit the FIFO on the controller registers instead of spidev", NULL},
+    {NULL}
+};
+
+static PyMethodDef SPIDevice_methods[] = {
+    {"xfer", (PyCFunction)SPIDevice_xfer, METH_VARARGS, "Transfer data - send a bytes-like object or list of integers while reading n bytes, returned as bytes"},
+    {"xfer_into", (PyCFunction)SPIDevice_xfer_into, METH_VARARGS, "Transfer data - send a bytes-like object or list of integers while reading into a writable buffer, returns the number of bytes read"},
+    {"write", (PyCFunction)SPIDevice_write, METH_VARARGS, "Write data - a bytes-like object or list of integers"},
+    {"read", (PyCFunction)SPIDevice_read, METH_VARARGS, "Read n bytes, returned as bytes"},
+    {"readinto", (PyCFunction)SPIDevice_readinto, METH_VARARGS, "Read into a writable buffer, filling it, returns the number of bytes read"},
+    {"write_words", (PyCFunction)SPIDevice_write_words, METH_VARARGS | METH_KEYWORDS, "Write words - a buffer of width bit items (array, NumPy, ...) or list of integers, sent in byteorder with each byte LSB first if lsb_first"},
+    {"read_words", (PyCFunction)SPIDevice_read_words, METH_VARARGS | METH_KEYWORDS, "Read count words of width bits, returned as an array"},
+    {"readinto_words", (PyCFunction)SPIDevice_readinto_words, METH_VARARGS | METH_KEYWORDS, "Read words into a writable buffer of width bit items, filling it, returns the number of words read"},
+    {"xfer_words", (PyCFunction)SPIDevice_xfer_words, METH_VARARGS | METH_KEYWORDS, "Transfer words - send a buffer of width bit items or list of integers while reading count words, returned as an array"},
+    {"xfer_words_into", (PyCFunction)SPIDevice_xfer_words_into, METH_VARARGS | METH_KEYWORDS, "Transfer words - send a buffer of width bit items or list of integers while reading into a writable buffer of width bit items, returns the number of words read"},
+    {"transfer", (PyCFunction)SPIDevice_transfer, METH_VARARGS, "Run a list of segments as one transaction - each a bytes-like object to send, a number of bytes to read, or a dict with tx, rx, cs_change, delay_usecs, speed_hz and bits_per_word - returns a memoryview of the bytes read per segment"},
+    {"close", (PyCFunction)SPIDevice_close, METH_NOARGS, "Close the device"},
+    {"fileno", (PyCFunction)SPIDevice_fileno, METH_NOARGS, "File descriptor of the spidev node, -1 once closed"},
+    {"__enter__", (PyCFunction)SPIDevice_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)SPIDevice_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject SPIDeviceType = {
+    PyVarObject_HEAD_INIT(NULL,0)
+    "RPi._SPI.Device",              /* tp_name */
+    sizeof(SPIDeviceObject),        /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor)SPIDevice_dealloc,  /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+    "SPI device - Device(path, mode=0, speed=100000, bits=8, delay=0, direct=False)", /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    SPIDevice_methods,              /* tp_methods */
+    0,                              /* tp_members */
+    SPIDevice_getset,               /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    (initproc)SPIDevice_init,       /* tp_init */
+    0,                              /* tp_alloc */
+    SPIDevice_new,                  /* tp_new */
+};
+
+PyTypeObject *SPIDevice_init_SPIDeviceType(void){
+
+    if(PyType_Ready(&SPIDeviceType) < 0){
+        return NULL;
+    }
+    return &SPIDeviceType;
+}
@@ -0,0 +1,84 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_device.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef _SPI_DEVICE_H
+#define _SPI_DEVICE_H
+
+#include "Python.h"
+#include "pythread.h"
+
+#include "spi_lib.h"
+#include "sunxi_spi.h"
+#include "spi_pack.h"
+#include "spi_bus.h"
+
+/* An open spidev node with its own settings. The lock serializes users of
+ * the object, the GIL is released while the kernel does the transfer. bus
+ * and cs come from the node name, direct is set while small transfers go
+ * straight to the controller registers. cs_gpio, when not -1, is driven as
+ * chip select around the transfers. */
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    spi_config_t config;
+    int bus;
+    int cs;
+    int cs_gpio;
+    struct sunxi_spi *direct;
+    uint8_t *scratch;
+    size_t scratch_size;
+    PyThread_type_lock lock;
+} SPIDeviceObject;
+
+extern PyTypeObject SPIDeviceType;
+PyTypeObject *SPIDevice_init_SPIDeviceType(void);
+
+/* Hold the lock while using fd or config, waiting for it lets other threads
+ * run */
+extern void spi_device_lock(SPIDeviceObject *self);
+extern void spi_device_unlock(SPIDeviceObject *self);
+
+/* Transfer with the lock held, safe to call with the GIL released. Takes
+ * the bus and drives a gpio chip select. Returns 0 or an errno value. */
+extern int spi_device_transfer(SPIDeviceObject *self, const spi_segment_t *segments, size_t count);
+
+/* Map the gpio registers for chip select and D/C lines */
+extern int spi_claim_gpio(unsigned int gpio);
+
+/* Shared with the module level functions, which work on a default device */
+extern int spi_device_config(spi_config_t *config, int mode, int bits, long speed, int delay);
+extern int spi_device_open(SPIDeviceObject *self, const char *path, spi_config_t config);
+extern PyObject *SPIDevice_close(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_read(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_readinto(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_write(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_xfer(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_xfer_into(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_transfer(SPIDeviceObject *self, PyObject *args);
+extern PyObject *SPIDevice_write_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs);
+extern PyObject *SPIDevice_read_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs);
+extern PyObject *SPIDevice_readinto_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs);
+extern PyObject *SPIDevice_xfer_words(SPIDeviceObject *self, PyObject *args, PyObject *kwargs);
+extern PyObject *SPIDevice_xfer_words_into(SPIDeviceObject *self, PyObject *args, PyObject *kwargs);
+
+#endif
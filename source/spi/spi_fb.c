@@ -0,0 +1,361 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_fb.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#endif
+
+#include "spi_fb.h"
+#include "spi_pack.h"
+#include "spi_gpio.h"
+
+/*
+ * What a new address window costs, in bytes of pixel data: six transfers
+ * with two D/C changes. Dirty rows closer than this are sent as one
+ * rectangle, resending the clean pixels between them.
+ */
+#define SPI_FB_WINDOW_COST  512
+
+int spi_fb_init(struct spi_fb *fb, unsigned int width, unsigned int height, int dc,
+                spi_fb_xfer_t xfer, void *ctx) {
+    size_t size = (size_t)width * height * 2;
+
+    memset(fb, 0, sizeof(*fb));
+    fb->width = width;
+    fb->height = height;
+    fb->dc = dc;
+    fb->xfer = xfer;
+    fb->ctx = ctx;
+    fb->frame = malloc(size);
+    fb->shadow = malloc(size);
+    fb->rects = calloc(height, sizeof(*fb->rects));
+    fb->segments = calloc(height, sizeof(*fb->segments));
+    if (fb->frame == NULL || fb->shadow == NULL || fb->rects == NULL || fb->segments == NULL) {
+        spi_fb_free(fb);
+        errno = ENOMEM;
+        return -1;
+    }
+    spi_fb_invalidate(fb);
+    return 0;
+}
+
+void spi_fb_free(struct spi_fb *fb) {
+    free(fb->frame);
+    free(fb->shadow);
+    free(fb->rects);
+    free(fb->segments);
+    fb->frame = fb->shadow = NULL;
+    fb->rects = NULL;
+    fb->segments = NULL;
+}
+
+/* Forget what the panel shows, the next update sends the whole frame */
+void spi_fb_invalidate(struct spi_fb *fb) {
+    fb->valid = 0;
+    fb->dc_level = -1;
+    fb->window[0] = fb->window[1] = fb->window[2] = fb->window[3] = -1;
+}
+
+static int send(struct spi_fb *fb, int dc, const spi_segment_t *segments, size_t count) {
+    int err;
+
+    if (fb->dc_level != dc) {
+        gpio_api->output_gpio(fb->dc, dc);
+        fb->dc_level = dc;
+    }
+    if ((err = fb->xfer(fb->ctx, segments, count)) != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int command(struct spi_fb *fb, uint8_t cmd, const uint8_t *data, size_t len) {
+    spi_segment_t segment;
+
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = &cmd;
+    segment.len = 1;
+    if (send(fb, 0, &segment, 1) < 0)
+        return -1;
+    if (len == 0)
+        return 0;
+    segment.tx = data;
+    segment.len = len;
+    return send(fb, 1, &segment, 1);
+}
+
+/* Send a command with D/C low followed by its parameters with D/C high */
+int spi_fb_command(struct spi_fb *fb, uint8_t cmd, const uint8_t *data, size_t len) {
+    /* the command may move the window or change the frame memory */
+    fb->window[0] = fb->window[1] = fb->window[2] = fb->window[3] = -1;
+    return command(fb, cmd, data, len);
+}
+
+/* CASET or PASET, skipped when the panel already has that range */
+static int address(struct spi_fb *fb, uint8_t cmd, long *cached, unsigned int start, unsigned int end) {
+    uint8_t range[4];
+
+    if (cached[0] == start && cached[1] == end)
+        return 0;
+    range[0] = start >> 8;
+    range[1] = start;
+    range[2] = end >> 8;
+    range[3] = end;
+    cached[0] = cached[1] = -1;
+    if (command(fb, cmd, range, 4) < 0)
+        return -1;
+    cached[0] = start;
+    cached[1] = end;
+    return 0;
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static size_t rgb888_vector(uint8_t *dst, const uint8_t *src, size_t count) {
+    const uint8x16_t red = vdupq_n_u8(0xF8), green = vdupq_n_u8(0xE0);
+    uint8x16x3_t rgb;
+    uint8x16x2_t out;
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        rgb = vld3q_u8(src + 3 * i);
+        out.val[0] = vorrq_u8(vandq_u8(rgb.val[0], red), vshrq_n_u8(rgb.val[1], 5));
+        out.val[1] = vorrq_u8(vandq_u8(vshlq_n_u8(rgb.val[1], 3), green), vshrq_n_u8(rgb.val[2], 3));
+        vst2q_u8(dst + 2 * i, out);
+    }
+    return i;
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+/* SSSE3 is not in the x86-64 baseline, so this is picked at run time */
+__attribute__((target("ssse3")))
+static size_t rgb888_ssse3(uint8_t *dst, const uint8_t *src, size_t count) {
+    uint8_t table[9][16];
+    __m128i shuffle[9], v0, v1, v2, r, g, b, hi, lo;
+    const __m128i red = _mm_set1_epi8((char)0xF8), green_hi = _mm_set1_epi8(0x07);
+    const __m128i green_lo = _mm_set1_epi8((char)0xE0), blue = _mm_set1_epi8(0x1F);
+    int c, k, j, from;
+    size_t i;
+
+    /* shuffle[3 * c + k] moves channel c of the pixels in the k-th 16
+     * bytes of 16 pixels to their place, 0x80 zeroes the rest */
+    for (c = 0; c < 3; c++) {
+        for (k = 0; k < 3; k++) {
+            for (j = 0; j < 16; j++) {
+                from = 3 * j + c - 16 * k;
+                table[3 * c + k][j] = from >= 0 && from < 16 ? from : 0x80;
+            }
+            shuffle[3 * c + k] = _mm_loadu_si128((const __m128i *)table[3 * c + k]);
+        }
+    }
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        v0 = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        v1 = _mm_loadu_si128((const __m128i *)(src + 3 * i + 16));
+        v2 = _mm_loadu_si128((const __m128i *)(src + 3 * i + 32));
+        r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, shuffle[0]), _mm_shuffle_epi8(v1, shuffle[1])),
+                         _mm_shuffle_epi8(v2, shuffle[2]));
+        g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, shuffle[3]), _mm_shuffle_epi8(v1, shuffle[4])),
+                         _mm_shuffle_epi8(v2, shuffle[5]));
+        b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, shuffle[6]), _mm_shuffle_epi8(v1, shuffle[7])),
+                         _mm_shuffle_epi8(v2, shuffle[8]));
+        /* no byte shifts, the masks drop what crosses a byte */
+        hi = _mm_or_si128(_mm_and_si128(r, red), _mm_and_si128(_mm_srli_epi16(g, 5), green_hi));
+        lo = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(g, 3), green_lo), _mm_and_si128(_mm_srli_epi16(b, 3), blue));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+static size_t rgb888_vector(uint8_t *dst, const uint8_t *src, size_t count) {
+    static int ssse3 = -1;
+
+    if (ssse3 < 0) {
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3") != 0;
+    }
+    return ssse3 ? rgb888_ssse3(dst, src, count) : 0;
+}
+
+#else
+
+static size_t rgb888_vector(uint8_t *dst, const uint8_t *src, size_t count) {
+    return 0;
+}
+
+#endif
+
+/* RGB888 to RGB565, high byte first */
+static void rgb888(uint8_t *dst, const uint8_t *src, size_t count) {
+    size_t i;
+
+    for (i = rgb888_vector(dst, src, count); i < count; i++) {
+        dst[2 * i] = (src[3 * i] & 0xF8) | (src[3 * i + 1] >> 5);
+        dst[2 * i + 1] = ((src[3 * i + 1] << 3) & 0xE0) | (src[3 * i + 2] >> 3);
+    }
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t x;
+
+    memcpy(&x, p, 8);
+    return x;
+}
+
+/*
+ * Find the pixels x0 up to x1 of a row that changed
+ *
+ * @return 0 if the row is unchanged
+ */
+static int row_span(const uint8_t *a, const uint8_t *b, size_t len, unsigned int *x0, unsigned int *x1) {
+    size_t i = 0, j = len;
+
+    if (memcmp(a, b, len) == 0)
+        return 0;
+    while (i + 8 <= len && load64(a + i) == load64(b + i))
+        i += 8;
+    while (a[i] == b[i])
+        i++;
+    while (j >= 8 && load64(a + j - 8) == load64(b + j - 8))
+        j -= 8;
+    while (a[j - 1] == b[j - 1])
+        j--;
+    *x0 = i / 2;
+    *x1 = (j + 1) / 2;
+    return 1;
+}
+
+/*
+ * Cover the changed pixels with rectangles. A changed row joins the
+ * rectangle above when widening it and resending the clean rows between
+ * them costs less than a window of its own.
+ */
+static size_t dirty_rects(struct spi_fb *fb) {
+    size_t stride = (size_t)fb->width * 2, count = 0, extra;
+    struct spi_fb_rect *cur = NULL;
+    unsigned int y, x0, x1, left, right, gap = 0;
+
+    if (!fb->valid) {
+        fb->rects[0].x = fb->rects[0].y = 0;
+        fb->rects[0].w = fb->width;
+        fb->rects[0].h = fb->height;
+        return 1;
+    }
+
+    for (y = 0; y < fb->height; y++) {
+        if (!row_span(fb->frame + y * stride, fb->shadow + y * stride, stride, &x0, &x1)) {
+            gap++;
+            continue;
+        }
+        if (cur != NULL) {
+            left = x0 < cur->x ? x0 : cur->x;
+            right = x1 > cur->x + cur->w ? x1 : cur->x + cur->w;
+            extra = ((size_t)gap * (right - left) + (size_t)cur->h * (right - left - cur->w) +
+                     (right - left) - (x1 - x0)) * 2;
+            if (extra <= SPI_FB_WINDOW_COST) {
+                cur->x = left;
+                cur->w = right - left;
+                cur->h = y + 1 - cur->y;
+                gap = 0;
+                continue;
+            }
+        }
+        cur = &fb->rects[count++];
+        cur->x = x0;
+        cur->y = y;
+        cur->w = x1 - x0;
+        cur->h = 1;
+        gap = 0;
+    }
+    return count;
+}
+
+static int send_rect(struct spi_fb *fb, const struct spi_fb_rect *rect) {
+    size_t stride = (size_t)fb->width * 2, count, i;
+    unsigned int x = rect->x + fb->x_offset, y = rect->y + fb->y_offset;
+
+    if (address(fb, SPI_FB_CASET, &fb->window[0], x, x + rect->w - 1) < 0 ||
+        address(fb, SPI_FB_PASET, &fb->window[2], y, y + rect->h - 1) < 0 ||
+        command(fb, SPI_FB_RAMWR, NULL, 0) < 0)
+        return -1;
+
+    /* full width rows are one run of memory, spi_transfer() splits the
+     * rows into as few bufsiz messages as it can */
+    count = rect->w == fb->width ? 1 : rect->h;
+    for (i = 0; i < count; i++) {
+        memset(&fb->segments[i], 0, sizeof(spi_segment_t));
+        fb->segments[i].tx = fb->frame + (rect->y + i) * stride + rect->x * 2;
+        fb->segments[i].len = count == 1 ? rect->h * stride : rect->w * 2;
+    }
+    return send(fb, 1, fb->segments, count);
+}
+
+/*
+ * Convert a frame, send what changed since the last one and remember it
+ *
+ * @return number of rectangles sent, in fb->rects, or -1 with errno set
+ */
+int spi_fb_update(struct spi_fb *fb, const uint8_t *src, int format) {
+    size_t pixels = (size_t)fb->width * fb->height, stride = (size_t)fb->width * 2, count, i;
+    unsigned int y;
+
+    switch (format) {
+    case SPI_FB_RGB888:
+        rgb888(fb->frame, src, pixels);
+        break;
+    case SPI_FB_RGB565:
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        spi_pack(fb->frame, src, pixels, 2, 0);
+#else
+        spi_pack(fb->frame, src, pixels, 2, SPI_PACK_SWAP);
+#endif
+        break;
+    default:
+        memcpy(fb->frame, src, pixels * 2);
+        break;
+    }
+
+    count = dirty_rects(fb);
+    for (i = 0; i < count; i++) {
+        if (send_rect(fb, &fb->rects[i]) < 0) {
+            spi_fb_invalidate(fb);
+            return -1;
+        }
+        for (y = fb->rects[i].y; y < fb->rects[i].y + fb->rects[i].h; y++)
+            memcpy(fb->shadow + y * stride + fb->rects[i].x * 2, fb->frame + y * stride + fb->rects[i].x * 2,
+                   fb->rects[i].w * 2);
+    }
+    fb->valid = 1;
+    return count;
+}
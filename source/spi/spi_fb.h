@@ -0,0 +1,83 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_fb.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef _SPI_FB_H
+#define _SPI_FB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spi_lib.h"
+
+/* MIPI DCS commands of ILI9341, ST7789 and friends */
+#define SPI_FB_CASET        0x2A
+#define SPI_FB_PASET        0x2B
+#define SPI_FB_RAMWR        0x2C
+
+/* Pixel formats of a frame handed to spi_fb_update() */
+#define SPI_FB_RGB888       0   /* 3 bytes per pixel */
+#define SPI_FB_RGB565       1   /* 16 bit words in host order */
+#define SPI_FB_RGB565_BE    2   /* 2 bytes per pixel as sent, high byte first */
+
+struct spi_fb_rect {
+    unsigned int x;
+    unsigned int y;
+    unsigned int w;
+    unsigned int h;
+};
+
+/* Runs segments on the bus, returns 0 or an errno value */
+typedef int (*spi_fb_xfer_t)(void *ctx, const spi_segment_t *segments, size_t count);
+
+/*
+ * A panel's frame memory driven over SPI with a D/C gpio. frame holds the
+ * frame being sent in RGB565 as it goes on the wire, shadow what the panel
+ * shows, valid whether shadow can be trusted. Only rectangles that differ
+ * from shadow are sent, each behind a column and page address window.
+ */
+struct spi_fb {
+    unsigned int width;
+    unsigned int height;
+    unsigned int x_offset;
+    unsigned int y_offset;
+    int dc;
+    int dc_level;
+    uint8_t *frame;
+    uint8_t *shadow;
+    int valid;
+    struct spi_fb_rect *rects;
+    spi_segment_t *segments;
+    long window[4];
+    spi_fb_xfer_t xfer;
+    void *ctx;
+};
+
+extern int spi_fb_init(struct spi_fb *fb, unsigned int width, unsigned int height, int dc,
+                       spi_fb_xfer_t xfer, void *ctx);
+extern void spi_fb_free(struct spi_fb *fb);
+extern int spi_fb_command(struct spi_fb *fb, uint8_t cmd, const uint8_t *data, size_t len);
+extern int spi_fb_update(struct spi_fb *fb, const uint8_t *src, int format);
+extern void spi_fb_invalidate(struct spi_fb *fb);
+
+#endif
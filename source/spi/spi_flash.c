@@ -0,0 +1,404 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_flash.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include "spi_flash.h"
+#include "spi_device.h"
+#include "spi_nor.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The learned program and erase times are only touched with the device
+ * lock held */
+typedef struct {
+    PyObject_HEAD
+    SPIDeviceObject *device;
+    struct spi_nor nor;
+} SPIFlashObject;
+
+/* spi_nor_xfer_t on a device, runs with its lock held */
+static int device_xfer(void *ctx, const spi_segment_t *segments, size_t count){
+
+    return spi_device_transfer((SPIDeviceObject *)ctx, segments, count);
+}
+
+/**
+ * Lock the device and check that it is open
+ *
+ * @return 0, or -1 with an exception set and the lock released
+ */
+static int lock_open(SPIFlashObject *self){
+
+    if(self->device == NULL){
+        PyErr_SetString(PyExc_ValueError, "flash not initialized");
+        return -1;
+    }
+    spi_device_lock(self->device);
+    if(self->device->fd < 0){
+        spi_device_unlock(self->device);
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Check that [address, address + length) lies on the part
+ *
+ * @return 0, or -1 with an exception set
+ */
+static int check_range(SPIFlashObject *self, unsigned long address, Py_ssize_t length){
+
+    if(self->device == NULL){
+        PyErr_SetString(PyExc_ValueError, "flash not initialized");
+        return -1;
+    }
+    if(address > self->nor.size || (size_t)length > self->nor.size - address){
+        PyErr_Format(PyExc_ValueError, "range is past the end of the %lu byte flash",
+                     (unsigned long)self->nor.size);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Flash(device)
+ */
+static int SPIFlash_init(SPIFlashObject *self, PyObject *args, PyObject *kwargs){
+
+    SPIDeviceObject *device;
+    struct spi_nor nor;
+    int ret, err = 0;
+
+    static char *kwlist [] = {
+        "device", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!", kwlist, &SPIDeviceType, &device)){
+        return -1;
+    }
+
+    spi_device_lock(device);
+    if(device->fd < 0){
+        spi_device_unlock(device);
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if((ret = spi_nor_probe(&nor, device_xfer, device)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(device);
+    if(ret < 0){
+        if(err == ENODEV){
+            PyErr_Format(PyExc_IOError, "no SPI NOR flash answered the JEDEC ID read (%02x %02x %02x)",
+                         nor.id[0], nor.id[1], nor.id[2]);
+        }else{
+            errno = err;
+            PyErr_SetFromErrno(PyExc_IOError);
+        }
+        return -1;
+    }
+
+    Py_XDECREF(self->device);
+    Py_INCREF(device);
+    self->device = device;
+    self->nor = nor;
+    return 0;
+}
+
+static void SPIFlash_dealloc(SPIFlashObject *self){
+
+    Py_XDECREF(self->device);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/**
+ * Fast read into a buffer, as one transaction however long it is
+ *
+ * @param self
+ * @param address first byte
+ * @param buf writable buffer, filled from address on
+ * @return 0, or -1 with an exception set
+ */
+static int read_into(SPIFlashObject *self, unsigned long address, uint8_t *buf, Py_ssize_t len){
+
+    int ret, err = 0;
+
+    if(check_range(self, address, len) < 0 || lock_open(self) < 0){
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if((ret = spi_nor_read(&self->nor, address, buf, len)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(self->device);
+    if(ret < 0){
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Read bytes from the flash
+ *
+ * @param self
+ * @param args address and number of bytes
+ * @return bytes read
+ */
+static PyObject *SPIFlash_read(SPIFlashObject *self, PyObject *args){
+
+    PyObject *result;
+    unsigned long address;
+    Py_ssize_t length;
+
+    if(!PyArg_ParseTuple(args, "kn", &address, &length)){
+        return NULL;
+    }
+    if(length < 0){
+        PyErr_SetString(PyExc_ValueError, "length must not be negative");
+        return NULL;
+    }
+    if((result = PyBytes_FromStringAndSize(NULL, length)) == NULL){
+        return NULL;
+    }
+    if(read_into(self, address, (uint8_t *)PyBytes_AS_STRING(result), length) < 0){
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+/**
+ * Read from the flash into a buffer, without copying
+ *
+ * @param self
+ * @param args address and a writable buffer (bytearray, memoryview, ...),
+ * filled completely
+ * @return number of bytes read
+ */
+static PyObject *SPIFlash_readinto(SPIFlashObject *self, PyObject *args){
+
+    unsigned long address;
+    Py_buffer view;
+    int ret;
+
+    if(!PyArg_ParseTuple(args, "kw*", &address, &view)){
+        return NULL;
+    }
+    ret = read_into(self, address, (uint8_t *)view.buf, view.len);
+    PyBuffer_Release(&view);
+    if(ret < 0){
+        return NULL;
+    }
+    return PyLong_FromSsize_t(view.len);
+}
+
+/**
+ * Program erased flash, page by page, waiting for each page in C
+ *
+ * @param self
+ * @param args address, data - a bytes-like object, and verify - read the
+ * range back and compare it
+ * @return none
+ */
+static PyObject *SPIFlash_program(SPIFlashObject *self, PyObject *args, PyObject *kwargs){
+
+    unsigned long address;
+    Py_buffer view;
+    uint8_t *check = NULL;
+    int verify = 0, ret, err = 0;
+
+    static char *kwlist [] = {
+        "address", "data", "verify", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "ks*|i", kwlist, &address, &view, &verify)){
+        return NULL;
+    }
+    if(check_range(self, address, view.len) < 0){
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    if(verify && view.len > 0 && (check = malloc(view.len)) == NULL){
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
+    }
+    if(lock_open(self) < 0){
+        free(check);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = spi_nor_program(&self->nor, address, (const uint8_t *)view.buf, view.len);
+    if(ret == 0 && check != NULL){
+        ret = spi_nor_read(&self->nor, address, check, view.len);
+        if(ret == 0 && memcmp(check, view.buf, view.len) != 0){
+            errno = EIO;
+            ret = -1;
+        }
+    }
+    if(ret < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(self->device);
+    free(check);
+    PyBuffer_Release(&view);
+    if(ret < 0){
+        if(err == EROFS){
+            PyErr_SetString(PyExc_IOError, "the flash ignored the page program, is it write protected?");
+        }else if(err == EIO){
+            PyErr_SetString(PyExc_IOError, "the flash does not read back what was programmed, was it erased?");
+        }else{
+            errno = err;
+            PyErr_SetFromErrno(PyExc_IOError);
+        }
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Erase a range of 4K sectors, in 64K blocks where it covers them
+ *
+ * @param self
+ * @param args address and length, both multiples of 4096
+ * @return none
+ */
+static PyObject *SPIFlash_erase(SPIFlashObject *self, PyObject *args){
+
+    unsigned long address;
+    Py_ssize_t length;
+    int ret, err = 0;
+
+    if(!PyArg_ParseTuple(args, "kn", &address, &length)){
+        return NULL;
+    }
+    if(length < 0 || (address | length) % SPI_NOR_SECTOR != 0){
+        PyErr_Format(PyExc_ValueError, "address and length must be multiples of the %d byte sector",
+                     SPI_NOR_SECTOR);
+        return NULL;
+    }
+    if(check_range(self, address, length) < 0 || lock_open(self) < 0){
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if((ret = spi_nor_erase(&self->nor, address, length)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(self->device);
+    if(ret < 0){
+        if(err == EROFS){
+            PyErr_SetString(PyExc_IOError, "the flash ignored the erase, is it write protected?");
+        }else{
+            errno = err;
+            PyErr_SetFromErrno(PyExc_IOError);
+        }
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *SPIFlash_get_jedec_id(SPIFlashObject *self, void *closure){
+
+    return PyLong_FromUnsignedLong((unsigned long)self->nor.id[0] << 16 | self->nor.id[1] << 8 | self->nor.id[2]);
+}
+
+static PyObject *SPIFlash_get_size(SPIFlashObject *self, void *closure){
+
+    return PyLong_FromSize_t(self->nor.size);
+}
+
+static PyGetSetDef SPIFlash_getset[] = {
+    {"jedec_id", (getter)SPIFlash_get_jedec_id, NULL, "Manufacturer, memory type and capacity bytes of the JEDEC ID, as one number", NULL},
+    {"size", (getter)SPIFlash_get_size, NULL, "Size in bytes, from the JEDEC ID", NULL},
+    {NULL}
+};
+
+static PyMethodDef SPIFlash_methods[] = {
+    {"read", (PyCFunction)SPIFlash_read, METH_VARARGS, "Read length bytes from address on, with one fast read command"},
+    {"readinto", (PyCFunction)SPIFlash_readinto, METH_VARARGS, "Fill a writable buffer from address on, with one fast read command, returns the number of bytes read"},
+    {"program", (PyCFunction)SPIFlash_program, METH_VARARGS | METH_KEYWORDS, "Program a bytes-like object into erased flash at address, page by page; verify=True reads it back and raises IOError if it differs"},
+    {"erase", (PyCFunction)SPIFlash_erase, METH_VARARGS, "Erase length bytes from address on, both multiples of 4096, in 64K blocks where possible"},
+    {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject SPIFlashType = {
+    PyVarObject_HEAD_INIT(NULL,0)
+    "RPi._SPI.Flash",               /* tp_name */
+    sizeof(SPIFlashObject),         /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor)SPIFlash_dealloc,   /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    "25-series SPI NOR flash - Flash(device) reads the JEDEC ID, then reads, programs and erases with the polling done in C", /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    SPIFlash_methods,               /* tp_methods */
+    0,                              /* tp_members */
+    SPIFlash_getset,                /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    (initproc)SPIFlash_init,        /* tp_init */
+    0,                              /* tp_alloc */
+    PyType_GenericNew,              /* tp_new */
+};
+
+PyTypeObject *SPIFlash_init_SPIFlashType(void){
+
+    if(PyType_Ready(&SPIFlashType) < 0){
+        return NULL;
+    }
+    return &SPIFlashType;
+}
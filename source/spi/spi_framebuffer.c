@@ -0,0 +1,329 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_framebuffer.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include "spi_framebuffer.h"
+#include "spi_device.h"
+#include "spi_fb.h"
+#include "spi_gpio.h"
+#include "../c_gpio.h"
+#include "../event_gpio.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+/* The frame state is only touched with the device lock held, which also
+ * keeps other users of the device off the bus between the D/C changes and
+ * the transfers they belong to */
+typedef struct {
+    PyObject_HEAD
+    SPIDeviceObject *device;
+    struct spi_fb fb;
+} SPIFramebufferObject;
+
+/* spi_fb_xfer_t on a device, runs with its lock held */
+static int device_xfer(void *ctx, const spi_segment_t *segments, size_t count){
+
+    return spi_device_transfer((SPIDeviceObject *)ctx, segments, count);
+}
+
+/**
+ * Lock the device and check that it is open
+ *
+ * @return 0, or -1 with an exception set and the lock released
+ */
+static int lock_open(SPIFramebufferObject *self){
+
+    if(self->device == NULL){
+        PyErr_SetString(PyExc_ValueError, "framebuffer not initialized");
+        return -1;
+    }
+    spi_device_lock(self->device);
+    if(self->device->fd < 0){
+        spi_device_unlock(self->device);
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed SPI device");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Framebuffer(device, width, height, dc, x_offset=0, y_offset=0)
+ */
+static int SPIFramebuffer_init(SPIFramebufferObject *self, PyObject *args, PyObject *kwargs){
+
+    SPIDeviceObject *device;
+    unsigned int width, height, dc, x_offset = 0, y_offset = 0;
+
+    static char *kwlist [] = {
+        "device", "width", "height", "dc", "x_offset", "y_offset", NULL
+    };
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!III|II", kwlist,
+        &SPIDeviceType, &device, &width, &height, &dc, &x_offset, &y_offset)){
+        return -1;
+    }
+    if(width < 1 || height < 1 || x_offset + width > 0x10000 || y_offset + height > 0x10000){
+        PyErr_SetString(PyExc_ValueError, "the frame must fit a 65536 x 65536 address space");
+        return -1;
+    }
+    if(dc >= EVENT_GPIO_MAX){
+        PyErr_SetString(PyExc_ValueError, "invalid D/C gpio");
+        return -1;
+    }
+    if(spi_claim_gpio(dc) < 0){
+        return -1;
+    }
+    gpio_api->setup_gpio(dc, OUTPUT, PUD_OFF);
+
+    if(self->device != NULL){
+        gpio_api->release(self->fb.dc, GPIO_OWNER_SPI);
+        spi_fb_free(&self->fb);
+        Py_CLEAR(self->device);
+    }
+    if(spi_fb_init(&self->fb, width, height, dc, device_xfer, device) < 0){
+        gpio_api->release(dc, GPIO_OWNER_SPI);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->fb.x_offset = x_offset;
+    self->fb.y_offset = y_offset;
+    Py_INCREF(device);
+    self->device = device;
+    return 0;
+}
+
+static void SPIFramebuffer_dealloc(SPIFramebufferObject *self){
+
+    if(self->device != NULL){
+        gpio_api->release(self->fb.dc, GPIO_OWNER_SPI);
+    }
+    spi_fb_free(&self->fb);
+    Py_XDECREF(self->device);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/**
+ * Send the parts of a frame that changed since the last one
+ *
+ * @param self
+ * @param args frame - width * height pixels as RGB888 bytes, a buffer of
+ * 16 bit RGB565 words (array, NumPy, ...) or RGB565 bytes high byte first
+ * @return list of the (x, y, width, height) rectangles sent
+ */
+static PyObject *SPIFramebuffer_update(SPIFramebufferObject *self, PyObject *args){
+
+    PyObject *frame, *result, *rect;
+    Py_buffer view;
+    size_t pixels;
+    int format, count, err = 0, i;
+
+    if(!PyArg_ParseTuple(args, "O", &frame)){
+        return NULL;
+    }
+    if(PyObject_GetBuffer(frame, &view, PyBUF_SIMPLE) < 0){
+        return NULL;
+    }
+    pixels = (size_t)self->fb.width * self->fb.height;
+    if((size_t)view.len == pixels * 3){
+        format = SPI_FB_RGB888;
+    }else if((size_t)view.len == pixels * 2){
+        format = view.itemsize == 2 ? SPI_FB_RGB565 : SPI_FB_RGB565_BE;
+    }else{
+        PyErr_Format(PyExc_ValueError, "frame must be %lu bytes of RGB888 or %lu bytes of RGB565",
+                     (unsigned long)pixels * 3, (unsigned long)pixels * 2);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    if(lock_open(self) < 0){
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if((count = spi_fb_update(&self->fb, (const uint8_t *)view.buf, format)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(self->device);
+    PyBuffer_Release(&view);
+    if(count < 0){
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if((result = PyList_New(count)) == NULL){
+        return NULL;
+    }
+    for(i = 0; i < count; i++){
+        if((rect = Py_BuildValue("(IIII)", self->fb.rects[i].x, self->fb.rects[i].y,
+                                 self->fb.rects[i].w, self->fb.rects[i].h)) == NULL){
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, rect);
+    }
+    return result;
+}
+
+/**
+ * Send a command with D/C low and its parameters with D/C high, for panel
+ * set up
+ *
+ * @param self
+ * @param args command byte and parameters - a bytes-like object
+ * @return none
+ */
+static PyObject *SPIFramebuffer_command(SPIFramebufferObject *self, PyObject *args, PyObject *kwargs){
+
+    Py_buffer view;
+    int cmd, ret, err = 0;
+
+    static char *kwlist [] = {
+        "cmd", "data", NULL
+    };
+
+    view.buf = NULL;
+    view.len = 0;
+    view.obj = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "i|s*", kwlist, &cmd, &view)){
+        return NULL;
+    }
+    if(cmd < 0 || cmd > 0xff){
+        PyErr_SetString(PyExc_ValueError, "command must be between 0 and 255");
+        goto fail;
+    }
+    if(lock_open(self) < 0){
+        goto fail;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if((ret = spi_fb_command(&self->fb, cmd, (const uint8_t *)view.buf, view.len)) < 0){
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS
+    spi_device_unlock(self->device);
+    if(view.obj != NULL){
+        PyBuffer_Release(&view);
+    }
+    if(ret < 0){
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_RETURN_NONE;
+
+fail:
+    if(view.obj != NULL){
+        PyBuffer_Release(&view);
+    }
+    return NULL;
+}
+
+/**
+ * Forget what the panel shows, so the next update sends the whole frame
+ */
+static PyObject *SPIFramebuffer_invalidate(SPIFramebufferObject *self, PyObject *args){
+
+    if(self->device == NULL){
+        PyErr_SetString(PyExc_ValueError, "framebuffer not initialized");
+        return NULL;
+    }
+    spi_device_lock(self->device);
+    spi_fb_invalidate(&self->fb);
+    spi_device_unlock(self->device);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *SPIFramebuffer_get_width(SPIFramebufferObject *self, void *closure){
+
+    return PyLong_FromUnsignedLong(self->fb.width);
+}
+
+static PyObject *SPIFramebuffer_get_height(SPIFramebufferObject *self, void *closure){
+
+    return PyLong_FromUnsignedLong(self->fb.height);
+}
+
+static PyGetSetDef SPIFramebuffer_getset[] = {
+    {"width", (getter)SPIFramebuffer_get_width, NULL, "Width in pixels", NULL},
+    {"height", (getter)SPIFramebuffer_get_height, NULL, "Height in pixels", NULL},
+    {NULL}
+};
+
+static PyMethodDef SPIFramebuffer_methods[] = {
+    {"update", (PyCFunction)SPIFramebuffer_update, METH_VARARGS, "Send the parts of a frame - RGB888 bytes, a buffer of 16 bit RGB565 words or RGB565 bytes high byte first - that changed since the last one, returns the (x, y, width, height) rectangles sent"},
+    {"command", (PyCFunction)SPIFramebuffer_command, METH_VARARGS | METH_KEYWORDS, "Send a command byte with D/C low and its parameters, a bytes-like object, with D/C high"},
+    {"invalidate", (PyCFunction)SPIFramebuffer_invalidate, METH_NOARGS, "Send the whole frame on the next update"},
+    {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject SPIFramebufferType = {
+    PyVarObject_HEAD_INIT(NULL,0)
+    "RPi._SPI.Framebuffer",         /* tp_name */
+    sizeof(SPIFramebufferObject),   /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor)SPIFramebuffer_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    "RGB565 panel frame memory - Framebuffer(device, width, height, dc, x_offset=0, y_offset=0) sends only the rectangles that changed, switching gpio dc between commands and data", /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    SPIFramebuffer_methods,         /* tp_methods */
+    0,                              /* tp_members */
+    SPIFramebuffer_getset,          /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    (initproc)SPIFramebuffer_init,  /* tp_init */
+    0,                              /* tp_alloc */
+    PyType_GenericNew,              /* tp_new */
+};
+
+PyTypeObject *SPIFramebuffer_init_SPIFramebufferType(void){
+
+    if(PyType_Ready(&SPIFramebufferType) < 0){
+        return NULL;
+    }
+    return &SPIFramebufferType;
+}
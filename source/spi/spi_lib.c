@@ -34,6 +34,14 @@
 
 #include "spi_lib.h"
 
+#define SPI_DEFAULT_BUFSIZ  4096
+#define SPI_MAX_BATCH       64      /* transfers per SPI_IOC_MESSAGE */
+
+/* bytes spidev moves per word of the given size */
+static size_t word_bytes(unsigned int bits) {
+    return bits <= 8 ? 1 : bits <= 16 ? 2 : 4;
+}
+
 int spi_open(char *device, spi_config_t config) {
     int fd;
 
@@ -43,27 +51,17 @@ int spi_open(char *device, spi_config_t config) {
         return fd;
     }
 
-    /* Set SPI_POL and SPI_PHA */
-    if (ioctl(fd, SPI_IOC_WR_MODE, &config.mode) < 0) {
-        return -1;
-    }
-    if (ioctl(fd, SPI_IOC_RD_MODE, &config.mode) < 0) {
-        return -1;
-    }
-
-    /* Set bits per word*/
-    if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &config.bits_per_word) < 0) {
-        return -1;
-    }
-    if (ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &config.bits_per_word) < 0) {
-        return -1;
-    }
-
-    /* Set SPI speed*/
-    if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &config.speed) < 0) {
-        return -1;
-    }
-    if (ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &config.speed) < 0) {
+    /* Set SPI_POL and SPI_PHA, bits per word and SPI speed */
+    if (ioctl(fd, SPI_IOC_WR_MODE, &config.mode) < 0 ||
+        ioctl(fd, SPI_IOC_RD_MODE, &config.mode) < 0 ||
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &config.bits_per_word) < 0 ||
+        ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &config.bits_per_word) < 0 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &config.speed) < 0 ||
+        ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &config.speed) < 0) {
+        int saved = errno;
+
+        close(fd);
+        errno = saved;
         return -1;
     }
 
@@ -71,37 +69,161 @@ int spi_open(char *device, spi_config_t config) {
     return fd;
 }
 
+int spi_set_mode(int fd, uint8_t mode) {
+    return ioctl(fd, SPI_IOC_WR_MODE, &mode);
+}
+
 int spi_close(int fd) {
     return close(fd);
 }
 
-int spi_xfer(int fd, uint8_t *tx_buffer, uint8_t tx_len, uint8_t *rx_buffer, uint8_t rx_len){
-    struct spi_ioc_transfer spi_message[1];
-    memset(spi_message, 0, sizeof(spi_message));
+/*
+ * spidev copies each message through a bounce buffer of bufsiz bytes (a
+ * module parameter, 4096 by default) and rejects messages whose transmit or
+ * receive total is larger with EMSGSIZE.
+ */
+size_t spi_bufsiz(void) {
+    static size_t bufsiz = 0;
+    unsigned long value;
+    FILE *f;
+
+    if (bufsiz == 0) {
+        bufsiz = SPI_DEFAULT_BUFSIZ;
+        if ((f = fopen("/sys/module/spidev/parameters/bufsiz", "r")) != NULL) {
+            if (fscanf(f, "%lu", &value) == 1 && value > 0)
+                bufsiz = value;
+            fclose(f);
+        }
+    }
+    return bufsiz;
+}
 
-    spi_message[0].rx_buf = (unsigned long)rx_buffer;
-    spi_message[0].tx_buf = (unsigned long)tx_buffer;
-    spi_message[0].len = tx_len;
+/*
+ * The word size a segment is clocked with, from the segment, the config or,
+ * failing both, the device.  device_bits caches the device setting, 0 until
+ * it has been read.
+ */
+static unsigned int segment_bits(int fd, const spi_config_t *config, const spi_segment_t *segment, uint8_t *device_bits) {
+    if (segment->bits_per_word)
+        return segment->bits_per_word;
+    if (config != NULL && config->bits_per_word)
+        return config->bits_per_word;
+    if (*device_bits == 0 && (ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, device_bits) < 0 || *device_bits == 0))
+        *device_bits = 8;
+    return *device_bits;
+}
 
-    return ioctl(fd, SPI_IOC_MESSAGE(1), spi_message);
+/* send the n transfers in batch as one message, more is set if the transfer
+ * continues in another message */
+static int spi_message(int fd, struct spi_ioc_transfer *batch, int n, int more) {
+    /* cs_change on the last transfer of a message means the opposite, keep
+     * the device selected */
+    if (more)
+        batch[n-1].cs_change = !batch[n-1].cs_change;
+    if (ioctl(fd, SPI_IOC_MESSAGE(n), batch) < 0)
+        return -1;
+    memset(batch, 0, n * sizeof(*batch));
+    return 0;
 }
 
-int spi_read(int fd, uint8_t *rx_buffer, uint8_t rx_len){
-    struct spi_ioc_transfer spi_message[1];
-    memset(spi_message, 0, sizeof(spi_message));
+/*
+ * Submit the segments in as few SPI_IOC_MESSAGE ioctls as spidev allows:
+ * consecutive segments are packed into one message up to bufsiz bytes, and a
+ * segment longer than that is split across messages on a word boundary of
+ * that segment.  Buffers are passed to
+ * the kernel as they are, nothing is copied.  Every message but the last
+ * asks for chip select to stay asserted, so the whole transfer looks like one
+ * to the device, unless the segment that ends it asked for chip select to
+ * be released anyway.  With a config, its speed, word size and delay are set
+ * on every transfer, overriding whatever another user of the device left
+ * behind; without one the device defaults apply.  Settings given in a
+ * segment override both.  The delay and cs_change of a segment go with its
+ * last piece only.
+ */
+int spi_transfer(int fd, const spi_config_t *config, const spi_segment_t *segments, size_t count) {
+    struct spi_ioc_transfer batch[SPI_MAX_BATCH];
+    size_t bufsiz = spi_bufsiz();
+    size_t seg = 0, offset = 0, total = 0, take, word;
+    uint8_t device_bits = 0;
+    int n = 0;
+
+    memset(batch, 0, sizeof(batch));
+    while (seg < count) {
+        if (offset == segments[seg].len) {
+            seg++;
+            offset = 0;
+            continue;
+        }
+
+        take = segments[seg].len - offset;
+        if (take > bufsiz - total) {
+            word = word_bytes(segment_bits(fd, config, &segments[seg], &device_bits));
+            take = (bufsiz - total) / word * word;
+            if (take == 0) {
+                /* not even one word fits in what is left of this message */
+                if (n == 0) {
+                    errno = EMSGSIZE;
+                    return -1;
+                }
+                if (spi_message(fd, batch, n, 1) < 0)
+                    return -1;
+                n = 0;
+                total = 0;
+                continue;
+            }
+        }
+
+        if (segments[seg].tx != NULL)
+            batch[n].tx_buf = (unsigned long)(segments[seg].tx + offset);
+        if (segments[seg].rx != NULL)
+            batch[n].rx_buf = (unsigned long)(segments[seg].rx + offset);
+        batch[n].len = take;
+        if (config != NULL) {
+            batch[n].speed_hz = config->speed;
+            batch[n].bits_per_word = config->bits_per_word;
+        }
+        if (segments[seg].speed)
+            batch[n].speed_hz = segments[seg].speed;
+        if (segments[seg].bits_per_word)
+            batch[n].bits_per_word = segments[seg].bits_per_word;
+        if (offset + take == segments[seg].len) {
+            if (config != NULL)
+                batch[n].delay_usecs = config->delay;
+            if (segments[seg].delay)
+                batch[n].delay_usecs = segments[seg].delay;
+            batch[n].cs_change = segments[seg].cs_change;
+        }
+        n++;
+        total += take;
+        offset += take;
+
+        if (n == SPI_MAX_BATCH || total == bufsiz) {
+            if (spi_message(fd, batch, n, seg + 1 < count || offset < segments[seg].len) < 0)
+                return -1;
+            n = 0;
+            total = 0;
+        }
+    }
+
+    if (n > 0 && ioctl(fd, SPI_IOC_MESSAGE(n), batch) < 0)
+        return -1;
+    return 0;
+}
 
-    spi_message[0].rx_buf = (unsigned long)rx_buffer;
-    spi_message[0].len = rx_len;
+int spi_xfer(int fd, const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t len){
+    spi_segment_t segment = {tx_buffer, rx_buffer, len, 0, 0, 0, 0};
 
-    return ioctl(fd, SPI_IOC_MESSAGE(1), spi_message);
+    return spi_transfer(fd, NULL, &segment, 1);
 }
 
-int spi_write(int fd, uint8_t *tx_buffer, uint8_t tx_len){
-    struct spi_ioc_transfer spi_message[1];
-    memset(spi_message, 0, sizeof(spi_message));
+int spi_read(int fd, uint8_t *rx_buffer, size_t rx_len){
+    spi_segment_t segment = {NULL, rx_buffer, rx_len, 0, 0, 0, 0};
+
+    return spi_transfer(fd, NULL, &segment, 1);
+}
 
-    spi_message[0].tx_buf = (unsigned long)tx_buffer;
-    spi_message[0].len = tx_len;
+int spi_write(int fd, const uint8_t *tx_buffer, size_t tx_len){
+    spi_segment_t segment = {tx_buffer, NULL, tx_len, 0, 0, 0, 0};
 
-    return ioctl(fd, SPI_IOC_MESSAGE(1), spi_message);
+    return spi_transfer(fd, NULL, &segment, 1);
 }
@@ -25,6 +25,7 @@
 #define _I2C_LIB_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct {
     uint8_t mode;
@@ -33,11 +34,27 @@ typedef struct {
     uint16_t delay;
 } spi_config_t;
 
+/* One part of a transfer. tx NULL sends zeros, rx NULL discards input.
+ * Zero speed, bits and delay keep the device settings, cs_change releases
+ * chip select once the segment is done. */
+typedef struct {
+    const uint8_t *tx;
+    uint8_t *rx;
+    size_t len;
+    uint8_t cs_change;
+    uint8_t bits_per_word;
+    uint16_t delay;
+    uint32_t speed;
+} spi_segment_t;
+
 extern int spi_open(char *device, spi_config_t config);
 extern int spi_close(int fd);
-extern int spi_xfer(int fd, uint8_t *tx_buffer, uint8_t tx_len, uint8_t *rx_buffer, uint8_t rx_len);
-extern int spi_read(int fd, uint8_t *rx_buffer, uint8_t rx_len);
-extern int spi_write(int fd, uint8_t *tx_buffer, uint8_t tx_len);
+extern int spi_set_mode(int fd, uint8_t mode);
+extern size_t spi_bufsiz(void);
+extern int spi_transfer(int fd, const spi_config_t *config, const spi_segment_t *segments, size_t count);
+extern int spi_xfer(int fd, const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t len);
+extern int spi_read(int fd, uint8_t *rx_buffer, size_t rx_len);
+extern int spi_write(int fd, const uint8_t *tx_buffer, size_t tx_len);
 
 
 #endif
@@ -0,0 +1,312 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_nor.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "spi_nor.h"
+
+#define CMD_READ_STATUS     0x05
+#define CMD_WRITE_ENABLE    0x06
+#define CMD_READ_ID         0x9F
+
+#define STATUS_WIP          0x01
+
+/* Typical times of a W25Q, the starting point of the learned ones */
+#define PAGE_US             700L
+#define SECTOR_US           45000L
+#define BLOCK_US            150000L
+
+/* Give up on a program or erase that takes this many times its datasheet
+ * maximum (3 ms, 400 ms and 2 s on a W25Q) */
+#define PAGE_TIMEOUT_US     20000L
+#define SECTOR_TIMEOUT_US   2000000L
+#define BLOCK_TIMEOUT_US    8000000L
+
+/* Below this a poll costs less than a sleep and its wakeup */
+#define MIN_PAUSE_US        20L
+#define MAX_PAUSE_US        2000L
+
+static uint8_t op(const struct spi_nor *nor, uint8_t cmd3, uint8_t cmd4) {
+    return nor->addr4 ? cmd4 : cmd3;
+}
+
+/* Command and address, big endian as the part takes it; returns the length */
+static size_t header(const struct spi_nor *nor, uint8_t *buf, uint8_t cmd, uint32_t addr) {
+    size_t n = 0;
+
+    buf[n++] = cmd;
+    if (nor->addr4)
+        buf[n++] = addr >> 24;
+    buf[n++] = addr >> 16;
+    buf[n++] = addr >> 8;
+    buf[n++] = addr;
+    return n;
+}
+
+static int run(struct spi_nor *nor, const spi_segment_t *segments, size_t count) {
+    int err;
+
+    if ((err = nor->xfer(nor->ctx, segments, count)) != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static long elapsed_us(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void pause_us(long us) {
+    struct timespec ts = {us / 1000000L, us % 1000000L * 1000};
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static int read_status(struct spi_nor *nor, uint8_t *status) {
+    uint8_t buf[2] = {CMD_READ_STATUS, 0};
+    spi_segment_t segment;
+
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = buf;
+    segment.rx = buf;
+    segment.len = 2;
+    if (run(nor, &segment, 1) < 0)
+        return -1;
+    *status = buf[1];
+    return 0;
+}
+
+/*
+ * Wait out a program or erase whose first status read gave status. Sleep
+ * through three quarters of the time it usually takes, then poll at an
+ * eighth of it, and learn from how long it took. Finding the part ready at
+ * the first poll means the sleep was too long, so the estimate is halved.
+ */
+static int wait_ready(struct spi_nor *nor, uint8_t status, long *estimate, long timeout) {
+    struct timespec start;
+    long pause, took;
+    int polls = 0;
+
+    /* a part that did not go busy ignored the command: its write enable
+     * did not take, or the area is protected */
+    if (!(status & STATUS_WIP)) {
+        errno = EROFS;
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pause_us(*estimate * 3 / 4);
+    for (;;) {
+        if (read_status(nor, &status) < 0)
+            return -1;
+        polls++;
+        took = elapsed_us(&start);
+        if (!(status & STATUS_WIP))
+            break;
+        if (took > timeout) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        pause = *estimate / 8;
+        if (pause > MAX_PAUSE_US)
+            pause = MAX_PAUSE_US;
+        if (pause >= MIN_PAUSE_US)
+            pause_us(pause);
+    }
+
+    if (polls == 1)
+        *estimate /= 2;
+    else
+        *estimate = (*estimate * 3 + took) / 4;
+    return 0;
+}
+
+/* JEDEC capacity byte to bytes, 0 if it makes no sense */
+static size_t capacity(uint8_t code) {
+    if (code >= 0x10 && code <= 0x1F)
+        return (size_t)1 << code;
+    /* Micron and Macronix parts of 512 Mbit and up carry on from 0x20 */
+    if (code >= 0x20 && code <= 0x22)
+        return (size_t)1 << (code - 6);
+    return 0;
+}
+
+int spi_nor_probe(struct spi_nor *nor, spi_nor_xfer_t xfer, void *ctx) {
+    uint8_t buf[4] = {CMD_READ_ID, 0, 0, 0};
+    spi_segment_t segment;
+
+    memset(nor, 0, sizeof(*nor));
+    nor->xfer = xfer;
+    nor->ctx = ctx;
+    nor->page_us = PAGE_US;
+    nor->sector_us = SECTOR_US;
+    nor->block_us = BLOCK_US;
+
+    memset(&segment, 0, sizeof(segment));
+    segment.tx = buf;
+    segment.rx = buf;
+    segment.len = 4;
+    if (run(nor, &segment, 1) < 0)
+        return -1;
+    memcpy(nor->id, buf + 1, 3);
+
+    /* nothing on the bus reads as all zeros or all ones */
+    if ((nor->id[0] == 0x00 && nor->id[1] == 0x00 && nor->id[2] == 0x00) ||
+        (nor->id[0] == 0xFF && nor->id[1] == 0xFF && nor->id[2] == 0xFF) ||
+        (nor->size = capacity(nor->id[2])) == 0) {
+        errno = ENODEV;
+        return -1;
+    }
+    /* past 16 MB use the 4-byte address commands, which leave the address
+     * mode of the part alone */
+    nor->addr4 = nor->size > 0x1000000;
+    return 0;
+}
+
+static int check_range(const struct spi_nor *nor, uint32_t addr, size_t len) {
+    if (addr > nor->size || len > nor->size - addr) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Fast read straight into buf as one transaction: spi_transfer() splits it
+ * into bufsiz messages and keeps chip select asserted between them, so the
+ * part streams the whole range from a single command.
+ */
+int spi_nor_read(struct spi_nor *nor, uint32_t addr, uint8_t *buf, size_t len) {
+    uint8_t cmd[6];
+    spi_segment_t segments[2];
+
+    if (check_range(nor, addr, len) < 0)
+        return -1;
+    if (len == 0)
+        return 0;
+
+    memset(segments, 0, sizeof(segments));
+    segments[0].tx = cmd;
+    segments[0].len = header(nor, cmd, op(nor, 0x0B, 0x0C), addr);
+    cmd[segments[0].len++] = 0;     /* dummy byte */
+    segments[1].rx = buf;
+    segments[1].len = len;
+    return run(nor, segments, 2);
+}
+
+/*
+ * Program len bytes from addr on, page by page. Each page is one message of
+ * write enable, page program and the first status read, so a page costs one
+ * ioctl plus the polls to see it done.
+ */
+int spi_nor_program(struct spi_nor *nor, uint32_t addr, const uint8_t *data, size_t len) {
+    uint8_t wren = CMD_WRITE_ENABLE, cmd[5], status[2];
+    spi_segment_t segments[4];
+    size_t take;
+
+    if (check_range(nor, addr, len) < 0)
+        return -1;
+
+    memset(segments, 0, sizeof(segments));
+    segments[0].tx = &wren;
+    segments[0].len = 1;
+    segments[0].cs_change = 1;
+    segments[1].tx = cmd;
+    segments[2].cs_change = 1;
+    segments[3].tx = status;
+    segments[3].rx = status;
+    segments[3].len = 2;
+
+    while (len > 0) {
+        take = SPI_NOR_PAGE - (addr & (SPI_NOR_PAGE - 1));
+        if (take > len)
+            take = len;
+        segments[1].len = header(nor, cmd, op(nor, 0x02, 0x12), addr);
+        segments[2].tx = data;
+        segments[2].len = take;
+        status[0] = CMD_READ_STATUS;
+        if (run(nor, segments, 4) < 0 || wait_ready(nor, status[1], &nor->page_us, PAGE_TIMEOUT_US) < 0)
+            return -1;
+        addr += take;
+        data += take;
+        len -= take;
+    }
+    return 0;
+}
+
+/*
+ * Erase [addr, addr + len), both multiples of the 4K sector: 64K blocks
+ * where the range covers them, sectors for the rest.
+ */
+int spi_nor_erase(struct spi_nor *nor, uint32_t addr, size_t len) {
+    uint8_t wren = CMD_WRITE_ENABLE, cmd[5], status[2];
+    spi_segment_t segments[3];
+    size_t take;
+    long *estimate, timeout;
+
+    if (check_range(nor, addr, len) < 0)
+        return -1;
+    if ((addr | len) & (SPI_NOR_SECTOR - 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(segments, 0, sizeof(segments));
+    segments[0].tx = &wren;
+    segments[0].len = 1;
+    segments[0].cs_change = 1;
+    segments[1].tx = cmd;
+    segments[1].cs_change = 1;
+    segments[2].tx = status;
+    segments[2].rx = status;
+    segments[2].len = 2;
+
+    while (len > 0) {
+        if ((addr & (SPI_NOR_BLOCK - 1)) == 0 && len >= SPI_NOR_BLOCK) {
+            take = SPI_NOR_BLOCK;
+            segments[1].len = header(nor, cmd, op(nor, 0xD8, 0xDC), addr);
+            estimate = &nor->block_us;
+            timeout = BLOCK_TIMEOUT_US;
+        } else {
+            take = SPI_NOR_SECTOR;
+            segments[1].len = header(nor, cmd, op(nor, 0x20, 0x21), addr);
+            estimate = &nor->sector_us;
+            timeout = SECTOR_TIMEOUT_US;
+        }
+        status[0] = CMD_READ_STATUS;
+        if (run(nor, segments, 3) < 0 || wait_ready(nor, status[1], estimate, timeout) < 0)
+            return -1;
+        addr += take;
+        len -= take;
+    }
+    return 0;
+}
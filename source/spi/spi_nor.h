@@ -0,0 +1,62 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_nor.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef _SPI_NOR_H
+#define _SPI_NOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spi_lib.h"
+
+#define SPI_NOR_PAGE        256
+#define SPI_NOR_SECTOR      4096
+#define SPI_NOR_BLOCK       65536
+
+/* Runs segments on the bus as one transaction, returns 0 or an errno value */
+typedef int (*spi_nor_xfer_t)(void *ctx, const spi_segment_t *segments, size_t count);
+
+/*
+ * A 25-series SPI NOR flash. The *_us fields hold how long a page program,
+ * a sector erase and a block erase have been taking, learned as they run,
+ * so status polling sleeps through most of the wait instead of hammering
+ * the bus.
+ */
+struct spi_nor {
+    uint8_t id[3];
+    size_t size;
+    int addr4;
+    long page_us;
+    long sector_us;
+    long block_us;
+    spi_nor_xfer_t xfer;
+    void *ctx;
+};
+
+extern int spi_nor_probe(struct spi_nor *nor, spi_nor_xfer_t xfer, void *ctx);
+extern int spi_nor_read(struct spi_nor *nor, uint32_t addr, uint8_t *buf, size_t len);
+extern int spi_nor_program(struct spi_nor *nor, uint32_t addr, const uint8_t *data, size_t len);
+extern int spi_nor_erase(struct spi_nor *nor, uint32_t addr, size_t len);
+
+#endif
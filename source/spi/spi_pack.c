@@ -0,0 +1,157 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_pack.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "spi_pack.h"
+
+/*
+ * Word-at-a-time fallback: swap and reverse within the 16 or 32 bit lanes of
+ * a 64 bit value. The lanes line up with the words in memory whatever the
+ * host byte order, as 8 is a multiple of every width.
+ */
+static inline uint64_t pack_word(uint64_t x, unsigned int width, unsigned int flags) {
+    if (flags & SPI_PACK_REVERSE) {
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    }
+    if (flags & SPI_PACK_SWAP) {
+        if (width == 4)
+            x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+        x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+    }
+    return x;
+}
+
+#if defined(__SSE2__)
+
+static size_t pack_vector(uint8_t *dst, const uint8_t *src, size_t len, unsigned int width, unsigned int flags) {
+    const __m128i m4 = _mm_set1_epi8(0x0F), m2 = _mm_set1_epi8(0x33), m1 = _mm_set1_epi8(0x55);
+    __m128i x;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        x = _mm_loadu_si128((const __m128i *)(src + i));
+        if (flags & SPI_PACK_REVERSE) {
+            /* SSE2 has no byte shifts, the masks drop what crosses a byte */
+            x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4), _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+            x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2), _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+            x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1), _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+        }
+        if (flags & SPI_PACK_SWAP) {
+            if (width == 4)
+                x = _mm_or_si128(_mm_srli_epi32(x, 16), _mm_slli_epi32(x, 16));
+            x = _mm_or_si128(_mm_srli_epi16(x, 8), _mm_slli_epi16(x, 8));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), x);
+    }
+    return i;
+}
+
+const char *spi_pack_kernel(void) {
+    return "sse2";
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static size_t pack_vector(uint8_t *dst, const uint8_t *src, size_t len, unsigned int width, unsigned int flags) {
+#ifndef __aarch64__
+    const uint8x16_t m2 = vdupq_n_u8(0x33), m1 = vdupq_n_u8(0x55);
+#endif
+    uint8x16_t x;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        x = vld1q_u8(src + i);
+        if (flags & SPI_PACK_REVERSE) {
+#ifdef __aarch64__
+            x = vrbitq_u8(x);
+#else
+            x = vorrq_u8(vshrq_n_u8(x, 4), vshlq_n_u8(x, 4));
+            x = vorrq_u8(vandq_u8(vshrq_n_u8(x, 2), m2), vshlq_n_u8(vandq_u8(x, m2), 2));
+            x = vorrq_u8(vandq_u8(vshrq_n_u8(x, 1), m1), vshlq_n_u8(vandq_u8(x, m1), 1));
+#endif
+        }
+        if (flags & SPI_PACK_SWAP)
+            x = width == 4 ? vrev32q_u8(x) : vrev16q_u8(x);
+        vst1q_u8(dst + i, x);
+    }
+    return i;
+}
+
+const char *spi_pack_kernel(void) {
+    return "neon";
+}
+
+#else
+
+static size_t pack_vector(uint8_t *dst, const uint8_t *src, size_t len, unsigned int width, unsigned int flags) {
+    return 0;
+}
+
+const char *spi_pack_kernel(void) {
+    return "scalar";
+}
+
+#endif
+
+/*
+ * Convert count words of width bytes (1, 2 or 4) from src to dst, which may
+ * be the same buffer but must not overlap it otherwise.
+ */
+void spi_pack(uint8_t *dst, const uint8_t *src, size_t count, unsigned int width, unsigned int flags) {
+    size_t len = count * width;
+    size_t i;
+    uint64_t x;
+
+    if (width < 2)
+        flags &= ~SPI_PACK_SWAP;
+    if (!flags) {
+        if (dst != src)
+            memcpy(dst, src, len);
+        return;
+    }
+
+    i = pack_vector(dst, src, len, width, flags);
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&x, src + i, 8);
+        x = pack_word(x, width, flags);
+        memcpy(dst + i, &x, 8);
+    }
+    /* the rest is whole words, so zero padding does not mix into them */
+    if (i < len) {
+        x = 0;
+        memcpy(&x, src + i, len - i);
+        x = pack_word(x, width, flags);
+        memcpy(dst + i, &x, len - i);
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ *
+ * This file is part of pyA20.
+ * spi_pack.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef _SPI_PACK_H
+#define _SPI_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Conversion between words in host order and the bytes that go out on the
+ * wire. SPI_PACK_SWAP reverses the bytes of each word, SPI_PACK_REVERSE the
+ * bits of each byte (for LSB first devices). Both are their own inverse, so
+ * the same call packs data to send and unpacks data received.
+ */
+#define SPI_PACK_SWAP       0x01
+#define SPI_PACK_REVERSE    0x02
+
+extern void spi_pack(uint8_t *dst, const uint8_t *src, size_t count, unsigned int width, unsigned int flags);
+extern const char *spi_pack_kernel(void);
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ *
+ * This file is part of pyA20.
+ * sunxi_spi.c is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Direct access to the A64 SPI controllers for transfers that fit in the
+ * FIFO. The bytes are written to the TX FIFO, the burst is started and the
+ * RX FIFO polled until everything came back, which takes a few register
+ * accesses instead of an ioctl, a copy through the spidev bounce buffer and
+ * an interrupt.
+ *
+ * The kernel driver owns the controller and puts it in reset with its
+ * clocks gated when idle, so every transfer first checks that the
+ * controller is still set up and brings it back up if not. Only use this
+ * when nothing else in the system talks to the bus at the same time.
+ *
+ * With RPI_GPIO_SPI_SIM set in the environment the registers are an
+ * in-process model whose MISO is wired to MOSI, for testing without a board.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <linux/spi/spidev.h>
+
+#include "sunxi_spi.h"
+
+#define SUNXI_PAGE_SIZE     4096
+#define SUNXI_CCU_BASE      0x01C20000
+#define SUNXI_SPI0_BASE     0x01C68000  /* SPI1 follows at 0x01C69000 */
+
+/* CCU registers, in bytes */
+#define CCU_BUS_GATING0     0x060       /* bit 20 + bus */
+#define CCU_SPI_CLK         0x0A0       /* + 4 * bus */
+#define CCU_BUS_RST0        0x2C0       /* bit 20 + bus, 1 releases reset */
+#define CCU_SCLK_GATING     (1u << 31)
+#define CCU_OSC24M          24000000u
+#define CCU_PLL_PERIPH0     600000000u
+
+/* SPI registers, in bytes */
+#define SPI_GCR             0x04
+#define SPI_GCR_EN          (1u << 0)
+#define SPI_GCR_MASTER      (1u << 1)
+#define SPI_GCR_TP          (1u << 7)
+#define SPI_GCR_SRST        (1u << 31)
+#define SPI_TCR             0x08
+#define SPI_TCR_CPHA        (1u << 0)
+#define SPI_TCR_CPOL        (1u << 1)
+#define SPI_TCR_SPOL        (1u << 2)   /* chip select active low */
+#define SPI_TCR_SS(cs)      (((cs) & 3) << 4)
+#define SPI_TCR_SS_OWNER    (1u << 6)   /* chip select driven by SS_LEVEL */
+#define SPI_TCR_SS_LEVEL    (1u << 7)
+#define SPI_TCR_FBS         (1u << 12)  /* LSB first */
+#define SPI_TCR_XCH         (1u << 31)
+#define SPI_ISR             0x14
+#define SPI_ISR_TC          (1u << 12)
+#define SPI_FCR             0x18
+#define SPI_FCR_RF_RST      (1u << 15)
+#define SPI_FCR_TF_RST      (1u << 31)
+#define SPI_FSR             0x1C
+#define SPI_FSR_RF_CNT(v)   ((v) & 0xff)
+#define SPI_CCR             0x24
+#define SPI_CCR_DRS         (1u << 12)  /* CDR2: mclk / (2 * (n + 1)) */
+#define SPI_MBC             0x30
+#define SPI_MTC             0x34
+#define SPI_BCC             0x38
+#define SPI_TXD             0x200
+#define SPI_RXD             0x300
+
+/* In-process controller for RPI_GPIO_SPI_SIM */
+struct sunxi_sim {
+    uint32_t regs[SUNXI_PAGE_SIZE / 4];
+    uint32_t ccu[SUNXI_PAGE_SIZE / 4];
+    uint8_t tx[SUNXI_SPI_FIFO];
+    uint8_t rx[SUNXI_SPI_FIFO];
+    unsigned int bus, tx_count, rx_head, rx_count;
+};
+
+struct sunxi_spi {
+    unsigned int bus;
+    int users;
+    pthread_mutex_t lock;
+    volatile uint32_t *regs;
+    volatile uint32_t *ccu;
+    struct sunxi_sim *sim;
+    uint32_t mclk;              /* module clock the divider was set for */
+    uint32_t speed;             /* clock the divider is set for */
+};
+
+static struct sunxi_spi buses[SUNXI_SPI_BUSES] = {
+    { 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { 1, 0, PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+};
+static pthread_mutex_t buses_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The model: TXD writes fill the TX FIFO, XCH clocks MBC bytes out and the
+ * same bytes back into the RX FIFO (zeros past what was queued), RXD reads
+ * drain it. Reset and status bits behave like the hardware.
+ */
+static uint32_t sim_read(struct sunxi_sim *sim, unsigned int reg) {
+    if (reg == SPI_FSR)
+        return sim->rx_count | (sim->tx_count << 16);
+    return sim->regs[reg / 4];
+}
+
+static void sim_write(struct sunxi_sim *sim, unsigned int reg, uint32_t value) {
+    unsigned int i, len;
+
+    switch (reg) {
+    case SPI_GCR:
+        value &= ~SPI_GCR_SRST;
+        break;
+    case SPI_FCR:
+        if (value & SPI_FCR_TF_RST)
+            sim->tx_count = 0;
+        if (value & SPI_FCR_RF_RST)
+            sim->rx_head = sim->rx_count = 0;
+        value &= ~(SPI_FCR_TF_RST | SPI_FCR_RF_RST);
+        break;
+    case SPI_ISR:
+        value = sim->regs[reg / 4] & ~value;
+        break;
+    case SPI_TCR:
+        if (!(value & SPI_TCR_XCH))
+            break;
+        len = sim->regs[SPI_MBC / 4];
+        if (len > SUNXI_SPI_FIFO)
+            len = SUNXI_SPI_FIFO;
+        if (!(sim->regs[SPI_GCR / 4] & SPI_GCR_EN) || !(sim->ccu[CCU_BUS_RST0 / 4] & (1u << (20 + sim->bus))))
+            len = 0;
+        for (i = 0; i < len; i++)
+            sim->rx[(sim->rx_head + sim->rx_count + i) % SUNXI_SPI_FIFO] = i < sim->tx_count ? sim->tx[i] : 0;
+        sim->rx_count += len;
+        sim->tx_count = 0;
+        sim->regs[SPI_ISR / 4] |= SPI_ISR_TC;
+        value &= ~SPI_TCR_XCH;
+        break;
+    }
+    sim->regs[reg / 4] = value;
+}
+
+static inline uint32_t reg_read(struct sunxi_spi *spi, unsigned int reg) {
+    if (spi->sim != NULL)
+        return sim_read(spi->sim, reg);
+    return spi->regs[reg / 4];
+}
+
+static inline void reg_write(struct sunxi_spi *spi, unsigned int reg, uint32_t value) {
+    if (spi->sim != NULL)
+        sim_write(spi->sim, reg, value);
+    else
+        spi->regs[reg / 4] = value;
+}
+
+static inline void fifo_write(struct sunxi_spi *spi, uint8_t value) {
+    if (spi->sim == NULL)
+        *(volatile uint8_t *)((volatile uint8_t *)spi->regs + SPI_TXD) = value;
+    else if (spi->sim->tx_count < SUNXI_SPI_FIFO)
+        spi->sim->tx[spi->sim->tx_count++] = value;
+}
+
+static inline uint8_t fifo_read(struct sunxi_spi *spi) {
+    struct sunxi_sim *sim = spi->sim;
+    uint8_t value = 0;
+
+    if (sim == NULL)
+        return *(volatile uint8_t *)((volatile uint8_t *)spi->regs + SPI_RXD);
+    if (sim->rx_count > 0) {
+        value = sim->rx[sim->rx_head];
+        sim->rx_head = (sim->rx_head + 1) % SUNXI_SPI_FIFO;
+        sim->rx_count--;
+    }
+    return value;
+}
+
+static volatile uint32_t *map_page(int fd, uint32_t phys) {
+    void *map = mmap(NULL, SUNXI_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, phys);
+
+    return map == MAP_FAILED ? NULL : (volatile uint32_t *)map;
+}
+
+/*
+ * Map a controller from devmem, shared by every user of the bus. Returns
+ * NULL with errno set when the registers cannot be mapped.
+ */
+struct sunxi_spi *sunxi_spi_open(unsigned int bus, const char *devmem) {
+    struct sunxi_spi *spi;
+    const char *sim;
+    int fd, err = 0;
+
+    if (bus >= SUNXI_SPI_BUSES) {
+        errno = ENODEV;
+        return NULL;
+    }
+    spi = &buses[bus];
+
+    pthread_mutex_lock(&buses_lock);
+    if (spi->users == 0) {
+        sim = getenv("RPI_GPIO_SPI_SIM");
+        if (sim != NULL && *sim) {
+            if ((spi->sim = calloc(1, sizeof(*spi->sim))) == NULL)
+                err = ENOMEM;
+            else
+                spi->sim->bus = bus;
+        } else if ((fd = open(devmem, O_RDWR|O_SYNC)) < 0) {
+            err = errno;
+        } else {
+            spi->regs = map_page(fd, SUNXI_SPI0_BASE + bus * 0x1000);
+            spi->ccu = map_page(fd, SUNXI_CCU_BASE);
+            if (spi->regs == NULL || spi->ccu == NULL) {
+                err = errno;
+                if (spi->regs != NULL)
+                    munmap((void *)spi->regs, SUNXI_PAGE_SIZE);
+                if (spi->ccu != NULL)
+                    munmap((void *)spi->ccu, SUNXI_PAGE_SIZE);
+                spi->regs = spi->ccu = NULL;
+            }
+            close(fd);
+        }
+        spi->speed = 0;
+    }
+    if (err == 0)
+        spi->users++;
+    pthread_mutex_unlock(&buses_lock);
+
+    if (err) {
+        errno = err;
+        return NULL;
+    }
+    return spi;
+}
+
+void sunxi_spi_close(struct sunxi_spi *spi) {
+    pthread_mutex_lock(&buses_lock);
+    if (--spi->users == 0) {
+        if (spi->sim != NULL) {
+            free(spi->sim);
+            spi->sim = NULL;
+        } else {
+            munmap((void *)spi->regs, SUNXI_PAGE_SIZE);
+            munmap((void *)spi->ccu, SUNXI_PAGE_SIZE);
+            spi->regs = spi->ccu = NULL;
+        }
+    }
+    pthread_mutex_unlock(&buses_lock);
+}
+
+/*
+ * The controller only does 8 bit words, and a burst has to fit in the FIFO
+ * with no per-segment settings. Anything else goes through spidev.
+ */
+int sunxi_spi_fits(const spi_config_t *config, const spi_segment_t *segments, size_t count) {
+    size_t i, total = 0;
+
+    if (config->bits_per_word != 8 || (config->mode & ~(SPI_CPHA | SPI_CPOL | SPI_CS_HIGH | SPI_LSB_FIRST)))
+        return 0;
+    for (i = 0; i < count; i++) {
+        if (segments[i].cs_change || segments[i].delay || segments[i].speed ||
+            (segments[i].bits_per_word && segments[i].bits_per_word != 8))
+            return 0;
+        total += segments[i].len;
+    }
+    return total > 0 && total <= SUNXI_SPI_FIFO;
+}
+
+static inline uint32_t ccu_read(struct sunxi_spi *spi, unsigned int reg) {
+    return spi->sim != NULL ? spi->sim->ccu[reg / 4] : spi->ccu[reg / 4];
+}
+
+static inline void ccu_write(struct sunxi_spi *spi, unsigned int reg, uint32_t value) {
+    if (spi->sim != NULL)
+        spi->sim->ccu[reg / 4] = value;
+    else
+        spi->ccu[reg / 4] = value;
+}
+
+/*
+ * Make sure the controller is clocked, out of reset and enabled as master,
+ * the kernel driver undoes all of that when it suspends the controller
+ */
+static void bring_up(struct sunxi_spi *spi) {
+    uint32_t bit = 1u << (20 + spi->bus), clk, value;
+
+    if (!(ccu_read(spi, CCU_BUS_GATING0) & bit) || !(ccu_read(spi, CCU_BUS_RST0) & bit) ||
+        !(ccu_read(spi, CCU_SPI_CLK + 4 * spi->bus) & CCU_SCLK_GATING)) {
+        ccu_write(spi, CCU_BUS_GATING0, ccu_read(spi, CCU_BUS_GATING0) | bit);
+        ccu_write(spi, CCU_BUS_RST0, ccu_read(spi, CCU_BUS_RST0) | bit);
+        clk = ccu_read(spi, CCU_SPI_CLK + 4 * spi->bus);
+        if (!(clk & CCU_SCLK_GATING))
+            ccu_write(spi, CCU_SPI_CLK + 4 * spi->bus, CCU_SCLK_GATING);    /* OSC24M / 1 */
+        spi->speed = 0;
+    }
+
+    value = reg_read(spi, SPI_GCR);
+    if ((value & (SPI_GCR_EN | SPI_GCR_MASTER | SPI_GCR_TP)) != (SPI_GCR_EN | SPI_GCR_MASTER | SPI_GCR_TP)) {
+        reg_write(spi, SPI_GCR, SPI_GCR_SRST);
+        while (reg_read(spi, SPI_GCR) & SPI_GCR_SRST)
+            ;
+        reg_write(spi, SPI_GCR, SPI_GCR_EN | SPI_GCR_MASTER | SPI_GCR_TP);
+        spi->speed = 0;
+    }
+}
+
+/*
+ * Module clock from the CCU: OSC24M or PLL_PERIPH0 (assumed at its usual
+ * 600 MHz), divided by 2^N and M + 1
+ */
+static uint32_t module_clock(struct sunxi_spi *spi) {
+    uint32_t clk = ccu_read(spi, CCU_SPI_CLK + 4 * spi->bus);
+    uint32_t src = (clk >> 24) & 3 ? CCU_PLL_PERIPH0 : CCU_OSC24M;
+
+    return (src >> ((clk >> 16) & 3)) / ((clk & 0xf) + 1);
+}
+
+static void set_speed(struct sunxi_spi *spi, uint32_t speed) {
+    uint32_t mclk = module_clock(spi), div, n;
+
+    if (spi->speed == speed && spi->mclk == mclk)
+        return;
+
+    /* CDR2 for mclk / 2 down to mclk / 512, past that powers of two */
+    div = (mclk + 2 * speed - 1) / (2 * speed);
+    if (div <= 256) {
+        reg_write(spi, SPI_CCR, SPI_CCR_DRS | (div ? div - 1 : 0));
+    } else {
+        for (n = 0; n < 15 && (mclk >> n) > speed; n++)
+            ;
+        reg_write(spi, SPI_CCR, n << 8);
+    }
+    spi->speed = speed;
+    spi->mclk = mclk;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Run the segments as one burst through the FIFOs, with chip select cs held
+ * for the whole of it. Only call with segments sunxi_spi_fits() accepted.
+ * Returns 0, or -1 with errno set to ETIMEDOUT if the burst never finished.
+ */
+int sunxi_spi_transfer(struct sunxi_spi *spi, unsigned int cs, const spi_config_t *config,
+                       const spi_segment_t *segments, size_t count) {
+    uint32_t tcr, fsr;
+    uint64_t deadline;
+    size_t i, j, len = 0;
+    unsigned int polls = 0;
+    int ret = 0;
+
+    for (i = 0; i < count; i++)
+        len += segments[i].len;
+
+    pthread_mutex_lock(&spi->lock);
+    bring_up(spi);
+    set_speed(spi, config->speed);
+
+    /* idle level first, then select */
+    tcr = SPI_TCR_SS(cs) | SPI_TCR_SS_OWNER;
+    if (config->mode & SPI_CPHA)
+        tcr |= SPI_TCR_CPHA;
+    if (config->mode & SPI_CPOL)
+        tcr |= SPI_TCR_CPOL;
+    if (config->mode & SPI_LSB_FIRST)
+        tcr |= SPI_TCR_FBS;
+    if (!(config->mode & SPI_CS_HIGH))
+        tcr |= SPI_TCR_SPOL | SPI_TCR_SS_LEVEL;
+    reg_write(spi, SPI_TCR, tcr);
+    tcr ^= SPI_TCR_SS_LEVEL;
+    reg_write(spi, SPI_TCR, tcr);
+
+    reg_write(spi, SPI_FCR, SPI_FCR_TF_RST | SPI_FCR_RF_RST);
+    reg_write(spi, SPI_ISR, ~0u);
+    reg_write(spi, SPI_MBC, len);
+    reg_write(spi, SPI_MTC, len);
+    reg_write(spi, SPI_BCC, len);
+    for (i = 0; i < count; i++)
+        for (j = 0; j < segments[i].len; j++)
+            fifo_write(spi, segments[i].tx != NULL ? segments[i].tx[j] : 0);
+    reg_write(spi, SPI_TCR, tcr | SPI_TCR_XCH);
+
+    /* eight clocks a byte, with plenty of slack for a slow bus */
+    deadline = now_ns() + 4 * 8 * 1000000000ULL * len / config->speed + 10000000ULL;
+    while (SPI_FSR_RF_CNT(fsr = reg_read(spi, SPI_FSR)) < len) {
+        if ((++polls & 0xff) == 0 && now_ns() > deadline) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        for (i = 0; i < count; i++)
+            for (j = 0; j < segments[i].len; j++) {
+                uint8_t value = fifo_read(spi);
+
+                if (segments[i].rx != NULL)
+                    segments[i].rx[j] = value;
+            }
+    }
+    reg_write(spi, SPI_TCR, tcr ^ SPI_TCR_SS_LEVEL);
+    pthread_mutex_unlock(&spi->lock);
+
+    if (ret < 0)
+        errno = ETIMEDOUT;
+    return ret;
+}
@@ -0,0 +1,43 @@
+/*
+ *
+ * This file is part of pyA20.
+ * sunxi_spi.h is python SPI extension.
+ *
+ * Copyright (c) 2014 Stefan Mavrodiev @ OLIMEX LTD, <support@olimex.com>
+ *
+ * pyA20 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef _SUNXI_SPI_H
+#define _SUNXI_SPI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spi_lib.h"
+
+#define SUNXI_SPI_BUSES     2
+#define SUNXI_SPI_FIFO      64      /* bytes, the A64 FIFOs are 64 deep */
+
+struct sunxi_spi;
+
+extern struct sunxi_spi *sunxi_spi_open(unsigned int bus, const char *devmem);
+extern void sunxi_spi_close(struct sunxi_spi *spi);
+extern int sunxi_spi_fits(const spi_config_t *config, const spi_segment_t *segments, size_t count);
+extern int sunxi_spi_transfer(struct sunxi_spi *spi, unsigned int cs, const spi_config_t *config,
+                              const spi_segment_t *segments, size_t count);
+
+#endif
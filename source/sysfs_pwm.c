@@ -0,0 +1,212 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include "sysfs_pwm.h"
+
+struct sysfs_pwm
+{
+    char path[512];             // .../pwmchipN
+    unsigned int channel;
+    int period_fd;
+    int duty_fd;
+    int enable_fd;
+    unsigned long long period_ns;
+    unsigned long long duty_ns;
+};
+
+// RPI_GPIO_PWM_SYSFS can point at another directory laid out like
+// /sys/class/pwm, for example a fake tree for testing
+static const char *sysfs_root(void)
+{
+    const char *path = getenv("RPI_GPIO_PWM_SYSFS");
+
+    return (path != NULL && *path) ? path : "/sys/class/pwm";
+}
+
+static int find_chip(uint32_t base, char *path, size_t len)
+// find the pwmchip whose device tree node is <base>.pwm
+{
+    DIR *dir;
+    struct dirent *entry;
+    char link[1024], target[256], node[32];
+    const char *name;
+    ssize_t n;
+    int found = 0;
+
+    snprintf(node, sizeof(node), "%x.pwm", base);
+    if ((dir = opendir(sysfs_root())) == NULL)
+        return 0;
+
+    while (!found && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "pwmchip", 7) != 0)
+            continue;
+        snprintf(link, sizeof(link), "%s/%s/device", sysfs_root(), entry->d_name);
+        if ((n = readlink(link, target, sizeof(target) - 1)) < 0)
+            continue;
+        target[n] = '\0';
+        name = strrchr(target, '/') ? strrchr(target, '/') + 1 : target;
+        if (strcmp(name, node) == 0) {
+            snprintf(path, len, "%s/%s", sysfs_root(), entry->d_name);
+            found = 1;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+static int open_attr(struct sysfs_pwm *pwm, const char *attr)
+{
+    int retry;
+    int fd;
+    struct timespec delay;
+    char filename[1024];
+
+    snprintf(filename, sizeof(filename), "%s/pwm%u/%s", pwm->path, pwm->channel, attr);
+
+    // retry waiting for udev to set correct file permissions after export
+    delay.tv_sec = 0;
+    delay.tv_nsec = 10000000L; // 10ms
+    for (retry=0; retry<100; retry++) {
+        if ((fd = open(filename, O_WRONLY)) >= 0)
+            return fd;
+        nanosleep(&delay, NULL);
+    }
+    return -1;
+}
+
+static int write_attr(int fd, unsigned long long value)
+{
+    char buf[24];
+    int len;
+
+    len = snprintf(buf, sizeof(buf), "%llu\n", value);
+    return pwrite(fd, buf, len, 0) == len ? 0 : -1;
+}
+
+struct sysfs_pwm *sysfs_pwm_open(uint32_t base, unsigned int channel)
+// returns NULL if there is no kernel driver for the controller
+{
+    struct sysfs_pwm *pwm;
+    char filename[1024];
+    int fd, len;
+
+    if ((pwm = malloc(sizeof(struct sysfs_pwm))) == NULL)
+        return NULL;
+    memset(pwm, 0, sizeof(struct sysfs_pwm));
+    pwm->channel = channel;
+    pwm->period_fd = pwm->duty_fd = pwm->enable_fd = -1;
+
+    if (!find_chip(base, pwm->path, sizeof(pwm->path))) {
+        free(pwm);
+        return NULL;
+    }
+
+    // export the channel unless it already is
+    snprintf(filename, sizeof(filename), "%s/pwm%u", pwm->path, channel);
+    if (access(filename, F_OK) != 0) {
+        snprintf(filename, sizeof(filename), "%s/export", pwm->path);
+        if ((fd = open(filename, O_WRONLY)) < 0) {
+            free(pwm);
+            return NULL;
+        }
+        len = snprintf(filename, sizeof(filename), "%u", channel);
+        write(fd, filename, len);
+        close(fd);
+    }
+
+    if ((pwm->period_fd = open_attr(pwm, "period")) < 0 ||
+        (pwm->duty_fd = open_attr(pwm, "duty_cycle")) < 0 ||
+        (pwm->enable_fd = open_attr(pwm, "enable")) < 0) {
+        sysfs_pwm_close(pwm);
+        return NULL;
+    }
+    return pwm;
+}
+
+int sysfs_pwm_config(struct sysfs_pwm *pwm, float freq, float dutycycle)
+{
+    unsigned long long period_ns = (unsigned long long)(1000000000.0 / freq);
+    unsigned long long duty_ns = (unsigned long long)(period_ns * (dutycycle / 100.0));
+
+    // the driver rejects a duty cycle longer than the period at any point
+    if (period_ns < pwm->period_ns) {
+        if (write_attr(pwm->duty_fd, duty_ns) || write_attr(pwm->period_fd, period_ns))
+            return -1;
+    } else {
+        if (write_attr(pwm->period_fd, period_ns) || write_attr(pwm->duty_fd, duty_ns))
+            return -1;
+    }
+    pwm->period_ns = period_ns;
+    pwm->duty_ns = duty_ns;
+    return 0;
+}
+
+int sysfs_pwm_duty(struct sysfs_pwm *pwm, float dutycycle)
+{
+    unsigned long long duty_ns = (unsigned long long)(pwm->period_ns * (dutycycle / 100.0));
+
+    if (write_attr(pwm->duty_fd, duty_ns))
+        return -1;
+    pwm->duty_ns = duty_ns;
+    return 0;
+}
+
+int sysfs_pwm_enable(struct sysfs_pwm *pwm, int enable)
+{
+    return write_attr(pwm->enable_fd, enable ? 1 : 0);
+}
+
+void sysfs_pwm_get(struct sysfs_pwm *pwm, float *freq, float *dutycycle)
+{
+    *freq = pwm->period_ns ? 1000000000.0 / pwm->period_ns : 0.0;
+    *dutycycle = pwm->period_ns ? pwm->duty_ns * 100.0 / pwm->period_ns : 0.0;
+}
+
+void sysfs_pwm_close(struct sysfs_pwm *pwm)
+{
+    char filename[1024];
+    int fd, len;
+
+    if (pwm->enable_fd != -1) {
+        sysfs_pwm_enable(pwm, 0);
+        close(pwm->enable_fd);
+    }
+    if (pwm->duty_fd != -1)
+        close(pwm->duty_fd);
+    if (pwm->period_fd != -1)
+        close(pwm->period_fd);
+
+    snprintf(filename, sizeof(filename), "%s/unexport", pwm->path);
+    if ((fd = open(filename, O_WRONLY)) >= 0) {
+        len = snprintf(filename, sizeof(filename), "%u", pwm->channel);
+        write(fd, filename, len);
+        close(fd);
+    }
+    free(pwm);
+}
@@ -0,0 +1,34 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* PWM through a kernel driver using /sys/class/pwm */
+
+#include <stdint.h>
+
+struct sysfs_pwm;
+
+struct sysfs_pwm *sysfs_pwm_open(uint32_t base, unsigned int channel);
+int sysfs_pwm_config(struct sysfs_pwm *pwm, float freq, float dutycycle);
+int sysfs_pwm_duty(struct sysfs_pwm *pwm, float dutycycle);
+int sysfs_pwm_enable(struct sysfs_pwm *pwm, int enable);
+void sysfs_pwm_get(struct sysfs_pwm *pwm, float *freq, float *dutycycle);
+void sysfs_pwm_close(struct sysfs_pwm *pwm);
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+"""
+Software PWM timing benchmark.
+
+Runs simulated channels through the PWM engine for a range of channel
+counts.  Every register write is timestamped instead of performed, so this
+needs neither a board nor root, and it reports how far the output is from
+what was asked for: edge jitter percentiles, frequency and duty cycle error,
+and the CPU used by the engine thread.
+
+Use --max-p99-us / --max-cpu to fail (exit status 1) when a limit is
+exceeded, e.g. to gate an upgrade.
+"""
+
+import argparse
+import json
+import sys
+
+import RPi.GPIO as GPIO
+
+COLUMNS = [('channels', '%8d'), ('frequency_error', '%10.3f'), ('duty_error', '%8.3f'),
+           ('jitter_p50_us', '%8.1f'), ('jitter_p99_us', '%8.1f'), ('jitter_p999_us', '%8.1f'),
+           ('jitter_max_us', '%8.1f'), ('cpu_percent', '%6.1f')]
+HEADINGS = ['channels', 'freq err', 'duty err', 'p50 us', 'p99 us', 'p99.9 us', 'max us', 'cpu %']
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--channels', default='1,2,4,8,16',
+                        help='comma separated channel counts (default 1,2,4,8,16)')
+    parser.add_argument('--frequency', type=float, default=1000.0, help='Hz (default 1000)')
+    parser.add_argument('--duty', type=float, default=25.0, help='duty cycle (default 25)')
+    parser.add_argument('--seconds', type=float, default=2.0, help='per channel count (default 2)')
+    parser.add_argument('--spin', type=float, default=0.0, help='spin threshold in us (default 0)')
+    parser.add_argument('--priority', type=int, default=0, help='SCHED_FIFO priority (default 0, needs root)')
+    parser.add_argument('--json', action='store_true', help='print the results as JSON')
+    parser.add_argument('--max-p99-us', type=float, help='fail if p99 jitter exceeds this')
+    parser.add_argument('--max-cpu', type=float, help='fail if the engine uses more CPU percent than this')
+    args = parser.parse_args()
+
+    GPIO.set_pwm_spin(args.spin)
+    if args.priority:
+        GPIO.set_pwm_priority(args.priority)
+
+    results = []
+    for channels in [int(n) for n in args.channels.split(',')]:
+        results.append(GPIO.pwm_benchmark(channels, args.frequency, args.duty, args.seconds))
+
+    if args.json:
+        print(json.dumps(results, indent=2, sort_keys=True))
+    else:
+        print('%.1f Hz, %.1f%% duty, spin %.1f us, priority %d' %
+              (args.frequency, args.duty, args.spin, args.priority))
+        print(' '.join('%*s' % (len(fmt % 0), h) for (key, fmt), h in zip(COLUMNS, HEADINGS)))
+        for r in results:
+            print(' '.join(fmt % r[key] for key, fmt in COLUMNS))
+
+    failed = False
+    for r in results:
+        if r['dropped']:
+            sys.stderr.write('%d channels: %d writes not recorded\n' % (r['channels'], r['dropped']))
+        if args.max_p99_us is not None and r['jitter_p99_us'] > args.max_p99_us:
+            sys.stderr.write('%d channels: p99 jitter %.1f us over %.1f us\n' %
+                             (r['channels'], r['jitter_p99_us'], args.max_p99_us))
+            failed = True
+        if args.max_cpu is not None and r['cpu_percent'] > args.max_cpu:
+            sys.stderr.write('%d channels: engine CPU %.1f%% over %.1f%%\n' %
+                             (r['channels'], r['cpu_percent'], args.max_cpu))
+            failed = True
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
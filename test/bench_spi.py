@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+"""
+SPI throughput benchmark.
+
+Times read, write, xfer, a four segment transaction and a 16 bit word
+transfer at a range of sizes and reports calls and bytes per second.  With --mock the spidev
+loopback of mockdev.py stands in for the kernel, so this runs
+without a board and measures the cost of the Python and C layers alone; it
+also counts the SPI_IOC_MESSAGE calls each operation made.
+
+Use --check to fail (exit status 1) when an operation needs more messages
+than spidev's bufsiz requires, which catches chunking regressions.
+"""
+
+import argparse
+import array
+import json
+import os
+import sys
+import time
+
+COLUMNS = [('op', '%-8s'), ('size', '%8d'), ('calls_per_sec', '%12.0f'),
+           ('mbytes_per_sec', '%10.2f'), ('messages_per_call', '%9.2f')]
+HEADINGS = ('op', 'size', 'calls/s', 'MB/s', 'msgs/call')
+
+def operations(dev, size):
+    data = os.urandom(size)
+    quarter = max(size // 4, 1)
+    segments = [data[:quarter], {'tx': data[quarter:2 * quarter], 'rx': quarter},
+                {'rx': quarter}, data[3 * quarter:]]
+    buf = bytearray(size)
+    words = array.array('H', data[:size // 2 * 2])
+    return [('read', lambda: dev.read(size)),
+            ('readinto', lambda: dev.readinto(buf)),
+            ('write', lambda: dev.write(data)),
+            ('xfer', lambda: dev.xfer(data, size)),
+            ('transfer', lambda: dev.transfer(segments)),
+            ('xfer16', lambda: dev.xfer_words(words, len(words)))]
+
+def run(dev, op, func, size, seconds, mock):
+    if mock:
+        mock.spidev_stats(reset=True)
+    calls = 0
+    start = time.time()
+    end = start + seconds
+    while True:
+        for i in range(16):
+            func()
+        calls += 16
+        now = time.time()
+        if now >= end:
+            break
+    elapsed = now - start
+    result = {'op': op, 'size': size, 'calls': calls,
+              'calls_per_sec': calls / elapsed,
+              'mbytes_per_sec': calls * size / elapsed / 1e6,
+              'messages_per_call': 0.0}
+    if mock:
+        result['messages_per_call'] = mock.spidev_stats()['messages'] / float(calls)
+    return result
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--device', default='/dev/spidev0.0', help='spidev node (default /dev/spidev0.0)')
+    parser.add_argument('--speed', type=int, default=10000000, help='clock in Hz (default 10000000)')
+    parser.add_argument('--sizes', default='4,64,1024,4096,65536',
+                        help='comma separated transfer sizes in bytes (default 4,64,1024,4096,65536)')
+    parser.add_argument('--seconds', type=float, default=0.5, help='per operation and size (default 0.5)')
+    parser.add_argument('--mock', action='store_true', help='use the spidev loopback of mockdev.py')
+    parser.add_argument('--bufsiz', type=int, default=4096, help='bufsiz of the mock (default 4096)')
+    parser.add_argument('--direct', action='store_true', help='run FIFO sized transfers on the registers')
+    parser.add_argument('--json', action='store_true', help='print the results as JSON')
+    parser.add_argument('--check', action='store_true',
+                        help='with --mock, fail if an operation used more messages than bufsiz requires')
+    args = parser.parse_args()
+
+    mock = None
+    if args.mock:
+        import mockdev
+        mockdev.preload(spidev_bufsiz=args.bufsiz)
+        mock = mockdev
+        if args.direct:
+            os.environ['RPI_GPIO_SPI_SIM'] = '1'
+    from RPi import SPI
+
+    dev = SPI.Device(args.device, speed=args.speed, direct=args.direct)
+    results = []
+    for size in [int(n) for n in args.sizes.split(',')]:
+        for op, func in operations(dev, size):
+            results.append(run(dev, op, func, size, args.seconds, mock))
+    dev.close()
+
+    if args.json:
+        print(json.dumps(results, indent=2, sort_keys=True))
+    else:
+        print('%s, %d Hz%s%s' % (args.device, args.speed, ', mock bufsiz %d' % args.bufsiz if args.mock else '',
+                                  ', direct' if args.direct else ''))
+        print('%-8s %8s %12s %10s %9s' % tuple(HEADINGS))
+        for r in results:
+            print(' '.join(fmt % r[key] for key, fmt in COLUMNS))
+
+    failed = False
+    if args.check and args.mock:
+        for r in results:
+            # FIFO sized transfers on the registers need no message at all
+            needed = (r['size'] + args.bufsiz - 1) // args.bufsiz
+            if args.direct and r['size'] <= 64:
+                needed = 0
+            if r['messages_per_call'] > needed:
+                sys.stderr.write('%s %d bytes: %.2f messages per call, %d needed\n' %
+                                 (r['op'], r['size'], r['messages_per_call'], needed))
+                failed = True
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,234 @@
+/*
+ * The libc calls the mock replaces: opens of a mocked node get a descriptor
+ * on /dev/null that the mock tracks, ioctls on it go to the node, and so do
+ * reads and writes when the node is an i2c-dev one. A gpio value file gets
+ * a descriptor of its own that poll() sees as the sysfs one, and the other
+ * sysfs gpio files are /dev/null. The spidev module parameters read back as
+ * the mock configures them. Everything else passes through.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "devmock.h"
+
+static struct devmock_node nodes[DEVMOCK_NODES];
+static struct devmock_node *fds[DEVMOCK_FDS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define REAL(name) \
+    static __typeof__(name) *real; \
+    if (real == NULL) \
+        real = (__typeof__(name) *)dlsym(RTLD_NEXT, #name)
+
+struct devmock_node *devmock_fd_node(int fd) {
+    return fd >= 0 && fd < DEVMOCK_FDS ? __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE) : NULL;
+}
+
+struct devmock_node *devmock_node_get(const char *path) {
+    struct devmock_node *node = NULL;
+    int kind, i;
+
+    if (path == NULL || strlen(path) >= sizeof(node->path))
+        return NULL;
+    if ((kind = spidev_match(path)) == DEVMOCK_NONE && (kind = i2c_match(path)) == DEVMOCK_NONE &&
+        (kind = gpio_match(path)) == DEVMOCK_NONE)
+        return NULL;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < DEVMOCK_NODES && nodes[i].kind != DEVMOCK_NONE; i++) {
+        if (strcmp(nodes[i].path, path) == 0)
+            break;
+    }
+    if (i < DEVMOCK_NODES) {
+        node = &nodes[i];
+        if (node->kind == DEVMOCK_NONE) {
+            strcpy(node->path, path);
+            node->kind = kind;
+            if (kind == DEVMOCK_SPIDEV)
+                spidev_node_init(node);
+            else if (kind == DEVMOCK_I2C)
+                i2c_node_init(node);
+            else
+                gpio_node_init(node);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return node;
+}
+
+static int track(int fd, struct devmock_node *node) {
+    if (fd >= 0 && node != NULL) {
+        if (fd >= DEVMOCK_FDS) {
+            close(fd);
+            errno = EMFILE;
+            return -1;
+        }
+        __atomic_store_n(&fds[fd], node, __ATOMIC_RELEASE);
+    }
+    return fd;
+}
+
+void devmock_node_each_fd(struct devmock_node *node, void (*fn)(int fd, void *arg), void *arg) {
+    int fd;
+
+    for (fd = 0; fd < DEVMOCK_FDS; fd++)
+        if (__atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE) == node)
+            fn(fd, arg);
+}
+
+static int open_node(struct devmock_node *node, int flags) {
+    REAL(open);
+
+    if (node->kind == DEVMOCK_GPIO)
+        return track(gpio_open(flags), node);
+    return track(real("/dev/null", O_RDWR | (flags & O_CLOEXEC)), node);
+}
+
+int open(const char *path, int flags, ...) {
+    struct devmock_node *node = devmock_node_get(path);
+    mode_t mode = 0;
+    va_list ap;
+    REAL(open);
+
+    if (node != NULL)
+        return open_node(node, flags);
+    if (gpio_sysfs(path))
+        path = "/dev/null";
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return real(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+    struct devmock_node *node = devmock_node_get(path);
+    mode_t mode = 0;
+    va_list ap;
+    REAL(open64);
+
+    if (node != NULL)
+        return open_node(node, flags);
+    if (gpio_sysfs(path))
+        path = "/dev/null";
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return real(path, flags, mode);
+}
+
+FILE *fopen(const char *path, const char *how) {
+    static char bufsiz[24];
+    REAL(fopen);
+
+    if (path != NULL && strcmp(path, "/sys/module/spidev/parameters/bufsiz") == 0) {
+        snprintf(bufsiz, sizeof(bufsiz), "%lu\n", (unsigned long)spidev_bufsiz());
+        return fmemopen(bufsiz, strlen(bufsiz), "r");
+    }
+    return real(path, how);
+}
+
+int close(int fd) {
+    REAL(close);
+
+    if (fd >= 0 && fd < DEVMOCK_FDS)
+        __atomic_store_n(&fds[fd], NULL, __ATOMIC_RELEASE);
+    return real(fd);
+}
+
+int dup(int fd) {
+    REAL(dup);
+
+    return track(real(fd), devmock_fd_node(fd));
+}
+
+int dup2(int fd, int fd2) {
+    REAL(dup2);
+
+    if (fd2 >= 0 && fd2 < DEVMOCK_FDS && fd2 != fd)
+        __atomic_store_n(&fds[fd2], NULL, __ATOMIC_RELEASE);
+    return track(real(fd, fd2), devmock_fd_node(fd));
+}
+
+ssize_t read(int fd, void *buffer, size_t len) {
+    struct devmock_node *node = devmock_fd_node(fd);
+    REAL(read);
+
+    if (node != NULL && node->kind == DEVMOCK_I2C)
+        return i2c_rw(fd, 1, buffer, len);
+    if (node != NULL && node->kind == DEVMOCK_GPIO)
+        return gpio_read(node, fd, buffer, len);
+    return real(fd, buffer, len);
+}
+
+ssize_t write(int fd, const void *buffer, size_t len) {
+    struct devmock_node *node = devmock_fd_node(fd);
+    REAL(write);
+
+    if (node != NULL && node->kind == DEVMOCK_I2C)
+        return i2c_rw(fd, 0, (void *)buffer, len);
+    return real(fd, buffer, len);
+}
+
+/* A gpio value file is ready with POLLPRI | POLLERR after an edge, where the
+ * eventfd standing in for it is readable */
+int poll(struct pollfd *fds, nfds_t n, int timeout) {
+    struct devmock_node *node;
+    short events[n > 0 ? n : 1];
+    int gpio = 0, ret;
+    nfds_t i;
+    REAL(poll);
+
+    for (i = 0; i < n; i++) {
+        events[i] = fds[i].events;
+        if ((node = devmock_fd_node(fds[i].fd)) != NULL && node->kind == DEVMOCK_GPIO) {
+            fds[i].events |= POLLIN;
+            gpio = 1;
+        }
+    }
+    ret = real(fds, n, timeout);
+    for (i = 0; gpio && i < n; i++) {
+        fds[i].events = events[i];
+        if ((node = devmock_fd_node(fds[i].fd)) != NULL && node->kind == DEVMOCK_GPIO &&
+            (fds[i].revents & POLLIN))
+            fds[i].revents |= POLLPRI | POLLERR;
+    }
+    return ret;
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    struct devmock_node *node = devmock_fd_node(fd);
+    void *arg;
+    va_list ap;
+    REAL(ioctl);
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (node == NULL)
+        return real(fd, request, arg);
+    switch (node->kind) {
+    case DEVMOCK_SPIDEV:
+        return spidev_ioctl(node, request, arg);
+    case DEVMOCK_I2C:
+        return i2c_ioctl(fd, request, arg);
+    }
+    errno = ENOTTY;
+    return -1;
+}
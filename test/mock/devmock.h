@@ -0,0 +1,74 @@
+/*
+ * Device mock for the tests, preloaded into the Python running them (see
+ * test/mockdev.py). It answers for the device nodes the extensions open,
+ * so the tests need neither a board nor root, and keeps the test doubles
+ * out of the extensions themselves.
+ */
+
+#ifndef _DEVMOCK_H
+#define _DEVMOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DEVMOCK_FDS         1024
+#define DEVMOCK_NODES       16
+
+enum devmock_kind {
+    DEVMOCK_NONE,
+    DEVMOCK_SPIDEV,
+    DEVMOCK_I2C,
+    DEVMOCK_GPIO,
+};
+
+struct flash;
+struct spi_ioc_transfer;
+
+/* A mocked device node, shared by every descriptor open on it the way the
+ * kernel shares one spi_device between the opens of a spidev node */
+struct devmock_node {
+    char path[64];
+    int kind;
+    uint8_t mode;
+    uint8_t bits;
+    uint32_t speed;
+    struct flash *flash;        /* answers in place of the loopback */
+    int counter;                /* or a count of the bytes clocked so far */
+    uint8_t count;
+    int value;                  /* level of a gpio value file */
+};
+
+/* The node a mocked descriptor is open on, NULL for any other descriptor */
+extern struct devmock_node *devmock_fd_node(int fd);
+/* The node of path, set up on first use, NULL if path is not mocked */
+extern struct devmock_node *devmock_node_get(const char *path);
+/* Call fn with every descriptor open on node, and arg */
+extern void devmock_node_each_fd(struct devmock_node *node, void (*fn)(int fd, void *arg), void *arg);
+
+/* The kind of node path names, DEVMOCK_NONE if it is not mocked */
+extern int spidev_match(const char *path);
+extern void spidev_node_init(struct devmock_node *node);
+extern int spidev_ioctl(struct devmock_node *node, unsigned long request, void *arg);
+/* Contents of /sys/module/spidev/parameters/bufsiz */
+extern size_t spidev_bufsiz(void);
+
+extern int i2c_match(const char *path);
+extern void i2c_node_init(struct devmock_node *node);
+extern int i2c_ioctl(int fd, unsigned long request, void *arg);
+/* read() and write() of a descriptor open on an i2c-dev node */
+extern ssize_t i2c_rw(int fd, int read, void *buffer, size_t len);
+
+extern int gpio_match(const char *path);
+/* Whether path is one of the other /sys/class/gpio files */
+extern int gpio_sysfs(const char *path);
+extern void gpio_node_init(struct devmock_node *node);
+/* A descriptor for a new open of a value file */
+extern int gpio_open(int flags);
+extern ssize_t gpio_read(struct devmock_node *node, int fd, void *buffer, size_t len);
+
+/* The flash configured for path, NULL if there is none */
+extern struct flash *flash_open(const char *path);
+extern void flash_message(struct flash *f, struct spi_ioc_transfer *batch, size_t n);
+
+#endif
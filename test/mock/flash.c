@@ -0,0 +1,188 @@
+/*
+ * A 25-series NOR flash behind a spidev node in place of the loopback.
+ * DEVMOCK_SPIDEV_FLASH=<node>:<size> puts one of size bytes behind node. It
+ * answers JEDEC ID, status, write enable, read and fast read, page program
+ * and the 4K and 64K erases, with the 4-byte address forms of the last four,
+ * and stays busy for a couple of status polls after a program or an erase,
+ * or until BUSY_NS has passed if the polls are late, so a test descheduled
+ * for longer than the driver's timeout does not see a part that never
+ * finishes. Commands other than a status read are ignored while it is
+ * busy, as real parts do.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/spi/spidev.h>
+
+#include "devmock.h"
+
+#define BUSY_NS             5000000LL
+
+struct flash {
+    uint8_t *mem;
+    size_t size;
+    uint8_t cmd;
+    size_t pos;
+    uint32_t addr;
+    int wel;
+    int busy;
+    long long busy_until;
+};
+
+struct flash *flash_open(const char *path) {
+    const char *value = getenv("DEVMOCK_SPIDEV_FLASH");
+    const char *colon;
+    unsigned long size;
+    struct flash *f;
+    char *end;
+
+    if (value == NULL || (colon = strrchr(value, ':')) == NULL)
+        return NULL;
+    if (strlen(path) != (size_t)(colon - value) || strncmp(path, value, colon - value) != 0)
+        return NULL;
+    size = strtoul(colon + 1, &end, 0);
+    /* a power of two the JEDEC capacity byte can describe */
+    if (*end != '\0' || size < 65536 || (size & (size - 1)) != 0)
+        return NULL;
+    if ((f = calloc(1, sizeof(*f))) == NULL)
+        return NULL;
+    if ((f->mem = malloc(size)) == NULL) {
+        free(f);
+        return NULL;
+    }
+    memset(f->mem, 0xFF, size);
+    f->size = size;
+    return f;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void flash_busy(struct flash *f, int polls) {
+    f->busy = polls;
+    f->busy_until = now_ns() + BUSY_NS;
+}
+
+static unsigned int flash_address_bytes(uint8_t cmd) {
+    switch (cmd) {
+    case 0x03: case 0x0B: case 0x02: case 0x20: case 0xD8:
+        return 3;
+    case 0x13: case 0x0C: case 0x12: case 0x21: case 0xDC:
+        return 4;
+    }
+    return 0;
+}
+
+static uint8_t flash_byte(struct flash *f, uint8_t in) {
+    unsigned int na = flash_address_bytes(f->cmd);
+    size_t pos = f->pos++;
+    uint32_t addr;
+
+    if (pos == 0) {
+        f->cmd = in;
+        f->addr = 0;
+        return 0xFF;
+    }
+    if (f->cmd == 0x05) {
+        uint8_t status;
+
+        if (f->busy && now_ns() >= f->busy_until)
+            f->busy = 0;
+        status = (f->busy ? 0x01 : 0) | (f->wel ? 0x02 : 0);
+
+        if (f->busy)
+            f->busy--;
+        return status;
+    }
+    if (f->busy)
+        return 0xFF;
+    if (f->cmd == 0x9F) {
+        /* Winbond, with the capacity byte log2 of the size */
+        const uint8_t id[3] = {0xEF, 0x40, (uint8_t)__builtin_ctzl(f->size)};
+
+        return id[(pos - 1) % 3];
+    }
+    if (na == 0)
+        return 0xFF;
+    if (pos <= na) {
+        f->addr = f->addr << 8 | in;
+        return 0xFF;
+    }
+    /* fast read has a dummy byte after the address */
+    if ((f->cmd == 0x0B || f->cmd == 0x0C) && pos == na + 1)
+        return 0xFF;
+
+    switch (f->cmd) {
+    case 0x03: case 0x13:
+        return f->mem[(f->addr + (pos - na - 1)) & (f->size - 1)];
+    case 0x0B: case 0x0C:
+        return f->mem[(f->addr + (pos - na - 2)) & (f->size - 1)];
+    case 0x02: case 0x12:
+        /* programming only clears bits, and wraps within the page */
+        if (f->wel) {
+            addr = (f->addr & ~0xFFu) | ((f->addr + (pos - na - 1)) & 0xFF);
+            f->mem[addr & (f->size - 1)] &= in;
+        }
+        return 0xFF;
+    }
+    return 0xFF;
+}
+
+static void flash_deselect(struct flash *f) {
+    unsigned int na = flash_address_bytes(f->cmd);
+    size_t block;
+
+    if (f->pos > 0 && !f->busy) {
+        switch (f->cmd) {
+        case 0x06:
+            f->wel = 1;
+            break;
+        case 0x04:
+            f->wel = 0;
+            break;
+        case 0x02: case 0x12:
+            if (f->wel && f->pos > na + 1)
+                flash_busy(f, 2);
+            f->wel = 0;
+            break;
+        case 0x20: case 0x21: case 0xD8: case 0xDC:
+            if (f->wel && f->pos == na + 1) {
+                block = f->cmd == 0x20 || f->cmd == 0x21 ? 4096 : 65536;
+                memset(f->mem + ((f->addr & (f->size - 1)) & ~(block - 1)), 0xFF, block);
+                flash_busy(f, 3);
+            }
+            f->wel = 0;
+            break;
+        }
+    }
+    f->pos = 0;
+}
+
+/* Clock the bytes of a message through the flash model, tracking chip
+ * select the way spidev drives it */
+void flash_message(struct flash *f, struct spi_ioc_transfer *batch, size_t n) {
+    const uint8_t *tx;
+    uint8_t *rx;
+    size_t i, j;
+
+    for (i = 0; i < n; i++) {
+        tx = (const uint8_t *)(uintptr_t)batch[i].tx_buf;
+        rx = (uint8_t *)(uintptr_t)batch[i].rx_buf;
+        for (j = 0; j < batch[i].len; j++) {
+            uint8_t out = flash_byte(f, tx ? tx[j] : 0);
+
+            if (rx)
+                rx[j] = out;
+        }
+        if (batch[i].cs_change && i + 1 < n)
+            flash_deselect(f);
+    }
+    if (n > 0 && !batch[n-1].cs_change)
+        flash_deselect(f);
+}
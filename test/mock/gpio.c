@@ -0,0 +1,92 @@
+/*
+ * sysfs gpio: the export, unexport, direction and edge files take whatever
+ * is written to them, and each gpioN/value file is an eventfd that
+ * devmock_gpio_edge() signals, so it polls the way the real file does:
+ * ready as soon as it is opened and again after every edge, until it is
+ * read. The test decides which edges happen, the edge file is not looked
+ * at. A read gives the level the last edge left.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#include "devmock.h"
+
+#define SYSFS_GPIO          "/sys/class/gpio/"
+
+int gpio_match(const char *path) {
+    unsigned int gpio;
+    int end = 0;
+
+    if (sscanf(path, SYSFS_GPIO "gpio%u/value%n", &gpio, &end) == 1 && path[end] == '\0')
+        return DEVMOCK_GPIO;
+    return DEVMOCK_NONE;
+}
+
+int gpio_sysfs(const char *path) {
+    return path != NULL && strncmp(path, SYSFS_GPIO, strlen(SYSFS_GPIO)) == 0;
+}
+
+void gpio_node_init(struct devmock_node *node) {
+    node->value = 0;
+}
+
+int gpio_open(int flags) {
+    return eventfd(1, EFD_NONBLOCK | (flags & O_CLOEXEC ? EFD_CLOEXEC : 0));
+}
+
+ssize_t gpio_read(struct devmock_node *node, int fd, void *buffer, size_t len) {
+    char value[2] = {__atomic_load_n(&node->value, __ATOMIC_ACQUIRE) ? '1' : '0', '\n'};
+    eventfd_t count;
+
+    /* rearm, eventfd_read() does not come back through the read() of the
+     * mock */
+    eventfd_read(fd, &count);
+    if (len > sizeof(value))
+        len = sizeof(value);
+    memcpy(buffer, value, len);
+    return len;
+}
+
+static struct devmock_node *value_node(unsigned int gpio) {
+    char path[64];
+
+    snprintf(path, sizeof(path), SYSFS_GPIO "gpio%u/value", gpio);
+    return devmock_node_get(path);
+}
+
+static void edge(int fd, void *arg) {
+    eventfd_write(fd, 1);
+}
+
+static void pending(int fd, void *arg) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    if (poll(&pfd, 1, 0) > 0)
+        *(int *)arg = 1;
+}
+
+/* Leave the value of gpio at value and wake every descriptor open on it */
+void devmock_gpio_edge(unsigned int gpio, int value) {
+    struct devmock_node *node = value_node(gpio);
+
+    if (node == NULL)
+        return;
+    __atomic_store_n(&node->value, value != 0, __ATOMIC_RELEASE);
+    devmock_node_each_fd(node, edge, NULL);
+}
+
+/* Whether a descriptor open on the value file of gpio has not read the
+ * last edge, or the opening, yet */
+int devmock_gpio_pending(unsigned int gpio) {
+    struct devmock_node *node = value_node(gpio);
+    int ready = 0;
+
+    if (node != NULL)
+        devmock_node_each_fd(node, pending, &ready);
+    return ready;
+}
@@ -0,0 +1,166 @@
+/*
+ * i2c-dev bus with a chip at each address of DEVMOCK_I2C_CHIPS=<address>
+ * [,<address>...], the way the i2c-stub module does: 256 byte registers and
+ * a register pointer that the first byte of a write sets and that every
+ * byte written or read advances. Nothing acknowledges other addresses, so
+ * a message to one fails with ENXIO and the rest of its I2C_RDWR is not
+ * sent. Requests are checked the way i2c-dev checks them. Every /dev/i2c-*
+ * node is the same bus.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "devmock.h"
+
+#define CHIPS               10
+#define RDWR_MAX_MSGS       42
+#define MAX_MSG_LEN         8192
+
+struct chip {
+    uint16_t address;
+    uint8_t pointer;
+    uint8_t regs[256];
+};
+
+struct devmock_i2c_stats {
+    uint64_t transactions;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t rejected;
+};
+
+static struct chip chips[CHIPS];
+static size_t chip_count = (size_t)-1;
+static uint16_t slaves[DEVMOCK_FDS];    /* I2C_SLAVE of each descriptor */
+static struct devmock_i2c_stats counts;
+static pthread_mutex_t bus = PTHREAD_MUTEX_INITIALIZER;
+
+int i2c_match(const char *path) {
+    return strncmp(path, "/dev/i2c-", 9) == 0 ? DEVMOCK_I2C : DEVMOCK_NONE;
+}
+
+/* Called with the node table locked, so the chips are set up once */
+void i2c_node_init(struct devmock_node *node) {
+    const char *value;
+    char *end;
+    unsigned long address;
+
+    if (chip_count != (size_t)-1)
+        return;
+    chip_count = 0;
+    value = getenv("DEVMOCK_I2C_CHIPS");
+    while (value != NULL && *value && chip_count < CHIPS) {
+        address = strtoul(value, &end, 0);
+        if (end == value || address > 0x7f)
+            break;
+        chips[chip_count++].address = address;
+        if (*end != ',')
+            break;
+        value = end + 1;
+    }
+}
+
+/* Counters of every i2c transaction, cleared after reading if reset is set */
+void devmock_i2c_stats(struct devmock_i2c_stats *stats, int reset) {
+    if (reset) {
+        stats->transactions = __atomic_exchange_n(&counts.transactions, 0, __ATOMIC_RELAXED);
+        stats->messages = __atomic_exchange_n(&counts.messages, 0, __ATOMIC_RELAXED);
+        stats->bytes = __atomic_exchange_n(&counts.bytes, 0, __ATOMIC_RELAXED);
+        stats->rejected = __atomic_exchange_n(&counts.rejected, 0, __ATOMIC_RELAXED);
+    } else {
+        stats->transactions = __atomic_load_n(&counts.transactions, __ATOMIC_RELAXED);
+        stats->messages = __atomic_load_n(&counts.messages, __ATOMIC_RELAXED);
+        stats->bytes = __atomic_load_n(&counts.bytes, __ATOMIC_RELAXED);
+        stats->rejected = __atomic_load_n(&counts.rejected, __ATOMIC_RELAXED);
+    }
+}
+
+static struct chip *chip_at(uint16_t address) {
+    size_t i;
+
+    for (i = 0; i < chip_count; i++)
+        if (chips[i].address == address)
+            return &chips[i];
+    return NULL;
+}
+
+/* Run the messages up to the first one nobody acknowledges, as a bus
+ * driver does; returns the number of messages or -1 */
+static int transfer(struct i2c_msg *msgs, size_t count) {
+    struct chip *chip;
+    size_t i, j, total = 0;
+
+    if (count == 0 || count > RDWR_MAX_MSGS)
+        goto invalid;
+    for (i = 0; i < count; i++)
+        if (msgs[i].len > MAX_MSG_LEN || (msgs[i].len > 0 && msgs[i].buf == NULL))
+            goto invalid;
+
+    __atomic_add_fetch(&counts.transactions, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&bus);
+    for (i = 0; i < count; i++) {
+        if ((chip = chip_at(msgs[i].addr)) == NULL) {
+            pthread_mutex_unlock(&bus);
+            __atomic_add_fetch(&counts.rejected, 1, __ATOMIC_RELAXED);
+            errno = ENXIO;
+            return -1;
+        }
+        j = 0;
+        if (msgs[i].flags & I2C_M_RD) {
+            for (; j < msgs[i].len; j++)
+                msgs[i].buf[j] = chip->regs[chip->pointer++];
+        } else if (msgs[i].len > 0) {
+            chip->pointer = msgs[i].buf[j++];
+            for (; j < msgs[i].len; j++)
+                chip->regs[chip->pointer++] = msgs[i].buf[j];
+        }
+        total += msgs[i].len;
+        __atomic_add_fetch(&counts.messages, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&bus);
+    __atomic_add_fetch(&counts.bytes, total, __ATOMIC_RELAXED);
+    return count;
+
+invalid:
+    __atomic_add_fetch(&counts.rejected, 1, __ATOMIC_RELAXED);
+    errno = EINVAL;
+    return -1;
+}
+
+int i2c_ioctl(int fd, unsigned long request, void *arg) {
+    struct i2c_rdwr_ioctl_data *data;
+
+    switch (request) {
+    case I2C_SLAVE:
+    case I2C_SLAVE_FORCE:
+        if ((uintptr_t)arg > 0x7f) {
+            errno = EINVAL;
+            return -1;
+        }
+        slaves[fd] = (uintptr_t)arg;
+        return 0;
+    case I2C_RDWR:
+        data = arg;
+        return transfer(data->msgs, data->nmsgs);
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+/* read() and write() are one message to the I2C_SLAVE address */
+ssize_t i2c_rw(int fd, int read, void *buffer, size_t len) {
+    struct i2c_msg msg = {slaves[fd], read ? I2C_M_RD : 0, len, buffer};
+
+    if (len > MAX_MSG_LEN)
+        len = msg.len = MAX_MSG_LEN;
+    if (len == 0)
+        return 0;
+    return transfer(&msg, 1) < 0 ? -1 : (ssize_t)len;
+}
@@ -0,0 +1,186 @@
+/*
+ * spidev loopback: MISO is wired to MOSI, unless flash.c models a device
+ * behind the node or the node is DEVMOCK_SPIDEV_COUNTER, which answers with
+ * a count of the bytes clocked so far, the way a sampling ADC gives a new
+ * value for every frame. Messages are checked the way
+ * spidev and the SPI core check them, so one whose transmit or receive
+ * total is over bufsiz fails with EMSGSIZE, and a transfer that ends
+ * mid-word with EINVAL. DEVMOCK_SPIDEV_BUFSIZ sets the bufsiz to emulate,
+ * 4096 by default. The bytes the last message put on MOSI are kept in the
+ * order they were clocked out, each word most significant bit first.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "devmock.h"
+
+struct devmock_spidev_stats {
+    uint64_t messages;
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t rejected;
+};
+
+#define WIRE_MAX            65536
+
+static struct devmock_spidev_stats counts;
+static uint8_t wire[WIRE_MAX];
+static size_t wire_len;
+static pthread_mutex_t wire_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Nodes named spidev* are mocked, whether or not they look like spidevB.C */
+int spidev_match(const char *path) {
+    const char *name = strrchr(path, '/');
+
+    return strncmp(name != NULL ? name + 1 : path, "spidev", 6) == 0 ? DEVMOCK_SPIDEV : DEVMOCK_NONE;
+}
+
+void spidev_node_init(struct devmock_node *node) {
+    const char *value;
+
+    node->mode = 0;
+    node->bits = 8;
+    node->speed = 500000;
+    node->flash = flash_open(node->path);
+    node->counter = (value = getenv("DEVMOCK_SPIDEV_COUNTER")) != NULL && strcmp(value, node->path) == 0;
+    node->count = 0;
+}
+
+size_t spidev_bufsiz(void) {
+    static size_t bufsiz = 0;
+    const char *value;
+    unsigned long n;
+    char *end;
+
+    if (bufsiz == 0) {
+        bufsiz = 4096;
+        if ((value = getenv("DEVMOCK_SPIDEV_BUFSIZ")) != NULL && (n = strtoul(value, &end, 0)) > 1 && *end == '\0')
+            bufsiz = n;
+    }
+    return bufsiz;
+}
+
+/* Counters of every spidev message, cleared after reading if reset is set */
+void devmock_spidev_stats(struct devmock_spidev_stats *stats, int reset) {
+    if (reset) {
+        stats->messages = __atomic_exchange_n(&counts.messages, 0, __ATOMIC_RELAXED);
+        stats->transfers = __atomic_exchange_n(&counts.transfers, 0, __ATOMIC_RELAXED);
+        stats->bytes = __atomic_exchange_n(&counts.bytes, 0, __ATOMIC_RELAXED);
+        stats->rejected = __atomic_exchange_n(&counts.rejected, 0, __ATOMIC_RELAXED);
+    } else {
+        stats->messages = __atomic_load_n(&counts.messages, __ATOMIC_RELAXED);
+        stats->transfers = __atomic_load_n(&counts.transfers, __ATOMIC_RELAXED);
+        stats->bytes = __atomic_load_n(&counts.bytes, __ATOMIC_RELAXED);
+        stats->rejected = __atomic_load_n(&counts.rejected, __ATOMIC_RELAXED);
+    }
+}
+
+static size_t word_bytes(unsigned int bits) {
+    return bits <= 8 ? 1 : bits <= 16 ? 2 : 4;
+}
+
+/* Shift out the native words of each transfer, highest byte first */
+static void clock_out(struct devmock_node *node, const struct spi_ioc_transfer *batch, size_t n) {
+    const uint8_t *tx;
+    size_t i, j, k, width;
+
+    pthread_mutex_lock(&wire_lock);
+    wire_len = 0;
+    for (i = 0; i < n; i++) {
+        tx = (const uint8_t *)(uintptr_t)batch[i].tx_buf;
+        width = word_bytes(batch[i].bits_per_word ? batch[i].bits_per_word : node->bits);
+        for (j = 0; j < batch[i].len && wire_len + width <= WIRE_MAX; j += width)
+            for (k = 0; k < width; k++)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                wire[wire_len++] = tx != NULL ? tx[j + k] : 0;
+#else
+                wire[wire_len++] = tx != NULL ? tx[j + width - 1 - k] : 0;
+#endif
+    }
+    pthread_mutex_unlock(&wire_lock);
+}
+
+/* Copy up to len bytes of what the last message clocked out, returns how
+ * many it clocked out */
+size_t devmock_spidev_wire(uint8_t *buffer, size_t len) {
+    size_t total;
+
+    pthread_mutex_lock(&wire_lock);
+    total = wire_len;
+    memcpy(buffer, wire, len < total ? len : total);
+    pthread_mutex_unlock(&wire_lock);
+    return total;
+}
+
+static int message(struct devmock_node *node, struct spi_ioc_transfer *batch, size_t n) {
+    size_t i, j, tx_total = 0, rx_total = 0, total = 0;
+    int err = 0;
+
+    for (i = 0; i < n && err == 0; i++) {
+        if (batch[i].bits_per_word > 32 ||
+            batch[i].len % word_bytes(batch[i].bits_per_word ? batch[i].bits_per_word : node->bits))
+            err = EINVAL;
+        else if ((batch[i].tx_buf && (tx_total += batch[i].len) > spidev_bufsiz()) ||
+                 (batch[i].rx_buf && (rx_total += batch[i].len) > spidev_bufsiz()))
+            err = EMSGSIZE;
+        total += batch[i].len;
+    }
+    if (err) {
+        __atomic_add_fetch(&counts.rejected, 1, __ATOMIC_RELAXED);
+        errno = err;
+        return -1;
+    }
+
+    clock_out(node, batch, n);
+    if (node->flash != NULL)
+        flash_message(node->flash, batch, n);
+    for (i = 0; i < n && node->flash == NULL; i++) {
+        if (!batch[i].rx_buf)
+            continue;
+        if (node->counter) {
+            for (j = 0; j < batch[i].len; j++)
+                ((uint8_t *)(uintptr_t)batch[i].rx_buf)[j] = node->count++;
+        } else if (batch[i].tx_buf)
+            memmove((void *)(uintptr_t)batch[i].rx_buf, (void *)(uintptr_t)batch[i].tx_buf, batch[i].len);
+        else
+            memset((void *)(uintptr_t)batch[i].rx_buf, 0, batch[i].len);
+    }
+    __atomic_add_fetch(&counts.messages, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counts.transfers, n, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counts.bytes, total, __ATOMIC_RELAXED);
+    return total;
+}
+
+int spidev_ioctl(struct devmock_node *node, unsigned long request, void *arg) {
+    switch (request) {
+    case SPI_IOC_WR_MODE:
+        node->mode = *(uint8_t *)arg;
+        return 0;
+    case SPI_IOC_RD_MODE:
+        *(uint8_t *)arg = node->mode;
+        return 0;
+    case SPI_IOC_WR_BITS_PER_WORD:
+        node->bits = *(uint8_t *)arg;
+        return 0;
+    case SPI_IOC_RD_BITS_PER_WORD:
+        *(uint8_t *)arg = node->bits;
+        return 0;
+    case SPI_IOC_WR_MAX_SPEED_HZ:
+        node->speed = *(uint32_t *)arg;
+        return 0;
+    case SPI_IOC_RD_MAX_SPEED_HZ:
+        *(uint32_t *)arg = node->speed;
+        return 0;
+    }
+    if (_IOC_TYPE(request) == SPI_IOC_MAGIC && _IOC_NR(request) == 0 && _IOC_DIR(request) == _IOC_WRITE &&
+        _IOC_SIZE(request) % sizeof(struct spi_ioc_transfer) == 0)
+        return message(node, arg, _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer));
+    errno = ENOTTY;
+    return -1;
+}
@@ -0,0 +1,107 @@
+"""
+Device mock for the tests.
+
+The C sources in test/mock build an LD_PRELOAD library that answers for the
+spidev, i2c-dev and sysfs gpio nodes the extensions open, so the tests run
+without a board or root and the extensions carry no test doubles of their
+own.  preload() builds the library with the compiler Python was built with
+and runs the calling script again with it preloaded.  The registers the
+extensions map from /dev/mem come from a file instead, see devmem().
+"""
+
+import ctypes
+import glob
+import os
+import subprocess
+import sys
+import sysconfig
+import tempfile
+
+SOURCES = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'mock')
+LIBRARY = os.path.join(tempfile.gettempdir(), 'rpi-gpio-devmock-%d.so' % os.getuid())
+DEVMEM_SIZE = 0x01F04000    # up to the end of the R_PWM page
+
+_lib = None
+_devmem = None
+
+class _SpidevStats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in ('messages', 'transfers', 'bytes', 'rejected')]
+
+class _I2cStats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in ('transactions', 'messages', 'bytes', 'rejected')]
+
+def build():
+    """Build the mock library if it is older than its sources, return its path"""
+    sources = sorted(glob.glob(os.path.join(SOURCES, '*.c')))
+    newest = max(os.path.getmtime(f) for f in sources + glob.glob(os.path.join(SOURCES, '*.h')))
+    if not os.path.exists(LIBRARY) or os.path.getmtime(LIBRARY) < newest:
+        partial = '%s.%d' % (LIBRARY, os.getpid())
+        cc = (sysconfig.get_config_var('CC') or 'cc').split()
+        subprocess.check_call(cc + ['-shared', '-fPIC', '-O2', '-Wall', '-o', partial] + sources +
+                              ['-ldl', '-lpthread'])
+        os.rename(partial, LIBRARY)
+    return LIBRARY
+
+def preload(**settings):
+    """
+    Make sure the script runs with the mock preloaded, running it again if it
+    does not.  settings are DEVMOCK_* environment variables for the mock,
+    given without the prefix, e.g. spidev_bufsiz=4096.
+    """
+    global _lib
+
+    library = build()
+    if library not in os.environ.get('LD_PRELOAD', '').split(':'):
+        for name, value in settings.items():
+            os.environ['DEVMOCK_' + name.upper()] = str(value)
+        os.environ['LD_PRELOAD'] = ':'.join(p for p in [library, os.environ.get('LD_PRELOAD')] if p)
+        argv = list(getattr(sys, 'orig_argv', [sys.executable] + sys.argv))
+        argv[0] = sys.executable
+        sys.stdout.flush()
+        sys.stderr.flush()
+        os.execv(sys.executable, argv)
+    _lib = ctypes.CDLL(library)
+    return _lib
+
+def devmem():
+    """
+    Point RPI_GPIO_DEVMEM (see c_gpio.c) at a zeroed sparse file addressed by
+    physical address, which the extensions map in place of /dev/mem, and
+    return its name.  Call it after preload() and before importing RPi.GPIO.
+    The file lasts as long as the process.
+    """
+    global _devmem
+
+    if _devmem is None:
+        _devmem = tempfile.NamedTemporaryFile(prefix='devmem')
+        _devmem.truncate(DEVMEM_SIZE)
+        _devmem.flush()
+    os.environ['RPI_GPIO_DEVMEM'] = _devmem.name
+    return _devmem.name
+
+def spidev_stats(reset=False):
+    """Counters of the spidev messages so far - messages, transfers, bytes and rejected"""
+    stats = _SpidevStats()
+    _lib.devmock_spidev_stats(ctypes.byref(stats), int(bool(reset)))
+    return dict((name, getattr(stats, name)) for name, _ in stats._fields_)
+
+def spidev_wire():
+    """The bytes the last spidev message clocked out on MOSI, in wire order"""
+    buf = ctypes.create_string_buffer(65536)
+    _lib.devmock_spidev_wire.restype = ctypes.c_size_t
+    count = _lib.devmock_spidev_wire(buf, ctypes.c_size_t(len(buf)))
+    return buf.raw[:count]
+
+def i2c_stats(reset=False):
+    """Counters of the i2c-dev bus so far - transactions, messages, bytes and rejected"""
+    stats = _I2cStats()
+    _lib.devmock_i2c_stats(ctypes.byref(stats), int(bool(reset)))
+    return dict((name, getattr(stats, name)) for name, _ in stats._fields_)
+
+def gpio_edge(gpio, value):
+    """Leave gpio at value and wake everything polling its sysfs value file"""
+    _lib.devmock_gpio_edge(gpio, value)
+
+def gpio_pending(gpio):
+    """Whether something that opened the value file of gpio has not read its last edge yet"""
+    return bool(_lib.devmock_gpio_pending(gpio))
@@ -525,6 +525,22 @@ class TestEdgeDetection(unittest.TestCase):
         self.assertEqual(GPIO.event_detected(LOOP_IN), True)
         GPIO.remove_event_detect(LOOP_IN)
 
+    def testEventsPending(self):
+        GPIO.output(LOOP_OUT, GPIO.LOW)
+        GPIO.add_event_detect(LOOP_IN, GPIO.RISING)
+        time.sleep(0.01)
+        self.assertEqual(GPIO.events_pending(), [])
+        GPIO.output(LOOP_OUT, GPIO.HIGH)
+        time.sleep(0.01)
+        self.assertEqual(GPIO.events_pending(), [LOOP_IN])
+        self.assertEqual(GPIO.events_pending(), [])
+        GPIO.output(LOOP_OUT, GPIO.LOW)
+        GPIO.output(LOOP_OUT, GPIO.HIGH)
+        time.sleep(0.01)
+        self.assertEqual(GPIO.events_pending(bitmask=True), 1 << LOOP_IN)
+        self.assertEqual(GPIO.event_detected(LOOP_IN), False)
+        GPIO.remove_event_detect(LOOP_IN)
+
     def testWaitForRising(self):
         def makehigh():
             GPIO.output(LOOP_OUT, GPIO.HIGH)
@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+"""
+Edge log tests: edges fired through the sysfs gpio value files of
+mockdev.py are logged by GPIO.start_edge_log() and converted back with
+edgelog2vcd.py.
+"""
+
+import os
+import resource
+import signal
+import struct
+import sys
+import tempfile
+import time
+import unittest
+
+import mockdev
+
+mockdev.preload()
+mockdev.devmem()
+
+# after the built package, not the RPi sources next to edgelog2vcd.py
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+import edgelog2vcd
+
+import RPi.GPIO as GPIO
+
+HEADER = struct.Struct('<8sIIQQ')
+RECORD = struct.Struct('<QII')
+
+def write_log(path, capacity, head, records):
+    # records holds the newest min(head, capacity) of them, oldest first
+    slots = [RECORD.pack(0, 0, 0)] * capacity
+    for n, record in enumerate(records, max(0, head - capacity)):
+        slots[n % capacity] = RECORD.pack(*record)
+    with open(path, 'wb') as f:
+        f.write(HEADER.pack(b'GPIOEDGE', 1, RECORD.size, capacity, head) + b''.join(slots))
+
+def vcd_changes(path):
+    # (time, value change) lines after the initial dump
+    with open(path) as f:
+        body = f.read().split('$dumpvars\n', 1)[1].split('$end\n', 1)[1]
+    changes, now = [], None
+    for line in body.splitlines():
+        if line.startswith('#'):
+            now = int(line[1:])
+        else:
+            changes.append((now, line))
+    return changes
+
+class TestConvert(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.log = os.path.join(self.dir, 'edges.log')
+        self.vcd = os.path.join(self.dir, 'edges.vcd')
+
+    def tearDown(self):
+        for name in (self.log, self.vcd):
+            if os.path.exists(name):
+                os.unlink(name)
+        os.rmdir(self.dir)
+
+    def test_vcd(self):
+        start = 1700000000 * 10**9
+        write_log(self.log, 8, 4, [(start, 5, 1), (start + 1500, 3, 0), (start + 1500, 5, 0),
+                                   (start + 4000, 3, 1)])
+        edgelog2vcd.convert(self.log, self.vcd)
+        with open(self.vcd) as f:
+            self.assertEqual(f.read(),
+                '$date %s $end\n' % time.ctime(start / 1e9) +
+                '$version RPi.GPIO edge log $end\n'
+                '$timescale 1ns $end\n'
+                '$scope module gpio $end\n'
+                '$var wire 1 ! gpio3 $end\n'
+                '$var wire 1 " gpio5 $end\n'
+                '$upscope $end\n$enddefinitions $end\n'
+                '$dumpvars\nx!\nx"\n$end\n'
+                '#0\n1"\n'
+                '#1500\n0!\n0"\n'
+                '#4000\n1!\n')
+
+    def test_wrapped(self):
+        # ten records through a ring of four leave the last four, the oldest
+        # of them in slot 2
+        start = 1700000000 * 10**9
+        records = [(start + 1000 * n, 7, n % 2) for n in range(10)]
+        write_log(self.log, 4, 10, records[6:])
+        edgelog2vcd.convert(self.log, self.vcd)
+        self.assertEqual(vcd_changes(self.vcd), [(0, '0!'), (1000, '1!'), (2000, '0!'), (3000, '1!')])
+
+    def test_clock_stepped_back(self):
+        start = 1700000000 * 10**9
+        write_log(self.log, 4, 3, [(start, 7, 1), (start - 500, 7, 0), (start + 200, 7, 1)])
+        edgelog2vcd.convert(self.log, self.vcd)
+        self.assertEqual(vcd_changes(self.vcd), [(0, '1!'), (0, '0!'), (200, '1!')])
+
+    def test_not_a_log(self):
+        with open(self.log, 'wb') as f:
+            f.write(b'\0' * HEADER.size)
+        with self.assertRaises(ValueError):
+            edgelog2vcd.convert(self.log, self.vcd)
+
+class TestEdgeLog(unittest.TestCase):
+    # BCM channels 2 and 3 are PH3 and PH2, gpio 227 and 226
+    CHANNELS = {2: 227, 3: 226}
+
+    def setUp(self):
+        GPIO.setwarnings(False)
+        GPIO.setmode(GPIO.BCM)
+        self.dir = tempfile.mkdtemp()
+        self.log = os.path.join(self.dir, 'edges.log')
+        self.vcd = os.path.join(self.dir, 'edges.vcd')
+
+    def tearDown(self):
+        GPIO.stop_edge_log()
+        GPIO.cleanup()
+        for name in (self.log, self.vcd):
+            if os.path.exists(name):
+                os.unlink(name)
+        os.rmdir(self.dir)
+
+    def head(self):
+        with open(self.log, 'rb') as f:
+            return HEADER.unpack(f.read(HEADER.size))[4]
+
+    def fire(self, channel, value):
+        # one edge at a time, each logged before the next
+        gpio = self.CHANNELS[channel]
+        head = self.head()
+        deadline = time.time() + 5
+        while mockdev.gpio_pending(gpio):
+            self.assertLess(time.time(), deadline)
+            time.sleep(0.001)
+        mockdev.gpio_edge(gpio, value)
+        while self.head() == head:
+            self.assertLess(time.time(), deadline)
+            time.sleep(0.001)
+
+    def test_round_trip(self):
+        GPIO.start_edge_log(self.log, records=4)
+        for channel in self.CHANNELS:
+            GPIO.setup(channel, GPIO.IN)
+            GPIO.add_event_detect(channel, GPIO.BOTH)
+        edges = [(2, 1), (3, 1), (2, 0), (2, 1), (3, 0), (2, 0)]
+        for channel, value in edges:
+            self.fire(channel, value)
+        GPIO.stop_edge_log()
+        self.assertEqual(self.head(), 6)
+
+        # the ring kept the last four, and the VCD has them oldest first
+        edgelog2vcd.convert(self.log, self.vcd)
+        ids = {226: '!', 227: '"'}
+        changes = vcd_changes(self.vcd)
+        self.assertEqual([line for _, line in changes],
+                         ['%d%s' % (value, ids[self.CHANNELS[channel]]) for channel, value in edges[2:]])
+        times = [t for t, _ in changes]
+        self.assertEqual(times[0], 0)
+        self.assertEqual(times, sorted(times))
+
+    def test_already_started(self):
+        GPIO.start_edge_log(self.log, records=4)
+        with self.assertRaises(RuntimeError):
+            GPIO.start_edge_log(self.log, records=4)
+        with self.assertRaises(ValueError):
+            GPIO.start_edge_log(self.log, records=0)
+
+    def start_over_limit(self):
+        # a log too big for the file size limit fails to allocate
+        limits = resource.getrlimit(resource.RLIMIT_FSIZE)
+        handler = signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+        resource.setrlimit(resource.RLIMIT_FSIZE, (4096, limits[1]))
+        try:
+            with self.assertRaises(IOError):
+                GPIO.start_edge_log(self.log, records=1000)
+        finally:
+            resource.setrlimit(resource.RLIMIT_FSIZE, limits)
+            signal.signal(signal.SIGXFSZ, handler)
+
+    def test_failed_open_removes_file(self):
+        self.start_over_limit()
+        self.assertFalse(os.path.exists(self.log))
+        # but a file that was there already is left, if truncated
+        with open(self.log, 'wb') as f:
+            f.write(b'keep')
+        self.start_over_limit()
+        self.assertTrue(os.path.exists(self.log))
+
+if __name__ == '__main__':
+    unittest.main()
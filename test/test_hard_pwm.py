@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+"""
+Hardware PWM tests: the controller registers are read back from the
+register image of mockdev.devmem(), and the kernel driver backend is
+tested against a fake /sys/class/pwm tree.
+"""
+
+import os
+import shutil
+import struct
+import tempfile
+import unittest
+
+import mockdev
+
+R_PIO_PL_CFG1 = 0x01F02C04
+R_PWM_CTRL = 0x01F03800
+R_PWM_PERIOD = 0x01F03804
+
+DEVMEM = mockdev.devmem()
+no_sysfs = tempfile.mkdtemp()
+os.environ['RPI_GPIO_PWM_SYSFS'] = no_sysfs
+
+import RPi.GPIO as GPIO
+
+def readl(addr):
+    with open(DEVMEM, 'rb') as f:
+        f.seek(addr)
+        return struct.unpack('<I', f.read(4))[0]
+
+class TestHardPWM(unittest.TestCase):
+    def setUp(self):
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup(7, GPIO.OUT)    # PL10, S_PWM
+
+    def test_program(self):
+        pwm = GPIO.PWM(7, 1000)
+        self.assertEqual((readl(R_PIO_PL_CFG1) >> 8) & 7, 2)
+        pwm.start(25)
+        self.assertEqual(readl(R_PWM_CTRL) & 0x5f, 0x5f)   # enabled, gated, 24 MHz
+        self.assertEqual(readl(R_PWM_PERIOD), (23999 << 16) | 6000)
+        stats = pwm.stats()
+        self.assertEqual(stats['frequency'], 1000.0)
+        self.assertEqual(stats['dutycycle'], 25.0)
+
+        pwm.ChangeFrequency(50)
+        self.assertEqual(readl(R_PWM_CTRL) & 0xf, 0)       # 24 MHz / 120
+        self.assertEqual(readl(R_PWM_PERIOD), (3999 << 16) | 1000)
+
+        pwm.stop()
+        self.assertEqual(readl(R_PWM_CTRL) & 0x10, 0)
+        del pwm
+        self.assertEqual((readl(R_PIO_PL_CFG1) >> 8) & 7, 1)
+
+    def test_full_period(self):
+        # 65535.6 cycles at 24 MHz would round to a period whose 100% duty
+        # cycle overflows the active field, so the next divider is used
+        pwm = GPIO.PWM(7, 24000000 / 65535.6)
+        pwm.start(100)
+        self.assertEqual(readl(R_PWM_CTRL) & 0xf, 0)       # 24 MHz / 120
+        self.assertEqual(readl(R_PWM_PERIOD), (545 << 16) | 546)
+        pwm.ChangeFrequency(24000000 / 65534.0)
+        self.assertEqual(readl(R_PWM_CTRL) & 0xf, 0xf)     # 24 MHz
+        self.assertEqual(readl(R_PWM_PERIOD), (65533 << 16) | 65534)
+        self.assertEqual(pwm.stats()['dutycycle'], 100.0)
+        pwm.stop()
+        del pwm
+
+    def test_out_of_range(self):
+        pwm = GPIO.PWM(7, 1000)
+        with self.assertRaises(ValueError):
+            pwm.ChangeFrequency(20000000)
+        del pwm
+
+    def test_one_object_per_channel(self):
+        # the channel's registers belong to the first PWM, until it is gone
+        first = GPIO.PWM(7, 1000)
+        with self.assertRaises(RuntimeError):
+            GPIO.PWM(7, 1000)
+        first.start(25)
+        del first
+        second = GPIO.PWM(7, 1000)
+        second.start(50)
+        self.assertEqual(readl(R_PWM_PERIOD), (23999 << 16) | 12000)
+        second.stop()
+        del second
+
+    def tearDown(self):
+        GPIO.cleanup()
+
+class TestSysfsPWM(unittest.TestCase):
+    def setUp(self):
+        # pwmchip0 is the R_PWM controller, with channel 0 already exported
+        self.root = tempfile.mkdtemp()
+        device = os.path.join(self.root, 'devices', '1f03800.pwm')
+        self.chip = os.path.join(self.root, 'pwmchip0')
+        os.makedirs(device)
+        os.makedirs(os.path.join(self.chip, 'pwm0'))
+        os.symlink(device, os.path.join(self.chip, 'device'))
+        for attr in ('export', 'unexport', 'pwm0/period', 'pwm0/duty_cycle', 'pwm0/enable'):
+            open(os.path.join(self.chip, attr), 'w').close()
+        os.environ['RPI_GPIO_PWM_SYSFS'] = self.root
+
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup(7, GPIO.OUT)
+
+    def attr(self, name):
+        with open(os.path.join(self.chip, name)) as f:
+            return f.readline().strip()
+
+    def test_program(self):
+        pwm = GPIO.PWM(7, 1000)
+        pwm.start(25)
+        self.assertEqual(readl(R_PWM_CTRL) & 0x10, 0)  # registers left to the driver
+        self.assertEqual(self.attr('pwm0/period'), '1000000')
+        self.assertEqual(self.attr('pwm0/duty_cycle'), '250000')
+        self.assertEqual(self.attr('pwm0/enable'), '1')
+        pwm.ChangeDutyCycle(50)
+        self.assertEqual(self.attr('pwm0/duty_cycle'), '500000')
+        pwm.ChangeFrequency(2000)
+        self.assertEqual(self.attr('pwm0/period'), '500000')
+        self.assertEqual(self.attr('pwm0/duty_cycle'), '250000')
+        self.assertEqual(pwm.stats()['frequency'], 2000.0)
+        pwm.stop()
+        self.assertEqual(self.attr('pwm0/enable'), '0')
+        del pwm
+        self.assertEqual(self.attr('unexport'), '0')
+
+    def tearDown(self):
+        GPIO.cleanup()
+        os.environ['RPI_GPIO_PWM_SYSFS'] = no_sysfs
+        shutil.rmtree(self.root)
+
+if __name__ == '__main__':
+    unittest.main()
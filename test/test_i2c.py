@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+"""
+I2C tests against the i2c-dev bus of mockdev.py, which has i2c-stub like
+chips at CHIPS: 256 registers each and a register pointer set by the first
+byte written.
+"""
+
+import errno
+import unittest
+
+import mockdev
+
+CHIPS = (0x50, 0x68)
+mockdev.preload(i2c_chips=','.join('0x%02x' % a for a in CHIPS))
+
+from RPi import I2C
+
+class TestWriteRead(unittest.TestCase):
+    def setUp(self):
+        I2C.init('/dev/i2c-1')
+        I2C.open(CHIPS[0])
+        mockdev.i2c_stats(reset=True)
+
+    def tearDown(self):
+        I2C.close()
+
+    def test_read_register(self):
+        self.assertEqual(I2C.write_read(b'\x10\x01\x02\x03', 0), b'')
+        self.assertEqual(I2C.read_register(0x10, 3), b'\x01\x02\x03')
+        # write and read back in one I2C_RDWR, with a repeated start
+        stats = mockdev.i2c_stats()
+        self.assertEqual(stats['transactions'], 2)
+        self.assertEqual(stats['messages'], 3)
+        self.assertEqual(stats['bytes'], 4 + 1 + 3)
+
+        self.assertEqual(I2C.write_read([0x20, 9, 8], 0), b'')
+        self.assertEqual(I2C.write_read(bytearray([0x20]), 2), b'\x09\x08')
+        # plain read() goes on from the register pointer
+        self.assertEqual(I2C.write_read(memoryview(b'\x11'), 0), b'')
+        self.assertEqual(I2C.read(2), [2, 3])
+
+    def test_chips_apart(self):
+        I2C.write_read(b'\x00\xaa', 0)
+        I2C.close()
+        I2C.open(CHIPS[1])
+        I2C.write_read(b'\x00\x55', 0)
+        self.assertEqual(I2C.read_register(0, 1), b'\x55')
+        I2C.close()
+        I2C.open(CHIPS[0])
+        self.assertEqual(I2C.read_register(0, 1), b'\xaa')
+
+    def test_no_device(self):
+        I2C.close()
+        I2C.open(0x33)
+        with self.assertRaises(IOError) as cm:
+            I2C.read_register(0, 1)
+        self.assertEqual(cm.exception.errno, errno.ENXIO)
+        self.assertEqual(mockdev.i2c_stats()['rejected'], 1)
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            I2C.read_register(256, 1)
+        with self.assertRaises(ValueError):
+            I2C.read_register(0, 0)
+        with self.assertRaises(ValueError):
+            I2C.write_read(b'\0', -1)
+        with self.assertRaises(ValueError):
+            I2C.write_read(b'\0' * 8193, 0)
+        with self.assertRaises(TypeError):
+            I2C.write_read(1, 1)
+        self.assertEqual(mockdev.i2c_stats()['transactions'], 0)
+
+class TestTransfer(unittest.TestCase):
+    def setUp(self):
+        I2C.init('/dev/i2c-1')
+        I2C.open(CHIPS[0])
+        for i, chip in enumerate(CHIPS):
+            I2C.transfer([(chip, bytearray([0]) + bytearray((i + r) & 0xff for r in range(256)))])
+        mockdev.i2c_stats(reset=True)
+
+    def tearDown(self):
+        I2C.close()
+
+    def test_batch(self):
+        # register reads on both chips, a write and a plain read in between
+        messages = [(CHIPS[n % 2], [n], 2) for n in range(100)]
+        messages[10] = (CHIPS[1], b'\xf0\xee')
+        messages[11] = (CHIPS[1], 1)
+        data, status = I2C.transfer(messages)
+        self.assertEqual(status, [0] * 100)
+        expect = bytearray()
+        for n in range(100):
+            if n == 11:
+                expect += b'\xf2'   # register 0xf1, after the one written
+            elif n != 10:
+                expect += bytearray([n + n % 2, n + 1 + n % 2])
+        self.assertEqual(data, bytes(expect))
+        # pairs are never split, so 21 of them per 42 message I2C_RDWR
+        stats = mockdev.i2c_stats()
+        self.assertEqual(stats['transactions'], 5)
+        self.assertEqual(stats['messages'], 198)
+
+        buf = bytearray(8)
+        data, status = I2C.transfer([(CHIPS[0], b'\x04', 4), (CHIPS[1], b'\x04', 4)], buffer=buf)
+        self.assertIs(data, buf)
+        self.assertEqual(buf, bytearray([4, 5, 6, 7, 5, 6, 7, 8]))
+        self.assertEqual(I2C.transfer([]), (b'', []))
+
+    def test_status(self):
+        messages = [(CHIPS[0], 2), (0x33, 1), (CHIPS[1], 1), (0x34, 1)]
+        data, status = I2C.transfer(messages)
+        self.assertEqual(status, [0, errno.ENXIO, 0, errno.ENXIO])
+        # the failed call stopped at 0x33 after the first read, which is run again
+        self.assertEqual(data, b'\x02\x03\x00\x01\x00')
+        self.assertEqual(mockdev.i2c_stats()['transactions'], 5)
+
+    def test_no_write_replay(self):
+        messages = [(CHIPS[0], b'\x10\x55'), (0x33, 1), (CHIPS[1], b'\x00', 1), (CHIPS[0], 1)]
+        data, status = I2C.transfer(messages)
+        # the write went out before 0x33 failed the call, and must not go out again
+        self.assertEqual(status, [errno.ENXIO, errno.ENXIO, errno.ENXIO, 0])
+        # the plain read goes on from the register after the one written
+        self.assertEqual(data, b'\x00\x00\x11')
+        stats = mockdev.i2c_stats()
+        self.assertEqual(stats['transactions'], 3)
+        self.assertEqual(stats['messages'], 1 + 1)
+        self.assertEqual(I2C.transfer([(CHIPS[0], b'\x10', 1)])[0], b'\x55')
+
+    def test_errors(self):
+        for bad in ([(CHIPS[0],)], [(CHIPS[0], 1, 2, 3)], [(128, 1)], [(CHIPS[0], -1)],
+                    [(CHIPS[0], b'\0' * 8193)], [[CHIPS[0], 1]], 5):
+            with self.assertRaises((TypeError, ValueError)):
+                I2C.transfer(bad)
+        with self.assertRaises(ValueError):
+            I2C.transfer([(CHIPS[0], 4)], buffer=bytearray(3))
+        with self.assertRaises((TypeError, BufferError)):
+            I2C.transfer([(CHIPS[0], 4)], buffer=b'read only')
+        self.assertEqual(mockdev.i2c_stats()['transactions'], 0)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+"""
+Servo tests: pulse widths shared out over the 50 Hz frame of the software
+PWM engine, which drives the pins of mockdev.devmem().
+"""
+
+import time
+import unittest
+
+import mockdev
+
+mockdev.devmem()
+
+import RPi.GPIO as GPIO
+
+FRAME = 0.02
+
+class TestServo(unittest.TestCase):
+    def setUp(self):
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup([11, 12, 13], GPIO.OUT)
+
+    def test_set_many(self):
+        servos = [GPIO.Servo(pin, 1500) for pin in (11, 12, 13)]
+        time.sleep(2 * FRAME)
+        self.assertEqual([s.pulse_width() for s in servos], [1500.0] * 3)
+
+        GPIO.Servo.set_many([(servos[0], 1000), (servos[1], 1250.5), (servos[2], 2000)])
+        time.sleep(2 * FRAME)
+        self.assertEqual([s.pulse_width() for s in servos], [1000.0, 1250.5, 2000.0])
+
+        servos[1].set(900)
+        time.sleep(2 * FRAME)
+        self.assertEqual(servos[1].pulse_width(), 900.0)
+
+        servos[2].stop()
+        with self.assertRaises(RuntimeError):
+            GPIO.Servo.set_many([(servos[0], 1500), (servos[2], 1500)])
+        self.assertEqual(servos[0].pulse_width(), 1000.0)
+
+    def test_bad_values(self):
+        servo = GPIO.Servo(11)
+        with self.assertRaises(ValueError):
+            servo.set(25000)
+        with self.assertRaises(TypeError):
+            GPIO.Servo.set_many([(11, 1500)])
+        with self.assertRaises(RuntimeError):
+            GPIO.Servo(11)
+        servo.stop()
+
+    def test_after_stopped_pwm(self):
+        # a stopped PWM has let go of the pin, so deleting it later must
+        # leave the servo that took the pin over running
+        pwm = GPIO.PWM(11, 100)
+        pwm.start(50)
+        pwm.stop()
+        servo = GPIO.Servo(11, 1200)
+        pwm.stop()
+        del pwm
+        time.sleep(2 * FRAME)
+        self.assertEqual(servo.pulse_width(), 1200.0)
+        servo.stop()
+
+    def tearDown(self):
+        GPIO.cleanup()
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+"""
+Software PWM tests: ramps, pulse density modulation and the engine's jitter
+and benchmark reports, on pins of mockdev.devmem().
+"""
+
+import threading
+import time
+import unittest
+
+import mockdev
+
+mockdev.devmem()
+
+import RPi.GPIO as GPIO
+
+class TestRamp(unittest.TestCase):
+    def setUp(self):
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup(11, GPIO.OUT)
+        self.pwm = GPIO.PWM(11, 100)
+        self.pwm.start(0)
+
+    def test_ramp_callback(self):
+        done = threading.Event()
+        channels = []
+        def cb(channel):
+            channels.append(channel)
+            done.set()
+        self.pwm.ramp(80, 50, GPIO.RAMP_GAMMA, callback=cb)
+        self.assertTrue(self.pwm.wait_ramp(2.0))
+        self.assertTrue(done.wait(2.0))
+        self.assertEqual(channels, [11])
+
+        self.pwm.ramp(20, 0)
+        self.assertTrue(self.pwm.wait_ramp(2.0))
+
+    def test_cancel(self):
+        self.pwm.ramp(100, 10000, GPIO.RAMP_EXPONENTIAL)
+        self.assertFalse(self.pwm.wait_ramp(0.01))
+        self.pwm.ChangeDutyCycle(50)
+        self.assertTrue(self.pwm.wait_ramp(1.0))   # at the next period start
+
+    def test_bad_values(self):
+        with self.assertRaises(ValueError):
+            self.pwm.ramp(101, 10)
+        with self.assertRaises(ValueError):
+            self.pwm.ramp(50, 10, 7)
+        with self.assertRaises(TypeError):
+            self.pwm.ramp(50, 10, callback=1)
+
+    def test_frequency_limit(self):
+        # anything over 1e9 Hz has a period under the engine's 1 ns
+        with self.assertRaises(ValueError):
+            self.pwm.ChangeFrequency(2e9)
+        with self.assertRaises(ValueError):
+            GPIO.PWM(11, 2e9)
+
+    def tearDown(self):
+        self.pwm.stop()
+        del self.pwm
+        GPIO.cleanup()
+
+class TestPDM(unittest.TestCase):
+    def setUp(self):
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup(11, GPIO.OUT)
+
+    def test_density(self):
+        for order in (1, 2):
+            pdm = GPIO.PDM(11, 250, oversample=8, order=order, buffer_size=100)
+            self.assertEqual(pdm.write([0.25] * 200, block=False), 128)
+            self.assertEqual(pdm.write([0.25] * 50, timeout=1.0), 50)
+            time.sleep(0.1)
+            pdm.stats(reset=True)
+            time.sleep(0.2)
+            stats = pdm.stats()
+            # each bit clock tick the engine missed holds the previous level
+            self.assertAlmostEqual(stats['density'], 0.25, delta=0.02 + stats['overruns'] / 400.0)
+            pdm.stop()
+
+    def test_underrun(self):
+        pdm = GPIO.PDM(11, 1000, oversample=4)
+        self.assertEqual(pdm.write([1.0, 0.0, 0.5]), 3)
+        time.sleep(0.05)
+        stats = pdm.stats()
+        self.assertEqual(stats['queued'], 0)
+        self.assertGreater(stats['underruns'], 0)
+        with self.assertRaises(ValueError):
+            pdm.write([0.5, 2.0])
+        with self.assertRaises(RuntimeError):
+            GPIO.PWM(11, 100)
+        with self.assertRaises(RuntimeError):
+            GPIO.Servo(11)
+        pdm.stop()
+        with self.assertRaises(RuntimeError):
+            pdm.write([0.5])
+
+    def test_bad_values(self):
+        with self.assertRaises(ValueError):
+            GPIO.PDM(11, 1000, order=3)
+        with self.assertRaises(ValueError):
+            GPIO.PDM(11, 0)
+
+    def tearDown(self):
+        GPIO.cleanup()
+
+class TestJitter(unittest.TestCase):
+    def setUp(self):
+        GPIO.setmode(GPIO.BOARD)
+        GPIO.setup(11, GPIO.OUT)
+
+    def test_report(self):
+        GPIO.set_pwm_spin(50)
+        pwm = GPIO.PWM(11, 2000)
+        GPIO.pwm_jitter(reset=True)
+        pwm.start(10)
+        time.sleep(0.05)
+        report = GPIO.pwm_jitter()
+        pwm.stop()
+        GPIO.set_pwm_spin(0)
+
+        self.assertEqual(report['spin_us'], 50.0)
+        self.assertGreater(report['edges'], 0)
+        self.assertEqual(sum(n for bound, n in report['histogram']), report['edges'])
+        self.assertLessEqual(report['p50_us'], report['p99_us'])
+        self.assertGreaterEqual(report['max_us'], report['mean_us'])
+        self.assertEqual(GPIO.pwm_jitter()['spin_us'], 0.0)
+        with self.assertRaises(ValueError):
+            GPIO.set_pwm_spin(-1)
+
+    def test_benchmark(self):
+        result = GPIO.pwm_benchmark(4, 500, 50, seconds=0.2)
+        self.assertEqual(result['channels'], 4)
+        self.assertEqual(result['dropped'], 0)
+        self.assertGreater(result['edges'], 4 * 2 * 50)
+        self.assertLess(abs(result['frequency_error']), 50)
+        self.assertLessEqual(result['jitter_p50_us'], result['jitter_max_us'])
+        with self.assertRaises(ValueError):
+            GPIO.pwm_benchmark(0)
+        with self.assertRaises(ValueError):
+            GPIO.pwm_benchmark(1, 2e9)
+
+    def test_benchmark_all_slots(self):
+        result = GPIO.pwm_benchmark(54, 100, 50, seconds=0.1)
+        self.assertEqual(result['channels'], 54)
+        self.assertGreater(result['edges'], 0)
+
+    def tearDown(self):
+        GPIO.cleanup()
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,552 @@
+#!/usr/bin/env python
+"""
+SPI tests against the spidev mock of mockdev.py, whose MISO is wired to MOSI
+except on FLASH, where the mock models a NOR flash, and ADC, which counts
+the bytes clocked out of it.  Direct register access runs on the simulated
+controller of sunxi_spi.c (RPI_GPIO_SPI_SIM), and gpio chip selects on the
+pins of mockdev.devmem().
+"""
+
+import array
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import unittest
+
+import mockdev
+
+BUFSIZ = 4096
+FLASH, FLASH_SIZE = '/dev/spidev1.1', 1 << 20
+ADC = '/dev/spidev2.0'
+mockdev.preload(spidev_bufsiz=BUFSIZ, spidev_flash='%s:%d' % (FLASH, FLASH_SIZE), spidev_counter=ADC)
+os.environ['RPI_GPIO_SPI_SIM'] = '1'
+DEVMEM = mockdev.devmem()
+
+from RPi import GPIO, SPI
+
+def messages(size, bufsiz=BUFSIZ):
+    return (size + bufsiz - 1) // bufsiz
+
+class TestDevice(unittest.TestCase):
+    def setUp(self):
+        self.dev = SPI.Device('/dev/spidev0.0', speed=1000000)
+        mockdev.spidev_stats(reset=True)
+
+    def tearDown(self):
+        self.dev.close()
+
+    def test_loopback(self):
+        self.assertEqual(self.dev.xfer(b'\x01\x02\x03', 3), b'\x01\x02\x03')
+        self.assertEqual(self.dev.xfer([1, 2], 4), b'\x01\x02\x00\x00')
+        self.assertEqual(self.dev.xfer(bytearray(b'abcd'), 2), b'ab')
+        self.assertEqual(self.dev.read(3), b'\x00\x00\x00')
+        self.assertIsNone(self.dev.write(array.array('B', [1, 2, 3])))
+        buf = bytearray(4)
+        self.assertEqual(self.dev.xfer_into(memoryview(b'wxyz'), buf), 4)
+        self.assertEqual(buf, b'wxyz')
+        self.assertEqual(self.dev.readinto(buf), 4)
+        self.assertEqual(buf, bytearray(4))
+
+    def test_bufsiz_batching(self):
+        # one message per bufsiz bytes, not per 64 byte chunk
+        for size in (1, 64, BUFSIZ, BUFSIZ + 1, 150000):
+            data = os.urandom(size)
+            mockdev.spidev_stats(reset=True)
+            self.dev.write(data)
+            self.assertEqual(self.dev.xfer(data, size), data)
+            stats = mockdev.spidev_stats()
+            self.assertEqual(stats['messages'], 2 * messages(size))
+            self.assertEqual(stats['bytes'], 2 * size)
+            self.assertEqual(stats['rejected'], 0)
+
+    def test_transaction(self):
+        result = self.dev.transfer([b'\x0b\x00', 3, {'tx': [7, 8], 'rx': 4, 'cs_change': True},
+                                    {'rx': 1, 'speed_hz': 50000, 'bits_per_word': 8}])
+        self.assertIsNone(result[0])
+        self.assertEqual([bytes(r) for r in result[1:]], [b'\x00' * 3, b'\x07\x08\x00\x00', b'\x00'])
+        self.assertIs(result[1].obj, result[2].obj)
+        self.assertEqual(mockdev.spidev_stats()['messages'], 1)
+
+        big = self.dev.transfer([os.urandom(BUFSIZ), {'tx': b'ab', 'rx': 2}])
+        self.assertEqual(bytes(big[1]), b'ab')
+        self.assertEqual(mockdev.spidev_stats()['rejected'], 0)
+
+        with self.assertRaises(ValueError):
+            self.dev.transfer([{'rx': -1}])
+        with self.assertRaises(ValueError):
+            self.dev.transfer([{'tx': b'a', 'bits_per_word': 33}])
+
+    def test_word_split(self):
+        # a segment split at bufsiz is cut on a whole word of its size
+        data = os.urandom(BUFSIZ)
+        result = self.dev.transfer([b'a', {'tx': data, 'rx': BUFSIZ, 'bits_per_word': 16}])
+        self.assertEqual(bytes(result[1]), data)
+        self.dev.bits = 32
+        result = self.dev.transfer([{'tx': b'ab', 'bits_per_word': 8}, {'tx': data, 'rx': BUFSIZ}])
+        self.assertEqual(bytes(result[1]), data)
+        self.dev.bits = 8
+        stats = mockdev.spidev_stats()
+        self.assertEqual((stats['messages'], stats['rejected']), (4, 0))
+
+    def test_settings(self):
+        self.dev.mode = 3
+        self.dev.speed = 2000000
+        self.assertEqual((self.dev.mode, self.dev.speed, self.dev.bits), (3, 2000000, 8))
+        with self.assertRaises(ValueError):
+            self.dev.bits = 0
+        with self.assertRaises(ValueError):
+            SPI.Device('/dev/spidev0.0', mode=256)
+
+    def test_closed(self):
+        with SPI.Device('/dev/spidev0.1') as dev:
+            self.assertEqual(dev.read(1), b'\x00')
+        self.assertEqual(dev.fileno(), -1)
+        with self.assertRaises(ValueError):
+            dev.read(1)
+
+    def test_threads(self):
+        # lists go through a per-device scratch buffer, which must not be
+        # shared between concurrent calls
+        errors = []
+        def run(value):
+            for i in range(200):
+                if self.dev.xfer([value] * 100, 100) != bytes(bytearray([value] * 100)):
+                    errors.append(value)
+        threads = [threading.Thread(target=run, args=(v,)) for v in (1, 2, 3, 4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(errors, [])
+
+class TestWords(unittest.TestCase):
+    def setUp(self):
+        self.dev = SPI.Device('/dev/spidev0.0', speed=1000000)
+
+    def tearDown(self):
+        self.dev.close()
+
+    def test_layouts(self):
+        # the loopback sends the packed bytes back, so unpacking them must
+        # give the words again; counts cover the vector loop and the tails
+        for width, code in ((8, 'B'), (16, 'H'), (32, 'I')):
+            for count in (0, 1, 3, 7, 8, 9, 33):
+                words = array.array(code, [(0x9e3779b9 * (i + 1)) & ((1 << width) - 1) for i in range(count)])
+                for byteorder in ('big', 'little'):
+                    for lsb_first in (False, True):
+                        kw = dict(width=width, byteorder=byteorder, lsb_first=lsb_first)
+                        self.assertEqual(self.dev.xfer_words(words, count, **kw), words)
+                        self.assertEqual(self.dev.xfer_words(list(words), count, **kw), words)
+                        got = array.array(code, [0] * count)
+                        self.assertEqual(self.dev.xfer_words_into(words, got, **kw), count)
+                        self.assertEqual(got, words)
+
+    def test_read_write(self):
+        self.assertEqual(self.dev.read_words(3, width=32), array.array('I', [0, 0, 0]))
+        buf = array.array('H', [1, 2])
+        self.assertEqual(self.dev.readinto_words(buf, lsb_first=True), 2)
+        self.assertEqual(buf, array.array('H', [0, 0]))
+        self.assertIsNone(self.dev.write_words([0x1234, 0x10005]))
+
+    def test_wire_order(self):
+        # the words are packed in wire order, so they must go out a byte at a
+        # time even when the device clocks 16 bit words
+        with SPI.Device('/dev/spidev0.0', bits=16) as dev:
+            for byteorder, wire in (('big', b'\x12\x34\xab\xcd'), ('little', b'\x34\x12\xcd\xab')):
+                for words in (array.array('H', [0x1234, 0xabcd]), [0x1234, 0xabcd]):
+                    dev.write_words(words, byteorder=byteorder)
+                    self.assertEqual(mockdev.spidev_wire(), wire)
+                    dev.xfer_words(words, 2, byteorder=byteorder)
+                    self.assertEqual(mockdev.spidev_wire(), wire)
+            # while plain bytes go out as the device's native 16 bit words
+            dev.write(array.array('H', [0x1234]).tobytes())
+            self.assertEqual(mockdev.spidev_wire(), b'\x12\x34')
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            self.dev.write_words(array.array('H', [1]), width=12)
+        with self.assertRaises(ValueError):
+            self.dev.write_words(array.array('H', [1]), byteorder='middle')
+        with self.assertRaises(ValueError):
+            self.dev.write_words(array.array('I', [1]))
+        with self.assertRaises(ValueError):
+            self.dev.readinto_words(bytearray(4))
+        with self.assertRaises(ValueError):
+            self.dev.read_words(-1)
+
+def gpio_level(gpio):
+    # a file of its own, so no stale read buffer
+    with open(DEVMEM, 'rb') as f:
+        f.seek(0x01C20800 + (gpio >> 5) * 0x24 + 0x10)
+        return (struct.unpack('<I', f.read(4))[0] >> (gpio & 31)) & 1
+
+DC = 227   # PH3
+
+def rgb565(frame):
+    return array.array('H', [((frame[i] & 0xF8) << 8) | ((frame[i + 1] & 0xFC) << 3) | (frame[i + 2] >> 3)
+                             for i in range(0, len(frame), 3)])
+
+class TestFramebuffer(unittest.TestCase):
+    # not a multiple of 16 pixels, to reach the conversion tails
+    W, H = 37, 20
+
+    def setUp(self):
+        self.dev = SPI.Device('/dev/spidev0.0', speed=1000000)
+        self.fb = SPI.Framebuffer(self.dev, self.W, self.H, DC)
+        self.frame = bytearray(os.urandom(self.W * self.H * 3))
+        mockdev.spidev_stats(reset=True)
+
+    def tearDown(self):
+        self.dev.close()
+
+    def set_pixel(self, x, y, rgb):
+        i = (y * self.W + x) * 3
+        self.frame[i:i + 3] = bytearray(rgb)
+
+    def test_dirty_rects(self):
+        self.assertEqual(self.fb.update(self.frame), [(0, 0, self.W, self.H)])
+        # CASET, PASET and RAMWR with their parameters, the pixels in one go
+        self.assertEqual(mockdev.spidev_stats(reset=True)['messages'], 6)
+        self.assertEqual(gpio_level(DC), 1)
+
+        self.assertEqual(self.fb.update(self.frame), [])
+        self.assertEqual(mockdev.spidev_stats(reset=True)['messages'], 0)
+
+        self.frame[0] ^= 0xff
+        self.assertEqual(self.fb.update(self.frame), [(0, 0, 1, 1)])
+        self.set_pixel(5, 3, (1, 2, 3))
+        self.set_pixel(9, 4, (1, 2, 3))
+        self.set_pixel(30, 19, (1, 2, 3))
+        # near rows share a rectangle, far ones get their own
+        self.assertEqual(self.fb.update(self.frame), [(5, 3, 5, 2), (30, 19, 1, 1)])
+
+        self.fb.invalidate()
+        self.assertEqual(self.fb.update(self.frame), [(0, 0, self.W, self.H)])
+
+    def test_formats(self):
+        self.fb.update(self.frame)
+        # the same picture as RGB565 words or wire order bytes changes nothing
+        words = rgb565(self.frame)
+        self.assertEqual(self.fb.update(words), [])
+        wire = array.array('H', words)
+        wire.byteswap()
+        self.assertEqual(self.fb.update(bytes(wire.tobytes())), [])
+        words[self.W + 2] ^= 1
+        self.assertEqual(self.fb.update(words), [(2, 1, 1, 1)])
+        with self.assertRaises(ValueError):
+            self.fb.update(b'\0' * 10)
+
+    def test_command(self):
+        self.fb.command(0x11)
+        self.fb.command(0x36, b'\x48')
+        self.assertEqual(mockdev.spidev_stats()['messages'], 3)
+        self.assertEqual(gpio_level(DC), 1)
+        self.dev.close()
+        with self.assertRaises(ValueError):
+            self.fb.update(self.frame)
+
+class TestFlash(unittest.TestCase):
+    def setUp(self):
+        self.dev = SPI.Device(FLASH, speed=1000000)
+        self.flash = SPI.Flash(self.dev)
+        mockdev.spidev_stats(reset=True)
+
+    def tearDown(self):
+        self.dev.close()
+
+    def test_identify(self):
+        self.assertEqual(self.flash.jedec_id, 0xEF4014)
+        self.assertEqual(self.flash.size, FLASH_SIZE)
+        # the loopback echoes the command, which reads as nothing there
+        with SPI.Device('/dev/spidev0.0') as dev:
+            with self.assertRaises(IOError):
+                SPI.Flash(dev)
+
+    def test_program_read(self):
+        self.flash.erase(0, 8192)
+        mockdev.spidev_stats(reset=True)
+        self.assertEqual(self.flash.read(0, 8192), b'\xff' * 8192)
+        # the fast read is one transaction over as few messages as bufsiz allows
+        self.assertEqual(mockdev.spidev_stats(reset=True)['messages'], messages(8192 + 5))
+
+        data = os.urandom(1000)
+        self.flash.program(100, data, verify=True)
+        self.assertEqual(self.flash.read(100, 1000), data)
+        buf = bytearray(1200)
+        self.assertEqual(self.flash.readinto(0, memoryview(buf)), 1200)
+        self.assertEqual(buf, b'\xff' * 100 + data + b'\xff' * 100)
+
+        # programming only clears bits
+        with self.assertRaises(IOError):
+            self.flash.program(100, b'\xff' * 10, verify=True)
+        self.assertEqual(self.flash.read(100, 10), data[:10])
+
+    def test_erase(self):
+        size = 65536 + 2 * 4096
+        self.flash.program(0, b'\0' * size)
+        self.flash.erase(0, size)
+        self.assertEqual(self.flash.read(0, size), b'\xff' * size)
+        with self.assertRaises(ValueError):
+            self.flash.erase(100, 4096)
+        with self.assertRaises(ValueError):
+            self.flash.erase(FLASH_SIZE - 4096, 8192)
+        with self.assertRaises(ValueError):
+            self.flash.read(FLASH_SIZE, 1)
+        self.dev.close()
+        with self.assertRaises(ValueError):
+            self.flash.read(0, 1)
+
+class TestGpioChipSelect(unittest.TestCase):
+    CS = (224, 225, 226)   # PH0 - PH2
+
+    def setUp(self):
+        self.devs = [SPI.Device('/dev/spidev0.0', speed=1000000, cs_gpio=cs) for cs in self.CS]
+        mockdev.spidev_stats(reset=True)
+
+    def tearDown(self):
+        for dev in self.devs:
+            dev.close()
+
+    def test_select(self):
+        dev = self.devs[0]
+        self.assertEqual(dev.cs_gpio, self.CS[0])
+        self.assertEqual([gpio_level(cs) for cs in self.CS], [1, 1, 1])
+        self.assertEqual(dev.xfer(b'abc', 3), b'abc')
+        self.assertEqual(gpio_level(self.CS[0]), 1)
+        # chip select is released after a segment with cs_change, so each
+        # run of segments is a message of its own
+        result = dev.transfer([{'tx': b'a', 'rx': 1, 'cs_change': True}, {'tx': b'b', 'rx': 1}])
+        self.assertEqual([bytes(r) for r in result], [b'a', b'b'])
+        self.assertEqual(mockdev.spidev_stats()['messages'], 3)
+        dev.mode = SPI.CS_HIGH
+        self.assertEqual(gpio_level(self.CS[0]), 0)
+        self.assertIsNone(SPI.Device('/dev/spidev0.1').cs_gpio)
+        with self.assertRaises(ValueError):
+            SPI.Device('/dev/spidev0.0', cs_gpio=-1)
+
+    def test_xfer_many(self):
+        a, b, c = self.devs
+        result = SPI.xfer_many([(a, b'\x01\x02', 2), (b, [3], 2), (c, b'', 1), (a, bytearray(b'\x04'), 1)])
+        self.assertEqual(result, [b'\x01\x02', b'\x03\x00', b'\x00', b'\x04'])
+        self.assertEqual(mockdev.spidev_stats()['messages'], 4)
+        self.assertEqual(SPI.xfer_many([]), [])
+        with self.assertRaises(TypeError):
+            SPI.xfer_many([(a, b'x')])
+        c.close()
+        with self.assertRaises(ValueError):
+            SPI.xfer_many([(a, b'x', 1), (c, b'y', 1)])
+
+    def test_threads(self):
+        errors = []
+        def run(dev, value):
+            for i in range(100):
+                if SPI.xfer_many([(dev, [value] * 10, 10), (self.devs[0], [value], 1)]) != \
+                        [bytes(bytearray([value] * 10)), bytes(bytearray([value]))]:
+                    errors.append(value)
+        threads = [threading.Thread(target=run, args=(dev, v)) for v, dev in enumerate(self.devs)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(errors, [])
+
+class TestDirect(unittest.TestCase):
+    def test_fifo_sized(self):
+        dev = SPI.Device('/dev/spidev1.0', speed=1000000, direct=True)
+        self.assertTrue(dev.direct)
+        mockdev.spidev_stats(reset=True)
+        self.assertEqual(dev.xfer(b'\x9f', 4), b'\x9f\x00\x00\x00')
+        self.assertEqual(dev.xfer(bytes(bytearray(range(64))), 64), bytes(bytearray(range(64))))
+        self.assertEqual(mockdev.spidev_stats()['messages'], 0)
+
+        # larger than the FIFO or not 8 bit words - spidev
+        data = os.urandom(65)
+        self.assertEqual(dev.xfer(data, 65), data)
+        dev.bits = 16
+        self.assertEqual(dev.xfer(b'ab', 2), b'ab')
+        self.assertEqual(mockdev.spidev_stats()['messages'], 2)
+
+        dev.direct = False
+        self.assertFalse(dev.direct)
+        dev.close()
+
+    def test_needs_bus(self):
+        dev = SPI.Device('/dev/spidev-loop')
+        with self.assertRaises(ValueError):
+            dev.direct = True
+        dev.close()
+
+class TestAcquisition(unittest.TestCase):
+    # BCM channel 2 is PH3, gpio 227
+    CHANNEL, DRDY = 2, 227
+
+    def setUp(self):
+        GPIO.setwarnings(False)
+        GPIO.setmode(GPIO.BCM)
+        self.dev = SPI.Device(ADC)
+        # the counter carries on from earlier tests
+        self.first = bytearray(self.dev.xfer(b'', 1))[0] + 1
+        self.acq = SPI.Acquisition(self.dev, self.DRDY, 4, capacity=4)
+
+    def tearDown(self):
+        self.acq.stop()
+        self.dev.close()
+        GPIO.cleanup()
+
+    def frames(self, first, count):
+        return bytes(bytearray((self.first + 4 * first + i) & 0xff for i in range(4 * count)))
+
+    def fire(self, count=1):
+        # one DRDY edge at a time, each read before the next
+        for _ in range(count):
+            deadline = time.time() + 5
+            while mockdev.gpio_pending(self.DRDY):
+                self.assertLess(time.time(), deadline)
+                time.sleep(0.001)
+            stats = self.acq.stats()
+            mockdev.gpio_edge(self.DRDY, 0)
+            while self.acq.stats()['queued'] + self.acq.stats()['overruns'] == stats['queued'] + stats['overruns']:
+                self.assertLess(time.time(), deadline)
+                time.sleep(0.001)
+
+    def test_drdy(self):
+        self.assertEqual(self.acq.frame_size, 4)
+        self.assertEqual(self.acq.read(), b'')
+        self.fire()
+        self.assertEqual(self.acq.read(), self.frames(0, 1))
+        self.fire(2)
+        self.assertEqual(self.acq.read(), self.frames(1, 2))
+
+    def test_ring_wrap(self):
+        self.fire(3)
+        self.assertEqual(self.acq.read(2), self.frames(0, 2))
+        # frames 2 to 5 fill the ring from slot 2 round to slot 1
+        self.fire(3)
+        self.assertEqual(self.acq.stats()['queued'], 4)
+        self.assertEqual(self.acq.read(max_frames=3), self.frames(2, 3))
+        self.fire()
+        self.assertEqual(self.acq.read(-1), self.frames(5, 2))
+
+    def test_overrun(self):
+        self.fire(6)
+        stats = self.acq.stats()
+        self.assertEqual((stats['frames'], stats['overruns'], stats['errors'], stats['queued']), (6, 2, 0, 4))
+        # the dropped frames were still clocked out of the device
+        self.assertEqual(self.acq.read(), self.frames(0, 4))
+        self.fire()
+        self.assertEqual(self.acq.read(), self.frames(6, 1))
+
+    def test_read_timeout(self):
+        start = time.time()
+        self.assertEqual(self.acq.read(timeout=0.2), b'')
+        self.assertGreaterEqual(time.time() - start, 0.19)
+        self.assertLess(time.time() - start, 2)
+
+        timer = threading.Timer(0.05, mockdev.gpio_edge, (self.DRDY, 1))
+        timer.start()
+        self.assertEqual(self.acq.read(1, timeout=5), self.frames(0, 1))
+        timer.join()
+        self.fire()
+        self.assertEqual(self.acq.read(0, timeout=None), b'')
+        self.assertEqual(self.acq.read(timeout=None), self.frames(1, 1))
+
+    def test_stop_wakes_reader(self):
+        errors = []
+        def read():
+            try:
+                self.acq.read(timeout=None)
+            except ValueError as e:
+                errors.append(e)
+        reader = threading.Thread(target=read)
+        reader.start()
+        time.sleep(0.05)     # let it block in the wait
+        self.acq.stop()
+        reader.join(5)
+        self.assertFalse(reader.is_alive())
+        self.assertEqual(len(errors), 1)
+
+    def test_stats_reset(self):
+        self.fire(5)
+        stats = self.acq.stats(reset=True)
+        self.assertEqual((stats['frames'], stats['overruns'], stats['queued']), (5, 1, 4))
+        stats = self.acq.stats()
+        self.assertEqual((stats['frames'], stats['overruns'], stats['errors'], stats['queued']), (0, 0, 0, 4))
+
+    def test_stop(self):
+        self.fire()
+        with self.assertRaises(ValueError):
+            GPIO.setup(self.CHANNEL, GPIO.IN)
+        self.acq.stop()
+        self.assertEqual(self.acq.stats()['queued'], 0)
+        with self.assertRaises(ValueError):
+            self.acq.read()
+        # the gpio is given back, and the value file closed
+        self.assertFalse(mockdev.gpio_pending(self.DRDY))
+        mockdev.gpio_edge(self.DRDY, 0)
+        self.assertFalse(mockdev.gpio_pending(self.DRDY))
+        GPIO.setup(self.CHANNEL, GPIO.IN)
+        GPIO.cleanup(self.CHANNEL)
+        self.acq.stop()
+
+        with SPI.Acquisition(self.dev, self.DRDY, 4) as acq:
+            self.assertEqual(acq.stats()['frames'], 0)
+        with self.assertRaises(ValueError):
+            acq.read()
+
+        # dealloc stops the thread and releases the gpio too
+        acq = SPI.Acquisition(self.dev, self.DRDY, 4)
+        del acq
+        GPIO.setup(self.CHANNEL, GPIO.IN)
+
+class TestGpioOwnership(unittest.TestCase):
+    # BCM channel 2 is PH3, gpio 227
+    CHANNEL, DRDY = 2, 227
+
+    def setUp(self):
+        GPIO.setwarnings(False)
+        GPIO.setmode(GPIO.BCM)
+        self.dev = SPI.Device('/dev/spidev0.0')
+
+    def tearDown(self):
+        self.dev.close()
+        GPIO.cleanup()
+
+    def test_drdy_owned_by_gpio(self):
+        # the pin table is shared with RPi._GPIO, so a pin it drives is refused
+        GPIO.setup(self.CHANNEL, GPIO.IN)
+        with self.assertRaises(ValueError):
+            SPI.Acquisition(self.dev, self.DRDY, 4)
+
+    def test_cs_owned_by_spi(self):
+        # BCM channel 3 is PH2, gpio 226
+        dev = SPI.Device('/dev/spidev0.0', cs_gpio=226)
+        with self.assertRaises(ValueError):
+            GPIO.setup(3, GPIO.OUT)
+        dev.close()
+        del dev
+        GPIO.setup(3, GPIO.OUT)
+        with self.assertRaises(ValueError):
+            SPI.Device('/dev/spidev0.0', cs_gpio=226)
+
+    def test_gpio_imported_on_demand(self):
+        # a chip select works in a process that never imported RPi.GPIO
+        subprocess.check_call([sys.executable, '-c',
+                               "from RPi import SPI; SPI.Device('/dev/spidev0.0', cs_gpio=224).xfer(b'a', 1)"],
+                              cwd=tempfile.gettempdir())
+
+class TestModule(unittest.TestCase):
+    def test_default_device(self):
+        SPI.open('/dev/spidev0.0', speed=500000)
+        self.assertEqual(SPI.xfer(b'hi', 2), b'hi')
+        self.assertEqual([bytes(r) for r in SPI.transfer([{'tx': b'x', 'rx': 1}])], [b'x'])
+        self.assertEqual(SPI.xfer_words([0x1234], 1, byteorder='little'), array.array('H', [0x1234]))
+        SPI.close()
+        with self.assertRaises(ValueError):
+            SPI.read(1)
+
+if __name__ == '__main__':
+    unittest.main()